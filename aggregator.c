@@ -0,0 +1,270 @@
+#define _GNU_SOURCE // for accept4
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cluster.h"
+#include "frame.h"
+#include "sched.h"
+
+// most events taken from epoll at once
+#define MAX_EVENTS 256
+
+/**
+ * @brief an accepted agent
+ */
+struct conn {
+  int fd;
+  struct frame_reader reader;
+  struct cluster_node *node; // NULL until the hello frame arrived
+  char peer[64];             // who connected, for messages
+};
+
+// set by SIGINT and SIGTERM to stop the event loop
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * @brief handler for the signals that stop the aggregator
+ *
+ * @param sig
+ */
+static void Stop(int sig) { stopping = 1; }
+
+/**
+ * @brief take the hello frame of a new agent
+ *
+ * @param c the cluster
+ * @param conn the agent
+ * @param hdr header of the frame
+ * @param payload payload of the frame
+ * @param now_ns CLOCK_MONOTONIC when it arrived
+ * @return 0 on success, -1 if the agent should be closed
+ */
+static int Hello(struct cluster *c, struct conn *conn,
+                 const struct frame_header *hdr, const char *payload,
+                 long long now_ns) {
+  struct hello_frame hello;
+  if (hdr->type != FRAME_HELLO || hdr->len != sizeof(hello)) {
+    fprintf(stderr, "aggregator: %s did not say hello\n", conn->peer);
+    return -1;
+  }
+  memcpy(&hello, payload, sizeof(hello));
+  if (hello.magic != HELLO_MAGIC) {
+    fprintf(stderr, "aggregator: %s has another byte order\n", conn->peer);
+    return -1;
+  }
+  hello.node[sizeof(hello.node) - 1] = '\0';
+  if (hello.node[0] == '\0') {
+    fprintf(stderr, "aggregator: %s sent no node name\n", conn->peer);
+    return -1;
+  }
+  conn->node = JoinCluster(c, hello.node);
+  conn->node->last_ns = now_ns; // up until it is late with its samples
+  fprintf(stderr, "aggregator: %s joined\n", conn->node->name);
+  return 0;
+}
+
+/**
+ * @brief read what an agent sent and merge every whole frame
+ *
+ * One read() per call, so an agent sending a lot cannot hold up the others.
+ *
+ * @param c the cluster
+ * @param conn the agent
+ * @param now_ns CLOCK_MONOTONIC of the wakeup
+ * @return 0 on success, -1 if the agent should be closed
+ */
+static int ReadAgent(struct cluster *c, struct conn *conn, long long now_ns) {
+  struct frame_reader *r = &conn->reader;
+  struct frame_header hdr;
+  const char *payload;
+  ssize_t n = read(conn->fd, r->buf + r->len, r->size - r->len);
+  if (n < 0) {
+    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+  }
+  if (n == 0) {
+    return -1; // the agent stopped
+  }
+  r->len += n;
+  while (1) {
+    // never grow the buffer for a length nobody would send
+    if (r->len - r->used >= sizeof(hdr)) {
+      memcpy(&hdr, r->buf + r->used, sizeof(hdr));
+      if (hdr.len > AGENT_MAX_BUFFER) {
+        fprintf(stderr, "aggregator: %s sent a bad frame\n", conn->peer);
+        return -1;
+      }
+    }
+    if (NextFrame(r, &hdr, &payload) == 0) {
+      return 0;
+    }
+    if (conn->node == NULL) {
+      if (Hello(c, conn, &hdr, payload, now_ns) < 0) {
+        return -1;
+      }
+    } else if (hdr.type != FRAME_STATS &&
+               MergeFrame(c, conn->node, &hdr, payload, now_ns) < 0) {
+      fprintf(stderr, "aggregator: %s sent a bad frame\n", conn->node->name);
+      return -1;
+    }
+  }
+}
+
+/**
+ * @brief close the connection of an agent, its node is kept
+ *
+ * @param conn the agent
+ */
+static void CloseAgent(struct conn *conn) {
+  if (conn->node != NULL) {
+    conn->node->connections--;
+    fprintf(stderr, "aggregator: %s left\n", conn->node->name);
+  }
+  close(conn->fd); // also removes it from the epoll set
+  free(conn->reader.buf);
+  free(conn);
+}
+
+/**
+ * @brief accept every agent waiting on the listening socket
+ *
+ * @param epfd the epoll set
+ * @param listen_fd the listening socket
+ */
+static void AcceptAgents(int epfd, int listen_fd) {
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  int fd;
+  while ((fd = accept4(listen_fd, (struct sockaddr *)&addr, &len,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    struct conn *conn = calloc(1, sizeof(struct conn));
+    if (conn == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+    conn->fd = fd;
+    snprintf(conn->peer, sizeof(conn->peer), "agent on fd %d", fd);
+    InitFrameReader(&conn->reader, fd);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      perror("epoll_ctl");
+      exit(1);
+    }
+    len = sizeof(addr);
+  }
+  if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+    perror("accept4"); // e.g. out of fds, the agent retries
+  }
+}
+
+/**
+ * @brief main function of the aggregator
+ *
+ * Agents started with sys_monitoring_tool --agent connect to the endpoint
+ * given with --listen and stream their samples; once a period the latest
+ * values of every node and their spread over the fleet are printed. All
+ * agents are served by one thread with one epoll set. Runs until stopped
+ * with SIGINT or SIGTERM, or for --samples=N tables.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+  int sample_size = INT_MAX;
+  long long period = 1000000; // in microseconds
+  const char *endpoint = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (strncmp(argv[i], "--listen=", 9) == 0 && argv[i][9] != '\0') {
+      endpoint = argv[i] + 9;
+    } else {
+      printf("Invalid command line arguments\n");
+      exit(0);
+    }
+  }
+  if (endpoint == NULL) {
+    fprintf(stderr, "usage: aggregator --listen=HOST:PORT|unix:PATH "
+                    "[--tdelay=T] [--samples=N]\n");
+    exit(1);
+  }
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = Stop;
+  if (sigaction(SIGINT, &sa, NULL) < 0 || sigaction(SIGTERM, &sa, NULL) < 0 ||
+      signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+    perror("sigaction");
+    exit(1);
+  }
+  // one fd per agent
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  struct cluster cluster;
+  InitCluster(&cluster);
+  int listen_fd = ListenEndpoint(endpoint);
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+    perror("epoll");
+    exit(1);
+  }
+  printf("Aggregating samples on %s\n", endpoint);
+  fflush(stdout);
+
+  struct epoll_event events[MAX_EVENTS];
+  long long period_ns = period * 1000;
+  long long next = MonotonicNow() + period_ns;
+  int shown = 0;
+  while (!stopping && shown < sample_size) {
+    long long now = MonotonicNow();
+    if (now >= next) {
+      PrintCluster(stdout, &cluster, now, period_ns);
+      fflush(stdout);
+      shown++;
+      // a late display is not caught up, the next one keeps the grid
+      next += ((now - next) / period_ns + 1) * period_ns;
+      continue;
+    }
+    int timeout = (int)((next - now + 999999) / 1000000);
+    int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      exit(1);
+    }
+    now = MonotonicNow();
+    for (int i = 0; i < n; i++) {
+      struct conn *conn = events[i].data.ptr;
+      if (conn == NULL) {
+        AcceptAgents(epfd, listen_fd);
+      } else if (ReadAgent(&cluster, conn, now) < 0) {
+        CloseAgent(conn);
+      }
+    }
+  }
+  if (strncmp(endpoint, "unix:", 5) == 0) {
+    unlink(endpoint + 5);
+  }
+  return 0;
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#include "alert.h"
+#include "export.h"
+
+// names of the statistics in rules, the latest value has none
+static const char *const stat_names[STAT_NUM] = {"",    "ewma", "mean", "p50",
+                                                 "p95", "p99",  "rate"};
+
+/**
+ * @brief parse a rule such as "cpu.usage>90" or "mem.available:ewma<2G"
+ *
+ * The threshold may end in k, M, G or T for thousands up to 10^12, so sizes
+ * read like the GB shown elsewhere, and in '%' which is ignored.
+ *
+ * @param text the rule
+ * @param rule where to store it
+ * @return 0 on success, -1 if the rule is malformed
+ */
+int ParseAlert(const char *text, struct alert_rule *rule) {
+  memset(rule, 0, sizeof(*rule));
+  const char *op = strpbrk(text, "<>");
+  if (op == NULL || strlen(text) >= sizeof(rule->text)) {
+    return -1;
+  }
+  const char *colon = memchr(text, ':', op - text);
+  const char *name_end = colon != NULL ? colon : op;
+  rule->metric = FindMetric(text, name_end - text);
+  if (rule->metric < 0) {
+    return -1;
+  }
+  rule->stat = -1;
+  for (int i = 0; i < STAT_NUM; i++) {
+    size_t len = strlen(stat_names[i]);
+    if (colon == NULL ? len == 0
+                      : (size_t)(op - colon - 1) == len && len > 0 &&
+                            memcmp(colon + 1, stat_names[i], len) == 0) {
+      rule->stat = i;
+    }
+  }
+  if (rule->stat < 0) {
+    return -1;
+  }
+  rule->above = *op == '>';
+  char *end;
+  rule->threshold = strtod(op + 1, &end);
+  if (end == op + 1) {
+    return -1;
+  }
+  const char *units = "kMGT";
+  const char *unit = *end != '\0' ? strchr(units, *end) : NULL;
+  if (unit != NULL) {
+    for (int i = 0; i <= unit - units; i++) {
+      rule->threshold *= 1000;
+    }
+    end++;
+  }
+  if (*end == '%') {
+    end++;
+  }
+  if (*end != '\0') {
+    return -1;
+  }
+  strcpy(rule->text, text);
+  return 0;
+}
+
+/**
+ * @brief parse the --alert-to argument: stderr, stdout or exec:COMMAND
+ *
+ * @param text the value of the argument
+ * @param a where to store the sink
+ * @return 0 on success, -1 if it is none of these
+ */
+int ParseAlertSink(const char *text, struct alerts *a) {
+  if (strcmp(text, "stderr") == 0) {
+    a->sink = ALERT_STDERR;
+  } else if (strcmp(text, "stdout") == 0) {
+    a->sink = ALERT_STDOUT;
+  } else if (strncmp(text, "exec:", 5) == 0 && text[5] != '\0') {
+    a->sink = ALERT_EXEC;
+    a->hook = text + 5;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief the statistic of a metric a rule compares
+ *
+ * @param m the metric
+ * @param stat e.g. STAT_P99
+ * @return the value
+ */
+static double StatValue(const struct metric *m, int stat) {
+  switch (stat) {
+  case STAT_EWMA:
+    return m->ewma;
+  case STAT_MEAN:
+    return m->mean;
+  case STAT_P50:
+    return Quantile(m, 0.5);
+  case STAT_P95:
+    return Quantile(m, 0.95);
+  case STAT_P99:
+    return Quantile(m, 0.99);
+  case STAT_RATE:
+    return m->rate;
+  default:
+    return m->last;
+  }
+}
+
+/**
+ * @brief run the hook command of an alert without waiting for it
+ *
+ * The command runs in a grandchild, so it never has to be reaped and a slow
+ * hook does not hold up sampling. It gets the alert in its environment,
+ * which is built before the fork: with collector or recorder threads the
+ * child may only make async-signal-safe calls, and setenv allocates.
+ *
+ * @param hook the command
+ * @param rule the rule that fired or resolved
+ * @param value the value of its statistic
+ */
+static void RunHook(const char *hook, const struct alert_rule *rule,
+                    double value) {
+  char vars[4][128];
+  snprintf(vars[0], sizeof(vars[0]), "SMT_ALERT=%s", rule->text);
+  snprintf(vars[1], sizeof(vars[1]), "SMT_ALERT_STATE=%s",
+           rule->firing ? "firing" : "resolved");
+  snprintf(vars[2], sizeof(vars[2]), "SMT_ALERT_METRIC=%s",
+           metric_names[rule->metric]);
+  snprintf(vars[3], sizeof(vars[3]), "SMT_ALERT_VALUE=%g", value);
+  size_t count = 0;
+  while (environ[count] != NULL) {
+    count++;
+  }
+  char **env = malloc((count + 5) * sizeof(char *));
+  if (env == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (strncmp(environ[i], "SMT_ALERT", 9) != 0) {
+      env[n++] = environ[i]; // ours replace any inherited
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    env[n++] = vars[i];
+  }
+  env[n] = NULL;
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    free(env);
+    return; // the alert is still shown
+  }
+  if (pid == 0) {
+    if (fork() == 0) {
+      execle("/bin/sh", "sh", "-c", hook, (char *)NULL, env);
+      static const char msg[] = "/bin/sh: exec failed\n";
+      if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0) {
+        // nowhere left to report it
+      }
+      _exit(127);
+    }
+    _exit(0);
+  }
+  waitpid(pid, NULL, 0);
+  free(env);
+}
+
+/**
+ * @brief send an alert that fired or resolved to the sink
+ *
+ * @param a the rules and sink
+ * @param rule the rule
+ * @param value the value of its statistic
+ * @param time_ns CLOCK_REALTIME of the sample that changed it
+ */
+static void Notify(struct alerts *a, const struct alert_rule *rule,
+                   double value, long long time_ns) {
+  const char *state = rule->firing ? "firing" : "resolved";
+  if (a->sink == ALERT_EXEC) {
+    RunHook(a->hook, rule, value);
+  } else if (a->framed) {
+    return; // a line outside the frame would shift every later frame
+  } else if (a->sink == ALERT_STDOUT && a->format == FORMAT_JSONL) {
+    printf("{\"time\":%lld.%09lld,\"alert\":\"%s\",\"state\":\"%s\","
+           "\"value\":%g}\n",
+           time_ns / 1000000000, time_ns % 1000000000, rule->text, state,
+           value);
+  } else {
+    fprintf(a->sink == ALERT_STDOUT ? stdout : stderr,
+            "alert: %s %s (value %g)\n", rule->text, state, value);
+  }
+}
+
+/**
+ * @brief check the rules on the metrics of a collector that just sampled
+ *
+ * @param a the rules
+ * @param set the statistics, with the new sample added
+ * @param source which collector sampled
+ */
+void CheckAlerts(struct alerts *a, const struct metric_set *set, int source) {
+  for (int i = 0; i < a->count; i++) {
+    struct alert_rule *rule = &a->rules[i];
+    const struct metric *m = &set->m[rule->metric];
+    if (MetricSource(rule->metric) != source ||
+        m->count < (rule->stat == STAT_RATE ? 2 : 1)) {
+      continue;
+    }
+    double value = StatValue(m, rule->stat);
+    int holds = rule->above ? value > rule->threshold : value < rule->threshold;
+    if (holds != rule->firing) {
+      rule->firing = holds;
+      rule->fired += holds;
+      Notify(a, rule, value, m->last_ns);
+    }
+  }
+}
+
+/**
+ * @brief Displaying the state of every rule
+ *
+ * @param out where to print
+ * @param a the rules
+ * @param set the statistics
+ */
+void PrintAlerts(FILE *out, const struct alerts *a,
+                 const struct metric_set *set) {
+  for (int i = 0; i < a->count; i++) {
+    const struct alert_rule *rule = &a->rules[i];
+    const struct metric *m = &set->m[rule->metric];
+    fprintf(out, "%-24s %-8s", rule->text, rule->firing ? "FIRING" : "ok");
+    if (m->count > 0) {
+      fprintf(out, " value %-12g", StatValue(m, rule->stat));
+    }
+    fprintf(out, " fired %lld times\n", rule->fired);
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef ALERT_H
+#define ALERT_H
+
+#include <stdio.h>
+
+#include "metrics.h"
+
+// the most rules given with --alert
+#define MAX_ALERTS 16
+
+// the statistic of a metric a rule compares
+#define STAT_VALUE 0 // the latest sample
+#define STAT_EWMA 1
+#define STAT_MEAN 2
+#define STAT_P50 3
+#define STAT_P95 4
+#define STAT_P99 5
+#define STAT_RATE 6 // change per second since the sample before
+#define STAT_NUM 7
+
+// where alerts go
+#define ALERT_STDERR 0
+#define ALERT_STDOUT 1 // the output stream, a record with --format=jsonl, not
+                       // allowed with --format=csv
+#define ALERT_EXEC 2   // a hook command run by /bin/sh
+
+/**
+ * @brief a threshold on a statistic of a metric, e.g. "cpu.usage:p99>95"
+ *
+ * A rule fires once when its condition becomes true and resolves once when
+ * it becomes false again, so a metric staying above the threshold does not
+ * repeat the alert every sample.
+ */
+struct alert_rule {
+  char text[64];    // the rule as given
+  int metric;       // e.g. METRIC_CPU_USAGE
+  int stat;         // e.g. STAT_P99
+  int above;        // 1 for '>', 0 for '<'
+  double threshold;
+  int firing;       // 1 while the condition holds
+  long long fired;  // number of times it fired
+};
+
+/**
+ * @brief the rules and where their alerts go
+ */
+struct alerts {
+  struct alert_rule rules[MAX_ALERTS];
+  int count;
+  int sink;         // ALERT_STDERR, ALERT_STDOUT or ALERT_EXEC
+  const char *hook; // command of ALERT_EXEC
+  int format;       // format of the output stream, for ALERT_STDOUT
+  int framed;       // 1 if the screen redraws frames, which show the rules
+};
+
+int ParseAlert(const char *text, struct alert_rule *rule);
+int ParseAlertSink(const char *text, struct alerts *a);
+void CheckAlerts(struct alerts *a, const struct metric_set *set, int source);
+void PrintAlerts(FILE *out, const struct alerts *a,
+                 const struct metric_set *set);
+
+#endif
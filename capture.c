@@ -0,0 +1,653 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "profile.h"
+#include "sched.h"
+
+// the collector each captured file belongs to
+static const int file_sources[CAPTURE_FILES] = {SOURCE_CPU, SOURCE_MEM,
+                                                SOURCE_USER};
+
+/**
+ * @brief make room for at least size bytes in a snapshot
+ *
+ * @param s the snapshot
+ * @param size number of bytes needed
+ */
+static void Reserve(struct raw_file *s, size_t size) {
+  if (size <= s->size) {
+    return;
+  }
+  while (s->size < size) {
+    s->size = s->size == 0 ? 4096 : s->size * 2;
+  }
+  s->buf = realloc(s->buf, s->size);
+  if (s->buf == NULL) {
+    perror("realloc");
+    exit(1);
+  }
+}
+
+/**
+ * @brief append bytes to a record
+ *
+ * @param rec the record
+ * @param src what to append
+ * @param len number of bytes
+ */
+static void PutBytes(struct raw_file *rec, const void *src, size_t len) {
+  Reserve(rec, rec->len + len);
+  memcpy(rec->buf + rec->len, src, len);
+  rec->len += len;
+}
+
+/**
+ * @brief append a number to a record, seven bits per byte
+ *
+ * @param rec the record
+ * @param v the number
+ */
+static void PutVarint(struct raw_file *rec, uint64_t v) {
+  unsigned char bytes[10];
+  size_t n = 0;
+  do {
+    bytes[n] = (v & 0x7f) | (v > 0x7f ? 0x80 : 0);
+    v >>= 7;
+    n++;
+  } while (v != 0);
+  PutBytes(rec, bytes, n);
+}
+
+/**
+ * @brief take a number stored by PutVarint
+ *
+ * @param p where the number starts, moved past it
+ * @param end end of the record
+ * @param v where to store the number
+ * @return 0 on success, -1 if the record ends within the number
+ */
+static int GetVarint(const char **p, const char *end, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    unsigned char b = *(*p)++;
+    *v |= (uint64_t)(b & 0x7f) << shift;
+    if ((b & 0x80) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief the length of the line starting at p, with its newline
+ *
+ * @param p start of the line
+ * @param end end of the file
+ * @return the length, 0 at the end of the file
+ */
+static size_t LineLen(const char *p, const char *end) {
+  const char *eol = memchr(p, '\n', end - p);
+  return eol != NULL ? (size_t)(eol - p + 1) : (size_t)(end - p);
+}
+
+/**
+ * @brief append the lines of a file that changed to a record
+ *
+ * Lines are compared with the line of the same number in the old file, which
+ * keeps a /proc file whose numbers grow by a digit cheap to store.
+ *
+ * @param rec the record
+ * @param old the file as of the record before
+ * @param now the file as of this tick
+ */
+static void PutDelta(struct raw_file *rec, const struct raw_file *old,
+                     const struct raw_file *now) {
+  const char *o = old->buf;
+  const char *oend = old->buf + old->len;
+  const char *n = now->buf;
+  const char *nend = now->buf + now->len;
+  PutVarint(rec, now->len);
+  while (n < nend) {
+    uint64_t same = 0;
+    size_t nl = LineLen(n, nend);
+    size_t ol = LineLen(o, oend);
+    while (n < nend && nl == ol && memcmp(n, o, nl) == 0) {
+      n += nl;
+      o += ol;
+      same++;
+      nl = LineLen(n, nend);
+      ol = LineLen(o, oend);
+    }
+    PutVarint(rec, same);
+    if (n == nend) {
+      break;
+    }
+    size_t prefix = 0;
+    while (prefix < nl && prefix < ol && n[prefix] == o[prefix]) {
+      prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < nl - prefix && suffix < ol - prefix &&
+           n[nl - 1 - suffix] == o[ol - 1 - suffix]) {
+      suffix++;
+    }
+    PutVarint(rec, prefix);
+    PutVarint(rec, suffix);
+    PutVarint(rec, nl - prefix - suffix);
+    PutBytes(rec, n + prefix, nl - prefix - suffix);
+    n += nl;
+    o += ol;
+  }
+}
+
+/**
+ * @brief rebuild a file from its old content and a delta
+ *
+ * @param old the file as of the record before
+ * @param p start of the delta, moved past it
+ * @param end end of the record
+ * @param out where to store the file
+ * @return 0 on success, -1 if the delta is malformed
+ */
+static int ApplyDelta(const struct raw_file *old, const char **p,
+                      const char *end, struct raw_file *out) {
+  const char *o = old->buf;
+  const char *oend = old->buf + old->len;
+  uint64_t len, same, prefix, suffix, mid;
+  // every byte comes either from the old file or from the record
+  if (GetVarint(p, end, &len) < 0 || len > old->len + (uint64_t)(end - *p)) {
+    return -1;
+  }
+  Reserve(out, len);
+  out->len = 0;
+  while (out->len < len) {
+    if (GetVarint(p, end, &same) < 0) {
+      return -1;
+    }
+    for (uint64_t i = 0; i < same; i++) {
+      size_t ol = LineLen(o, oend);
+      if (ol == 0 || out->len + ol > len) {
+        return -1;
+      }
+      memcpy(out->buf + out->len, o, ol);
+      out->len += ol;
+      o += ol;
+    }
+    if (out->len == len) {
+      break;
+    }
+    size_t ol = LineLen(o, oend);
+    if (GetVarint(p, end, &prefix) < 0 || GetVarint(p, end, &suffix) < 0 ||
+        GetVarint(p, end, &mid) < 0 || prefix + suffix > ol ||
+        mid > (uint64_t)(end - *p) || out->len + prefix + mid + suffix > len) {
+      return -1;
+    }
+    memcpy(out->buf + out->len, o, prefix);
+    memcpy(out->buf + out->len + prefix, *p, mid);
+    memcpy(out->buf + out->len + prefix + mid, o + ol - suffix, suffix);
+    out->len += prefix + mid + suffix;
+    *p += mid;
+    o += ol;
+  }
+  return 0;
+}
+
+/**
+ * @brief write a whole buffer, retrying after partial writes
+ *
+ * @param fd where to write
+ * @param buf what to write
+ * @param len number of bytes
+ */
+static void WriteAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      perror("write");
+      exit(1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief append the record of the files in now to the capture
+ *
+ * The record is written with one write(), so a capture cut short by the end
+ * of the process holds whole records but for the last one at most.
+ *
+ * @param r the recorder
+ * @param first 1 for the record of the read before the first tick
+ * @param hdr header of the record, len is filled in
+ */
+static void WriteRecord(struct recorder *r, int first,
+                        struct capture_record hdr) {
+  r->record.len = 0;
+  PutBytes(&r->record, &hdr, sizeof(hdr));
+  for (int i = 0; i < CAPTURE_FILES; i++) {
+    const struct raw_file *old = &r->last[i];
+    const struct raw_file *now = &r->now[i];
+    size_t mark = r->record.len;
+    if (!first && now->len == old->len &&
+        memcmp(now->buf, old->buf, now->len) == 0) {
+      PutBytes(&r->record, "\0", 1); // CAPTURE_SAME
+      continue;
+    }
+    if (!first) {
+      char kind = CAPTURE_DELTA;
+      PutBytes(&r->record, &kind, 1);
+      PutDelta(&r->record, old, now);
+    }
+    if (first || r->record.len - mark > now->len + 1) {
+      // the whole file is no larger than its delta
+      char kind = CAPTURE_FULL;
+      r->record.len = mark;
+      PutBytes(&r->record, &kind, 1);
+      PutVarint(&r->record, now->len);
+      PutBytes(&r->record, now->buf, now->len);
+    }
+  }
+  hdr.len = r->record.len - sizeof(hdr);
+  memcpy(r->record.buf, &hdr, sizeof(hdr));
+  WriteAll(r->fd, r->record.buf, r->record.len);
+
+  for (int i = 0; i < CAPTURE_FILES; i++) {
+    struct raw_file tmp = r->last[i];
+    r->last[i] = r->now[i];
+    r->now[i] = tmp;
+    r->now[i].len = 0;
+  }
+}
+
+/**
+ * @brief thread writing a record each time the files of a tick are complete
+ *
+ * The first record only holds /proc/stat, read by the cpu collector before
+ * its first tick. The files are taken over under the lock and encoded
+ * after, so a collector only waits for the recorder if it is a whole record
+ * ahead.
+ *
+ * @param arg the recorder
+ * @return NULL
+ */
+static void *RecordThread(void *arg) {
+  struct recorder *r = arg;
+  for (int i = 0; i <= r->sample_size; i++) {
+    int expected = i == 0 ? r->expected & 1 << CAPTURE_STAT : r->expected;
+    pthread_mutex_lock(&r->lock);
+    while ((r->present & expected) != expected && !r->done) {
+      pthread_cond_wait(&r->cond, &r->lock);
+    }
+    if ((r->present & expected) != expected) {
+      pthread_mutex_unlock(&r->lock); // a record that was cut short
+      break;
+    }
+    struct capture_record hdr = {0, 0, i == 0 ? r->real : 0};
+    for (int f = 0; f < CAPTURE_FILES; f++) {
+      if (expected & 1 << f) {
+        struct raw_file tmp = r->now[f];
+        r->now[f] = r->incoming[f];
+        r->incoming[f] = tmp;
+        // a late collector stamps the record with its later tick
+        hdr.timestamp = r->timestamp[f] > hdr.timestamp ? r->timestamp[f]
+                                                        : hdr.timestamp;
+        hdr.missed = r->missed[f] > hdr.missed ? r->missed[f] : hdr.missed;
+      }
+    }
+    r->present &= ~expected;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    WriteRecord(r, i == 0, hdr);
+  }
+  return NULL;
+}
+
+/**
+ * @brief hand the bytes a collector parsed on a tick over to the recorder
+ *
+ * Blocks only while the file of the tick before was not taken over yet.
+ *
+ * @param r the recorder
+ * @param file e.g. CAPTURE_STAT
+ * @param buf the bytes
+ * @param len number of bytes
+ * @param timestamp CLOCK_REALTIME of the tick
+ * @param missed ticks the collector skipped so far
+ */
+void CaptureFile(struct recorder *r, int file, const char *buf, size_t len,
+                 long long timestamp, long long missed) {
+  pthread_mutex_lock(&r->lock);
+  while ((r->present & 1 << file) && !r->done) {
+    pthread_cond_wait(&r->cond, &r->lock);
+  }
+  struct raw_file *in = &r->incoming[file];
+  Reserve(in, len);
+  memcpy(in->buf, buf, len);
+  in->len = len;
+  r->timestamp[file] = timestamp;
+  r->missed[file] = missed;
+  r->present |= 1 << file;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+}
+
+/**
+ * @brief create a capture file and start recording into it
+ *
+ * @param r recorder to start
+ * @param path the capture file, replaced if it exists
+ * @param sources for each collector, 1 if it runs and hands over its files
+ * @param sample_size number of ticks to record after the first read
+ * @param period microseconds between ticks
+ * @param real CLOCK_REALTIME of tick 0
+ */
+void StartRecorder(struct recorder *r, const char *path, const int *sources,
+                   int sample_size, long long period, long long real) {
+  memset(r, 0, sizeof(*r));
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->cond, NULL);
+  r->sample_size = sample_size;
+  r->real = real;
+  for (int f = 0; f < CAPTURE_FILES; f++) {
+    r->expected |= sources[file_sources[f]] << f;
+  }
+  r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (r->fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  struct capture_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, CAPTURE_MAGIC, sizeof(hdr.magic));
+  hdr.version = CAPTURE_VERSION;
+  hdr.files = CAPTURE_FILES;
+  hdr.period = period;
+  WriteAll(r->fd, (const char *)&hdr, sizeof(hdr));
+
+  sigset_t block, old;
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTSTP);
+  pthread_sigmask(SIG_BLOCK, &block, &old);
+  int err = pthread_create(&r->thread, NULL, RecordThread, r);
+  if (err != 0) {
+    fprintf(stderr, "pthread_create: %s\n", strerror(err));
+    exit(1);
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief write the records still complete and close the capture
+ *
+ * Must be called once the collectors stopped handing over files.
+ *
+ * @param r the recorder
+ */
+void StopRecorder(struct recorder *r) {
+  pthread_mutex_lock(&r->lock);
+  r->done = 1;
+  pthread_cond_broadcast(&r->cond);
+  pthread_mutex_unlock(&r->lock);
+  pthread_join(r->thread, NULL);
+  close(r->fd);
+  for (int i = 0; i < CAPTURE_FILES; i++) {
+    free(r->incoming[i].buf);
+    free(r->last[i].buf);
+    free(r->now[i].buf);
+  }
+  free(r->record.buf);
+  pthread_cond_destroy(&r->cond);
+  pthread_mutex_destroy(&r->lock);
+}
+
+/**
+ * @brief decode the next record into the files of the replay
+ *
+ * A malformed record ends the program, the same as a file the collectors
+ * cannot read.
+ *
+ * @param r the replay
+ */
+static void DecodeRecord(struct replay *r) {
+  struct capture_record hdr;
+  memcpy(&hdr, r->map + r->pos, sizeof(hdr));
+  const char *p = r->map + r->pos + sizeof(hdr);
+  const char *end = p + hdr.len;
+  r->pos += sizeof(hdr) + hdr.len;
+  r->interval = hdr.timestamp - r->timestamp;
+  r->timestamp = hdr.timestamp;
+  r->missed = hdr.missed;
+  for (int i = 0; i < CAPTURE_FILES; i++) {
+    long long stage = StageStart();
+    struct raw_file *file = &r->files[i];
+    uint64_t len;
+    int kind = p < end ? *p++ : -1;
+    if (kind == CAPTURE_FULL && GetVarint(&p, end, &len) == 0 &&
+        len <= (uint64_t)(end - p)) {
+      Reserve(file, len);
+      memcpy(file->buf, p, len);
+      file->len = len;
+      p += len;
+    } else if (kind == CAPTURE_DELTA &&
+               ApplyDelta(file, &p, end, &r->scratch) == 0) {
+      struct raw_file tmp = *file;
+      *file = r->scratch;
+      r->scratch = tmp;
+    } else if (kind != CAPTURE_SAME) {
+      fprintf(stderr, "capture: record %d is malformed\n", r->taken);
+      exit(1);
+    }
+    StageEnd(file_sources[i], STAGE_READ, stage);
+  }
+}
+
+/**
+ * @brief the number of cpu ids in /proc/stat, one past the highest cpuN line
+ *
+ * @param s content of /proc/stat
+ * @return the number of ids
+ */
+static int CountCores(const struct raw_file *s) {
+  int count = 0;
+  const char *end = s->buf + s->len;
+  for (const char *p = s->buf; p < end; p += LineLen(p, end)) {
+    if (end - p > 3 && memcmp(p, "cpu", 3) == 0 && p[3] >= '0' &&
+        p[3] <= '9') {
+      int id = atoi(p + 3);
+      count = id >= count ? id + 1 : count;
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief open a capture file to replay it
+ *
+ * The first record is decoded right away, as the counters the first sample
+ * is compared with. A last record cut short while recording is ignored.
+ *
+ * @param r where to store the replay
+ * @param path the capture file
+ * @param speed 1 for the recorded pace, 1000 for a thousand times faster,
+ * 0 for as fast as possible
+ * @return 0 on success, -1 if the file is not a capture or holds no sample
+ */
+int OpenReplay(struct replay *r, const char *path, double speed) {
+  struct capture_header hdr;
+  struct stat st;
+  memset(r, 0, sizeof(*r));
+  r->speed = speed;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(path);
+    exit(1);
+  }
+  if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+      memcmp(hdr.magic, CAPTURE_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.version != CAPTURE_VERSION || hdr.files != CAPTURE_FILES) {
+    fprintf(stderr, "%s is not a capture file\n", path);
+    close(fd);
+    return -1;
+  }
+  r->map_size = st.st_size;
+  r->map = mmap(NULL, r->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (r->map == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  r->period = hdr.period;
+
+  // count the complete records
+  int records = 0;
+  size_t pos = sizeof(hdr);
+  while (r->map_size - pos >= sizeof(struct capture_record)) {
+    struct capture_record rec;
+    memcpy(&rec, r->map + pos, sizeof(rec));
+    if (r->map_size - pos - sizeof(rec) < rec.len) {
+      break;
+    }
+    pos += sizeof(rec) + rec.len;
+    records++;
+  }
+  if (records < 2) {
+    fprintf(stderr, "%s holds no sample\n", path);
+    munmap(r->map, r->map_size);
+    return -1;
+  }
+  r->ticks = records - 1;
+
+  r->pos = sizeof(hdr);
+  DecodeRecord(r);
+  r->first = r->timestamp;
+  int cores = CountCores(&r->files[CAPTURE_STAT]);
+  InitCpuSample(&r->pre, cores);
+  InitCpuSample(&r->aft, cores);
+  ParseCpuStat(r->files[CAPTURE_STAT].buf, r->files[CAPTURE_STAT].len,
+               &r->pre);
+  return 0;
+}
+
+/**
+ * @brief wait until the next record is due and parse it
+ *
+ * @param r the replay
+ * @param wanted for each collector, 1 if its samples are shown
+ * @param out where to store the samples
+ * @param timeout_ms how long to wait at most, in milliseconds
+ * @return 1 if the record was parsed, 0 on timeout
+ */
+static int TakeRecord(struct replay *r, const int *wanted,
+                      struct samples *out, int timeout_ms) {
+  if (r->started == 0) {
+    r->started = MonotonicNow();
+  }
+  if (r->speed > 0) {
+    struct capture_record hdr;
+    memcpy(&hdr, r->map + r->pos, sizeof(hdr));
+    long long due = r->started + (hdr.timestamp - r->first) / r->speed;
+    long long limit = MonotonicNow() + timeout_ms * 1000000LL;
+    long long wake = due < limit ? due : limit;
+    struct timespec ts = {wake / 1000000000, wake % 1000000000};
+    if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0 ||
+        due > limit) {
+      return 0; // interrupted by ctrl-c or ctrl-z, or not due yet
+    }
+  }
+
+  DecodeRecord(r);
+  r->taken++;
+  const struct raw_file *files = r->files;
+  if (wanted[SOURCE_MEM]) {
+    long long stage = StageStart();
+    ParseMeminfo(files[CAPTURE_MEMINFO].buf, files[CAPTURE_MEMINFO].len,
+                 &out->mem.info);
+    ComputeMemory(&out->mem);
+    StageEnd(PROFILE_MEM, STAGE_PARSE, stage);
+  }
+  if (wanted[SOURCE_USER]) {
+    long long stage = StageStart();
+    ParseUsers(files[CAPTURE_UTMP].buf, files[CAPTURE_UTMP].len, &out->users);
+    StageEnd(PROFILE_USER, STAGE_PARSE, stage);
+  }
+  // the counters are parsed even if not shown, the next period needs them
+  long long stage = StageStart();
+  ParseCpuStat(files[CAPTURE_STAT].buf, files[CAPTURE_STAT].len, &r->aft);
+  if (wanted[SOURCE_CPU]) {
+    if (out->cpu.core_num < r->aft.core_num) {
+      free(out->cpu.cores);
+      InitCpuUsage(&out->cpu, r->aft.core_num);
+    }
+    CompareCpu(&r->pre, &r->aft, &out->cpu);
+  }
+  struct cpu_sample tmp = r->pre;
+  r->pre = r->aft;
+  r->aft = tmp;
+  StageEnd(PROFILE_CPU, STAGE_PARSE, stage);
+
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    r->pending |= wanted[i] << i;
+  }
+  return 1;
+}
+
+/**
+ * @brief take the sample of the next collector from the capture
+ *
+ * The samples of one record are delivered one collector at a time, the way
+ * the live collectors deliver them, once the record is due.
+ *
+ * @param r the replay
+ * @param wanted for each collector, 1 if its samples are shown
+ * @param out where to store the sample
+ * @param timeout_ms how long to wait at most, in milliseconds
+ * @return the collector the sample belongs to, -1 on timeout or at the end
+ */
+int NextReplayed(struct replay *r, const int *wanted, struct samples *out,
+                 int timeout_ms) {
+  if (r->pending == 0 &&
+      (r->taken == r->ticks || !TakeRecord(r, wanted, out, timeout_ms))) {
+    return -1;
+  }
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (r->pending & (1 << i)) {
+      r->pending &= ~(1 << i);
+      out->timestamp[i] = r->timestamp;
+      out->missed[i] = r->missed;
+      out->interval[i] = r->interval;
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief release a replay
+ *
+ * @param r the replay
+ */
+void CloseReplay(struct replay *r) {
+  munmap(r->map, r->map_size);
+  for (int i = 0; i < CAPTURE_FILES; i++) {
+    free(r->files[i].buf);
+  }
+  free(r->scratch.buf);
+  free(r->pre.cores);
+  free(r->pre.online);
+  free(r->aft.cores);
+  free(r->aft.online);
+}
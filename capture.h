@@ -0,0 +1,126 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu_stats.h"
+#include "render.h"
+
+#define CAPTURE_MAGIC "SMTCAPT1"
+#define CAPTURE_VERSION 1
+
+// the files captured on every tick, in the order they are stored
+#define CAPTURE_STAT 0    // /proc/stat
+#define CAPTURE_MEMINFO 1 // /proc/meminfo
+#define CAPTURE_UTMP 2    // utmp
+#define CAPTURE_FILES 3
+
+// how a file is stored in a record
+#define CAPTURE_SAME 0  // unchanged since the record before
+#define CAPTURE_FULL 1  // the whole file
+#define CAPTURE_DELTA 2 // the lines that changed since the record before
+
+/**
+ * @brief header at the start of a capture file
+ *
+ * The header is followed by one record per tick. The first record holds
+ * every file whole and only serves as the counters the first period is
+ * compared with, like the read a collector does before its first tick.
+ */
+struct capture_header {
+  char magic[8];    // CAPTURE_MAGIC
+  uint32_t version; // CAPTURE_VERSION
+  uint32_t files;   // CAPTURE_FILES
+  int64_t period;   // microseconds between ticks
+};
+
+/**
+ * @brief header of the record of one tick
+ *
+ * It is followed by every file in the order of CAPTURE_STAT and the others:
+ * a byte such as CAPTURE_DELTA, then for a full file its length as a varint
+ * and its bytes. A delta gives the length of the new file, then alternates
+ * between the number of lines unchanged since the record before and one
+ * changed line, stored as the bytes it shares with the start and the end
+ * of the old line and the bytes in between.
+ */
+struct capture_record {
+  uint32_t len;      // bytes of the files after this header
+  uint32_t missed;   // ticks the recorder skipped so far
+  int64_t timestamp; // CLOCK_REALTIME of the tick in nanoseconds
+};
+
+/**
+ * @brief the content of one file, or a record being encoded
+ */
+struct raw_file {
+  char *buf;
+  size_t len;  // bytes used
+  size_t size; // bytes allocated
+};
+
+/**
+ * @brief thread writing the raw files of every tick into a capture file
+ *
+ * The collector threads hand over the bytes they parsed with CaptureFile(),
+ * so a replay parses exactly what was shown. A record is written once every
+ * running collector handed over its file of the tick; the file of a
+ * collector that does not run stays empty.
+ */
+struct recorder {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int fd;           // the capture file
+  int sample_size;  // ticks to record after the first read
+  int expected;     // files handed over on every tick, as bits
+  int present;      // files handed over for the next record, as bits
+  int done;         // 1 once no more files are handed over
+  long long real;   // CLOCK_REALTIME of tick 0
+  long long timestamp[CAPTURE_FILES]; // CLOCK_REALTIME of each file
+  long long missed[CAPTURE_FILES];    // ticks its collector skipped so far
+  struct raw_file incoming[CAPTURE_FILES]; // files handed over
+  struct raw_file last[CAPTURE_FILES]; // files as of the record before
+  struct raw_file now[CAPTURE_FILES];  // files of this record
+  struct raw_file record;              // the record being encoded
+};
+
+/**
+ * @brief a capture file fed back through the parsers of the collectors
+ *
+ * Every record is decoded and parsed like the files of a live system, and
+ * delivered on the time it was recorded at, scaled by the speed.
+ */
+struct replay {
+  char *map;        // the capture file mapped into memory
+  size_t map_size;  // size of the mapping
+  size_t pos;       // start of the next record
+  int ticks;        // samples in the file, the complete records but one
+  int taken;        // samples decoded so far
+  long long period; // microseconds between ticks when recording
+  double speed;     // 1 for the recorded pace, 0 for as fast as possible
+  long long first;    // CLOCK_REALTIME of the first record
+  long long started;  // CLOCK_MONOTONIC the first sample was asked for at
+  long long timestamp; // CLOCK_REALTIME of the record decoded last
+  long long missed;    // ticks the recorder skipped, as of that record
+  long long interval;  // nanoseconds since the record before that one
+  int pending;         // sources of that record not delivered yet, as bits
+  struct raw_file files[CAPTURE_FILES]; // files as of the record decoded last
+  struct raw_file scratch;              // where a delta is decoded into
+  struct cpu_sample pre;                // /proc/stat of the record before
+  struct cpu_sample aft;                // /proc/stat of the record decoded last
+};
+
+void StartRecorder(struct recorder *r, const char *path, const int *sources,
+                   int sample_size, long long period, long long real);
+void CaptureFile(struct recorder *r, int file, const char *buf, size_t len,
+                 long long timestamp, long long missed);
+void StopRecorder(struct recorder *r);
+int OpenReplay(struct replay *r, const char *path, double speed);
+int NextReplayed(struct replay *r, const int *wanted, struct samples *out,
+                 int timeout_ms);
+void CloseReplay(struct replay *r);
+
+#endif
@@ -0,0 +1,548 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cgroup_stats.h"
+#include "procfs.h"
+
+// fds kept free for everything but the cached cgroup fds
+#define FD_RESERVE 64
+
+// names of the files read from every cgroup, in the order of cg_node.fds
+static const char *const cg_files[CG_FILES] = {
+    "memory.current", "memory.max", "memory.stat", "cpu.stat", "cpu.max"};
+
+/**
+ * @brief find where the cgroup2 hierarchy is mounted
+ *
+ * /proc/self/mounts is searched for a cgroup2 file system, so hybrid systems
+ * that mount it at /sys/fs/cgroup/unified are handled too.
+ *
+ * @param buf where to store the mount point
+ * @param size size of buf
+ */
+static void FindMount(char *buf, size_t size) {
+  char path[8192];
+  snprintf(buf, size, "/sys/fs/cgroup");
+  FILE *f = fopen(ProcPath("/proc/self/mounts", path, sizeof(path)), "r");
+  if (f == NULL) {
+    return;
+  }
+  char line[4096];
+  char dir[4096];
+  char type[64];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (sscanf(line, "%*s %4095s %63s", dir, type) == 2 &&
+        strcmp(type, "cgroup2") == 0 && strlen(dir) < size) {
+      strcpy(buf, dir);
+      break;
+    }
+  }
+  fclose(f);
+}
+
+/**
+ * @brief find the cgroup2 cgroup of the tool itself
+ *
+ * @param buf where to store the path, relative to the mount
+ * @param size size of buf
+ * @return 0 on success, -1 if the process is in no cgroup2 cgroup
+ */
+static int FindOwnCgroup(char *buf, size_t size) {
+  char path[8192];
+  FILE *f = fopen(ProcPath("/proc/self/cgroup", path, sizeof(path)), "r");
+  if (f == NULL) {
+    return -1;
+  }
+  char line[4096];
+  int found = -1;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, "0::", 3) == 0) {
+      line[strcspn(line, "\n")] = '\0';
+      snprintf(buf, size, "%s", line + 3);
+      found = 0;
+      break;
+    }
+  }
+  fclose(f);
+  return found;
+}
+
+/**
+ * @brief initialize a table of cgroups
+ *
+ * The open file limit is raised to its hard limit, so the files of thousands
+ * of cgroups can be kept open.
+ *
+ * @param t table to initialize
+ * @param cgroup path of the cgroup below the cgroup2 mount, NULL for the
+ * cgroup of the tool itself
+ * @param tree 1 to sample all descendants of the cgroup too
+ */
+void InitCgroupTable(struct cg_table *t, const char *cgroup, int tree) {
+  char mount[4096];
+  char own[4096];
+  char path[8192];
+  memset(t, 0, sizeof(*t));
+  t->tree = tree;
+  if (cgroup == NULL) {
+    if (FindOwnCgroup(own, sizeof(own)) < 0) {
+      fprintf(stderr, "cgroup_stats: not in a cgroup v2 hierarchy\n");
+      exit(1);
+    }
+    cgroup = own;
+  }
+  while (*cgroup == '/') {
+    cgroup++;
+  }
+  if (strlen(cgroup) >= sizeof(t->base)) {
+    fprintf(stderr, "cgroup_stats: cgroup path too long\n");
+    exit(1);
+  }
+  strcpy(t->base, *cgroup != '\0' ? cgroup : ".");
+  size_t len = strlen(t->base);
+  while (len > 1 && t->base[len - 1] == '/') {
+    t->base[--len] = '\0';
+  }
+
+  FindMount(mount, sizeof(mount));
+  t->mount_fd =
+      open(ProcPath(mount, path, sizeof(path)), O_RDONLY | O_DIRECTORY);
+  if (t->mount_fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  t->cap = 64;
+  t->nodes = calloc(t->cap, sizeof(struct cg_node));
+  if (t->nodes == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    t->fd_budget = limit.rlim_cur > FD_RESERVE ? limit.rlim_cur - FD_RESERVE : 0;
+    if (limit.rlim_cur == RLIM_INFINITY || t->fd_budget > 1 << 20) {
+      t->fd_budget = 1 << 20;
+    }
+  }
+}
+
+/**
+ * @brief close the fds a cgroup keeps open
+ *
+ * @param t the table
+ * @param n the cgroup
+ */
+static void CloseNode(struct cg_table *t, struct cg_node *n) {
+  if (n->dirfd >= 0) {
+    close(n->dirfd);
+    t->fd_budget++;
+  }
+  for (int f = 0; f < CG_FILES; f++) {
+    if (n->fds[f] >= 0) {
+      close(n->fds[f]);
+      t->fd_budget++;
+    }
+  }
+}
+
+/**
+ * @brief open a cgroup seen for the first time
+ *
+ * Which files exist is looked up once: the root cgroup has no limits and a
+ * cgroup only has the files of the controllers enabled for it. The directory
+ * and files are kept open while the fd budget allows.
+ *
+ * @param t the table
+ * @param n the cgroup, path and depth set
+ * @return 0 on success, -1 if the cgroup is gone
+ */
+static int OpenNode(struct cg_table *t, struct cg_node *n) {
+  int dirfd = openat(t->mount_fd, n->path, O_RDONLY | O_DIRECTORY);
+  if (dirfd < 0) {
+    return -1;
+  }
+  for (int f = 0; f < CG_FILES; f++) {
+    n->fds[f] = -2;
+    if (faccessat(dirfd, cg_files[f], R_OK, 0) != 0) {
+      n->fds[f] = -1;
+    } else if (t->fd_budget > 1) { // one is left for the directory
+      n->fds[f] = openat(dirfd, cg_files[f], O_RDONLY);
+      if (n->fds[f] >= 0) {
+        t->fd_budget--;
+      } else {
+        n->fds[f] = -2;
+      }
+    }
+  }
+  if (t->fd_budget > 0) {
+    n->dirfd = dirfd;
+    t->fd_budget--;
+  } else {
+    n->dirfd = -1;
+    close(dirfd);
+  }
+  n->removed = 0;
+  n->sampled = 0;
+  return 0;
+}
+
+/**
+ * @brief find a cgroup of the listing, moving it to the index of the listing
+ *
+ * The tree is listed in the same order every time, so the cgroup is normally
+ * already at that index and nothing is searched or moved.
+ *
+ * @param t the table
+ * @param i index in the listing
+ * @param path path of the cgroup
+ * @return the cgroup, NULL if it was not seen before
+ */
+static struct cg_node *FindNode(struct cg_table *t, int i, const char *path) {
+  for (int k = i; k < t->count; k++) {
+    struct cg_node *n = &t->nodes[k];
+    if (strcmp(n->path, path) == 0) {
+      if (k != i) {
+        struct cg_node tmp = t->nodes[i];
+        t->nodes[i] = *n;
+        *n = tmp;
+      }
+      return &t->nodes[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief make room for a new cgroup at index i
+ *
+ * The cgroup that was at i is moved to the end, where it is found again if
+ * it still exists.
+ *
+ * @param t the table
+ * @param i index in the listing
+ * @return the slot of the new cgroup
+ */
+static struct cg_node *InsertNode(struct cg_table *t, int i) {
+  if (t->count == t->cap) {
+    t->cap *= 2;
+    t->nodes = realloc(t->nodes, t->cap * sizeof(struct cg_node));
+    if (t->nodes == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  if (i < t->count) {
+    t->nodes[t->count] = t->nodes[i];
+  }
+  t->count++;
+  memset(&t->nodes[i], 0, sizeof(struct cg_node));
+  return &t->nodes[i];
+}
+
+/**
+ * @brief list a cgroup and its descendants, depth first
+ *
+ * @param t the table
+ * @param path path of the cgroup
+ * @param depth levels below the base cgroup
+ * @param i index of the cgroup in the listing
+ * @return index after the cgroup and its descendants
+ */
+static int ScanTree(struct cg_table *t, const char *path, int depth, int i) {
+  struct cg_node *n = FindNode(t, i, path);
+  if (n != NULL && n->removed) {
+    // removed and created again under the same name
+    CloseNode(t, n);
+    if (OpenNode(t, n) < 0) {
+      n->dirfd = -1;
+      memset(n->fds, -1, sizeof(n->fds));
+      return i; // dropped with the cgroups after the listing
+    }
+  } else if (n == NULL) {
+    n = InsertNode(t, i);
+    strcpy(n->path, path);
+    n->depth = depth;
+    if (OpenNode(t, n) < 0) {
+      t->count--;
+      if (i < t->count) {
+        t->nodes[i] = t->nodes[t->count];
+      }
+      return i;
+    }
+  }
+  i++;
+  if (!t->tree) {
+    return i;
+  }
+
+  int fd = openat(t->mount_fd, path, O_RDONLY | O_DIRECTORY);
+  DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+  if (dir == NULL) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return i;
+  }
+  char child[sizeof(n->path)];
+  struct dirent *e;
+  while ((e = readdir(dir)) != NULL) {
+    if (e->d_name[0] == '.' ||
+        (e->d_type != DT_DIR && e->d_type != DT_UNKNOWN)) {
+      continue;
+    }
+    struct stat st;
+    if (e->d_type == DT_UNKNOWN &&
+        (fstatat(fd, e->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode))) {
+      continue;
+    }
+    int len = strcmp(path, ".") == 0
+                  ? snprintf(child, sizeof(child), "%s", e->d_name)
+                  : snprintf(child, sizeof(child), "%s/%s", path, e->d_name);
+    if (len < (int)sizeof(child)) {
+      i = ScanTree(t, child, depth + 1, i);
+    }
+  }
+  closedir(dir);
+  return i;
+}
+
+/**
+ * @brief read one file of a cgroup into the buffer of the table
+ *
+ * @param t the table
+ * @param n the cgroup
+ * @param f which file, e.g. CG_CPU_STAT
+ * @return number of bytes read, 0 if the cgroup has no such file, -1 if the
+ * cgroup is gone
+ */
+static ssize_t ReadCgroupFile(struct cg_table *t, struct cg_node *n, int f) {
+  if (n->fds[f] == -1) {
+    t->buf[0] = '\0';
+    return 0;
+  }
+  int fd = n->fds[f];
+  if (fd < 0) {
+    char path[sizeof(n->path) + 32];
+    if (n->dirfd >= 0) {
+      fd = openat(n->dirfd, cg_files[f], O_RDONLY);
+    } else {
+      snprintf(path, sizeof(path), "%s/%s", n->path, cg_files[f]);
+      fd = openat(t->mount_fd, path, O_RDONLY);
+    }
+    if (fd < 0) {
+      return -1;
+    }
+  }
+  ssize_t len = pread(fd, t->buf, sizeof(t->buf) - 1, 0);
+  if (fd != n->fds[f]) {
+    close(fd);
+  }
+  if (len < 0) {
+    return -1; // ENODEV once the cgroup is removed
+  }
+  t->buf[len] = '\0';
+  return len;
+}
+
+/**
+ * @brief parse a single value that is either a number or "max"
+ *
+ * @param buf content of the file
+ * @return the value, -1 for "max"
+ */
+static long long ParseLimit(const char *buf) {
+  return strncmp(buf, "max", 3) == 0 ? -1 : strtoll(buf, NULL, 10);
+}
+
+/**
+ * @brief parse the "key value" lines of a file such as cpu.stat
+ *
+ * @param buf content of the file
+ * @param keys the keys wanted
+ * @param values where to store the value of each key, left as is if missing
+ * @param n number of keys
+ */
+static void ParseKeys(const char *buf, const char *const *keys,
+                      unsigned long long *values, int n) {
+  const char *p = buf;
+  while (*p != '\0') {
+    size_t len = strcspn(p, " ");
+    for (int k = 0; k < n; k++) {
+      if (strncmp(p, keys[k], len) == 0 && keys[k][len] == '\0') {
+        values[k] = strtoull(p + len, NULL, 10);
+        break;
+      }
+    }
+    p += strcspn(p, "\n");
+    if (*p == '\n') {
+      p++;
+    }
+  }
+}
+
+/**
+ * @brief read one sample of a cgroup
+ *
+ * @param t the table
+ * @param n the cgroup
+ * @return 0 on success, -1 if the cgroup is gone
+ */
+static int ReadNode(struct cg_table *t, struct cg_node *n) {
+  static const char *const cpu_keys[4] = {"usage_usec", "throttled_usec",
+                                          "nr_periods", "nr_throttled"};
+  static const char *const mem_keys[2] = {"anon", "file"};
+  unsigned long long cpu[4] = {n->usage_usec, n->throttled_usec,
+                               n->nr_periods, n->nr_throttled};
+  unsigned long long mem[2] = {0, 0};
+  memcpy(n->pre, cpu, sizeof(cpu));
+
+  if (ReadCgroupFile(t, n, CG_CPU_STAT) < 0) {
+    return -1;
+  }
+  ParseKeys(t->buf, cpu_keys, cpu, 4);
+  n->usage_usec = cpu[0];
+  n->throttled_usec = cpu[1];
+  n->nr_periods = cpu[2];
+  n->nr_throttled = cpu[3];
+  if (n->sampled == 0) {
+    memcpy(n->pre, cpu, sizeof(cpu)); // nothing to compare with yet
+  }
+
+  if (ReadCgroupFile(t, n, CG_CPU_MAX) < 0) {
+    return -1;
+  }
+  n->cpu_quota = -1;
+  n->cpu_period = 100000;
+  if (t->buf[0] != '\0') {
+    char *p;
+    n->cpu_quota = ParseLimit(t->buf);
+    p = strchr(t->buf, ' ');
+    if (p != NULL) {
+      n->cpu_period = strtoll(p + 1, NULL, 10);
+    }
+  }
+
+  if (ReadCgroupFile(t, n, CG_MEMORY_CURRENT) < 0) {
+    return -1;
+  }
+  n->mem_current = t->buf[0] != '\0' ? strtoll(t->buf, NULL, 10) : -1;
+  if (ReadCgroupFile(t, n, CG_MEMORY_MAX) < 0) {
+    return -1;
+  }
+  n->mem_max = t->buf[0] != '\0' ? ParseLimit(t->buf) : -1;
+  if (ReadCgroupFile(t, n, CG_MEMORY_STAT) < 0) {
+    return -1;
+  }
+  ParseKeys(t->buf, mem_keys, mem, 2);
+  n->anon = mem[0];
+  n->file = mem[1];
+  if (n->mem_current < 0 && n->fds[CG_MEMORY_STAT] != -1) {
+    n->mem_current = n->anon + n->file; // the root cgroup has no memory.current
+  }
+  n->sampled++;
+  return 0;
+}
+
+/**
+ * @brief take one sample of all cgroups of the table
+ *
+ * Every CG_RESCAN samples the tree is listed again to find cgroups that were
+ * created or removed; in between, only the kept open files are read again
+ * with pread. A cgroup whose files fail to read was removed and is skipped
+ * until the next listing drops it.
+ *
+ * @param t the table
+ * @param now_ns CLOCK_MONOTONIC of the sample in nanoseconds
+ */
+void ReadCgroups(struct cg_table *t, long long now_ns) {
+  if (t->generation % CG_RESCAN == 0) {
+    int count = ScanTree(t, t->base, 0, 0);
+    for (int i = count; i < t->count; i++) {
+      CloseNode(t, &t->nodes[i]);
+    }
+    t->count = count;
+    if (t->count == 0 && t->generation == 0) {
+      fprintf(stderr, "cgroup_stats: cannot open cgroup %s\n", t->base);
+      exit(1);
+    }
+  }
+  t->generation++;
+  for (int i = 0; i < t->count; i++) {
+    struct cg_node *n = &t->nodes[i];
+    if (!n->removed && ReadNode(t, n) < 0) {
+      n->removed = 1;
+    }
+  }
+  t->elapsed_ns = t->last_ns != 0 ? now_ns - t->last_ns : 0;
+  t->last_ns = now_ns;
+}
+
+/**
+ * @brief Displaying the usage of every cgroup against its limits
+ *
+ *    CPU is shown in percent of one core since the previous sample, next to
+ *    the limit set by cpu.max; memory in GB next to memory.max. Throttled is
+ *    the time the cgroup was stopped for exceeding its quota, and in how
+ *    many of the enforcement periods that happened.
+ *
+ * @param out where to print
+ * @param t the table, sampled at least twice
+ */
+void PrintCgroups(FILE *out, const struct cg_table *t) {
+  double usecs = t->elapsed_ns * 1e-3;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### cgroups ### (cpu used / limit -- memory used / limit, "
+               "throttled)\n");
+  for (int i = 0; i < t->count; i++) {
+    const struct cg_node *n = &t->nodes[i];
+    if (n->removed || n->sampled == 0) {
+      continue;
+    }
+    // the base cgroup by its path, descendants by their name
+    const char *name = n->path;
+    if (n->depth > 0 && strrchr(name, '/') != NULL) {
+      name = strrchr(name, '/') + 1;
+    } else if (strcmp(name, ".") == 0) {
+      name = "";
+    }
+    char label[sizeof(n->path) + 64];
+    snprintf(label, sizeof(label), "%*s%s%s", n->depth * 2, "",
+             n->depth == 0 ? "/" : "", name);
+    char cpu_limit[16];
+    char mem_limit[16];
+    if (n->cpu_quota < 0 || n->cpu_period <= 0) {
+      snprintf(cpu_limit, sizeof(cpu_limit), "max");
+    } else {
+      snprintf(cpu_limit, sizeof(cpu_limit), "%.0f%%",
+               n->cpu_quota * 100.0 / n->cpu_period);
+    }
+    if (n->mem_max < 0) {
+      snprintf(mem_limit, sizeof(mem_limit), "max");
+    } else {
+      snprintf(mem_limit, sizeof(mem_limit), "%.2f GB", n->mem_max / 1e9);
+    }
+    char mem_used[16];
+    if (n->mem_current < 0) {
+      snprintf(mem_used, sizeof(mem_used), "n/a"); // no memory controller
+    } else {
+      snprintf(mem_used, sizeof(mem_used), "%.2f GB", n->mem_current / 1e9);
+    }
+    double cpu = usecs > 0 ? (n->usage_usec - n->pre[0]) * 100.0 / usecs : 0;
+    fprintf(out,
+            "%-32.32s %7.2f%% / %-5s -- %9s / %-8s throttled %.1f ms "
+            "(%llu/%llu periods)\n",
+            label, cpu, cpu_limit, mem_used, mem_limit,
+            (n->throttled_usec - n->pre[1]) / 1e3,
+            n->nr_throttled - n->pre[3], n->nr_periods - n->pre[2]);
+  }
+}
@@ -0,0 +1,67 @@
+#ifndef CGROUP_STATS_H
+#define CGROUP_STATS_H
+
+#include <stdio.h>
+
+// the files read from every cgroup, in the order of cg_node.fds
+#define CG_MEMORY_CURRENT 0
+#define CG_MEMORY_MAX 1
+#define CG_MEMORY_STAT 2
+#define CG_CPU_STAT 3
+#define CG_CPU_MAX 4
+#define CG_FILES 5
+
+// the tree is listed again every this many samples, to find new cgroups
+#define CG_RESCAN 10
+
+/**
+ * @brief one cgroup as remembered between samples
+ *
+ * The directory and its files are opened once and kept open as far as the
+ * open file limit allows, so a sample only preads them.
+ */
+struct cg_node {
+  char path[256];     // relative to the cgroup2 mount, "." for its root
+  int depth;          // levels below the cgroup shown first
+  int dirfd;          // the cgroup directory, -1 if not kept open
+  int fds[CG_FILES];  // kept open files, -1 if missing, -2 if not open
+  int removed;        // 1 if the cgroup went away since the last listing
+  int sampled;        // number of samples taken of this cgroup
+  long long mem_current;        // bytes, -1 if unknown
+  long long mem_max;            // bytes, -1 if there is no limit
+  long long anon;               // anonymous memory in bytes
+  long long file;               // page cache in bytes
+  long long cpu_quota;          // microseconds per period, -1 if no limit
+  long long cpu_period;         // microseconds
+  unsigned long long usage_usec;     // cpu time used
+  unsigned long long throttled_usec; // time throttled
+  unsigned long long nr_periods;     // enforcement periods elapsed
+  unsigned long long nr_throttled;   // periods the cgroup was throttled in
+  unsigned long long pre[4];         // the four counters above, one sample ago
+};
+
+/**
+ * @brief a cgroup, or a whole subtree of them, sampled together
+ *
+ * nodes is kept in the order the tree is listed in, so after a listing every
+ * cgroup is normally found at the same index as before.
+ */
+struct cg_table {
+  int mount_fd;            // the cgroup2 mount
+  int tree;                // if 1, then all descendants are shown too
+  char base[256];          // the cgroup shown first, relative to the mount
+  struct cg_node *nodes;   // cgroups in the order of the listing
+  int count;               // number of cgroups
+  int cap;                 // number of cgroups allocated in nodes
+  int fd_budget;           // fds that may still be kept open
+  unsigned int generation; // number of samples taken
+  long long last_ns;       // CLOCK_MONOTONIC of the last sample
+  long long elapsed_ns;    // time between the last two samples
+  char buf[8192];          // where a file is read into
+};
+
+void InitCgroupTable(struct cg_table *t, const char *cgroup, int tree);
+void ReadCgroups(struct cg_table *t, long long now_ns);
+void PrintCgroups(FILE *out, const struct cg_table *t);
+
+#endif
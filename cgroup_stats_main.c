@@ -0,0 +1,82 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cgroup_stats.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for getting cgroup info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines like the other collectors. The cgroup v2 cgroup of the
+ * tool itself is shown, or the one given by --cgroup=PATH relative to the
+ * cgroup2 mount; with --tree, all its descendants too. With --root=DIR, the
+ * mount and cgroup are looked up in DIR/proc/self and read below DIR.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  struct ticker ticker;
+  const char *cgroup = NULL; // the cgroup of the tool itself
+  int tree = 0;
+  struct cg_table *table;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (ParseEpoch(argv[i], &start, &real)) {
+      continue;
+    } else if (ParseRoot(argv[i])) {
+      continue;
+    } else if (strncmp(argv[i], "--cgroup=", 9) == 0) {
+      cgroup = argv[i] + 9;
+    } else if (strcmp(argv[i], "--tree") == 0) {
+      tree = 1;
+    }
+  }
+
+  table = malloc(sizeof(struct cg_table));
+  if (table == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  InitCgroupTable(table, cgroup, tree);
+
+  // read the counters the first period is compared with
+  InitTicker(&ticker, period, start, real);
+  ReadCgroups(table, MonotonicNow());
+
+  for (int i = 0; i < sample_size; i++) {
+    WaitTick(&ticker);
+    ReadCgroups(table, MonotonicNow());
+    PrintCgroups(stdout, table);
+    fflush(stdout);
+  }
+  if (ticker.missed > 0) {
+    fprintf(stderr, "cgroup_stats: missed %lld deadlines\n", ticker.missed);
+  }
+}
@@ -0,0 +1,725 @@
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cluster.h"
+#include "sched.h"
+
+// how long connecting to an aggregator may take, in milliseconds
+#define CONNECT_TIMEOUT_MS 1000
+
+/**
+ * @brief split "HOST:PORT" into its parts, "[ADDR]:PORT" for IPv6
+ *
+ * @param endpoint the endpoint
+ * @param host where to store the host, empty for any address
+ * @param size size of host
+ * @return the port, NULL if the endpoint has none
+ */
+static const char *SplitEndpoint(const char *endpoint, char *host,
+                                 size_t size) {
+  const char *colon = strrchr(endpoint, ':');
+  if (colon == NULL || colon[1] == '\0') {
+    return NULL;
+  }
+  const char *start = endpoint;
+  size_t len = colon - endpoint;
+  if (len >= 2 && start[0] == '[' && start[len - 1] == ']') {
+    start++;
+    len -= 2;
+  }
+  if (len >= size) {
+    return NULL;
+  }
+  memcpy(host, start, len);
+  host[len] = '\0';
+  return colon + 1;
+}
+
+/**
+ * @brief fill in the address of a Unix socket
+ *
+ * @param path path of the socket
+ * @param addr where to store the address
+ * @return 0 on success, -1 if the path is too long
+ */
+static int UnixAddress(const char *path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+/**
+ * @brief look up the addresses of an aggregator
+ *
+ * This is done once when the agent starts, as getaddrinfo may block for as
+ * long as the name server takes. An endpoint that cannot be resolved is an
+ * error.
+ *
+ * @param a the agent, endpoint set
+ */
+static void ResolveAgent(struct agent *a) {
+  a->addr_count = 0;
+  a->addr_next = 0;
+  if (strncmp(a->endpoint, "unix:", 5) == 0) {
+    struct sockaddr_un *addr = (struct sockaddr_un *)&a->addrs[0];
+    if (UnixAddress(a->endpoint + 5, addr) < 0) {
+      fprintf(stderr, "%s: socket path too long\n", a->endpoint + 5);
+      exit(1);
+    }
+    a->addr_lens[0] = sizeof(*addr);
+    a->addr_count = 1;
+    return;
+  }
+
+  char host[256];
+  const char *port = SplitEndpoint(a->endpoint, host, sizeof(host));
+  if (port == NULL) {
+    fprintf(stderr, "%s: not HOST:PORT or unix:PATH\n", a->endpoint);
+    exit(1);
+  }
+  struct addrinfo hints;
+  struct addrinfo *list;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int err = getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &list);
+  if (err != 0) {
+    fprintf(stderr, "%s: %s\n", a->endpoint, gai_strerror(err));
+    exit(1);
+  }
+  for (struct addrinfo *ai = list; ai != NULL && a->addr_count < AGENT_ADDRS;
+       ai = ai->ai_next) {
+    memcpy(&a->addrs[a->addr_count], ai->ai_addr, ai->ai_addrlen);
+    a->addr_lens[a->addr_count] = ai->ai_addrlen;
+    a->addr_count++;
+  }
+  freeaddrinfo(list);
+}
+
+/**
+ * @brief create the socket an aggregator accepts agents on
+ *
+ * A Unix socket left behind by an aggregator that no longer runs is
+ * replaced.
+ *
+ * @param endpoint "HOST:PORT", ":PORT" for any address, or "unix:PATH"
+ * @return the non-blocking listening socket
+ */
+int ListenEndpoint(const char *endpoint) {
+  int fd = -1;
+  if (strncmp(endpoint, "unix:", 5) == 0) {
+    const char *path = endpoint + 5;
+    struct sockaddr_un addr;
+    if (UnixAddress(path, &addr) < 0) {
+      fprintf(stderr, "%s: socket path too long\n", path);
+      exit(1);
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      perror("socket");
+      exit(1);
+    }
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) &&
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+        errno == ECONNREFUSED) {
+      unlink(path);
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      perror(path);
+      exit(1);
+    }
+  } else {
+    char host[256];
+    const char *port = SplitEndpoint(endpoint, host, sizeof(host));
+    struct addrinfo hints;
+    struct addrinfo *list;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (port == NULL ||
+        getaddrinfo(host[0] != '\0' ? host : NULL, port, &hints, &list) != 0) {
+      fprintf(stderr, "%s: not HOST:PORT or unix:PATH\n", endpoint);
+      exit(1);
+    }
+    fd = socket(list->ai_family,
+                list->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                list->ai_protocol);
+    int one = 1;
+    if (fd < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(fd, list->ai_addr, list->ai_addrlen) < 0) {
+      perror(endpoint);
+      exit(1);
+    }
+    freeaddrinfo(list);
+  }
+  if (listen(fd, SOMAXCONN) < 0) {
+    perror("listen");
+    exit(1);
+  }
+  return fd;
+}
+
+/**
+ * @brief start connecting the agent to the next address of the aggregator
+ *
+ * The socket is non-blocking, so this only starts the connection; a connect
+ * that does not complete at once is finished by CheckConnect on a later
+ * flush.
+ *
+ * @param a the agent, disconnected
+ * @return 0 if the connect is under way or done, -1 with errno set otherwise
+ */
+static int StartConnect(struct agent *a) {
+  long long now = MonotonicNow();
+  a->retry_ns = now + AGENT_RETRY_NS;
+  a->connect_ns = now + CONNECT_TIMEOUT_MS * 1000000LL;
+  const struct sockaddr *addr =
+      (const struct sockaddr *)&a->addrs[a->addr_next];
+  int fd = socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, addr, a->addr_lens[a->addr_next]) < 0 &&
+      errno != EINPROGRESS) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  if (addr->sa_family != AF_UNIX) {
+    // a batch is complete when it is written, so send it right away
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  a->fd = fd;
+  a->connecting = 1;
+  return 0;
+}
+
+/**
+ * @brief give up a connect that failed, trying the next address right away
+ *
+ * Once every address was tried, the agent waits until retry_ns.
+ *
+ * @param a the agent
+ * @param err why the connect failed
+ */
+static void FailConnect(struct agent *a, int err) {
+  if (a->fd >= 0) {
+    close(a->fd);
+  }
+  a->fd = -1;
+  a->connecting = 0;
+  a->addr_next = (a->addr_next + 1) % a->addr_count;
+  if (a->addr_next != 0) {
+    if (StartConnect(a) < 0) {
+      FailConnect(a, errno);
+    }
+    return;
+  }
+  if (!a->warned) {
+    fprintf(stderr, "agent: %s: %s, retrying\n", a->endpoint, strerror(err));
+    a->warned = 1;
+  }
+}
+
+/**
+ * @brief see whether a connect under way completed, without waiting
+ *
+ * Once connected, the hello frame is sent ahead of everything buffered.
+ *
+ * @param a the agent, connecting
+ */
+static void CheckConnect(struct agent *a) {
+  struct pollfd p = {a->fd, POLLOUT, 0};
+  if (poll(&p, 1, 0) <= 0) {
+    if (MonotonicNow() >= a->connect_ns) {
+      FailConnect(a, ETIMEDOUT);
+    }
+    return;
+  }
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+  getsockopt(a->fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+  if (err != 0) {
+    FailConnect(a, err);
+    return;
+  }
+  struct frame_header hdr;
+  struct hello_frame hello;
+  memset(&hdr, 0, sizeof(hdr));
+  memset(&hello, 0, sizeof(hello));
+  hdr.len = sizeof(hello);
+  hdr.type = FRAME_HELLO;
+  hdr.timestamp = RealtimeNow();
+  hello.magic = HELLO_MAGIC;
+  strcpy(hello.node, a->node);
+  // the socket buffer of a new connection is empty, so the two parts fit
+  char buf[sizeof(hdr) + sizeof(hello)];
+  memcpy(buf, &hdr, sizeof(hdr));
+  memcpy(buf + sizeof(hdr), &hello, sizeof(hello));
+  if (send(a->fd, buf, sizeof(buf), MSG_NOSIGNAL | MSG_DONTWAIT) !=
+      (ssize_t)sizeof(buf)) {
+    FailConnect(a, errno);
+    return;
+  }
+  a->connecting = 0;
+  a->warned = 0;
+  a->addr_next = 0;
+  fprintf(stderr, "agent: sending to %s as %s\n", a->endpoint, a->node);
+}
+
+/**
+ * @brief close the connection, dropping what was not sent
+ *
+ * Frames are never split across connections, so a frame sent in part is
+ * dropped as well.
+ *
+ * @param a the agent
+ * @param why reason printed to stderr
+ */
+static void DisconnectAgent(struct agent *a, const char *why) {
+  fprintf(stderr, "agent: %s: %s\n", a->endpoint, why);
+  close(a->fd);
+  a->fd = -1;
+  a->dropped += a->queued;
+  a->queued = 0;
+  a->len = 0;
+  a->sent = 0;
+  a->connecting = 0;
+  a->retry_ns = MonotonicNow() + AGENT_RETRY_NS;
+}
+
+/**
+ * @brief prepare an agent and connect it to the aggregator
+ *
+ * The endpoint is resolved here, once, and the connect is only started, so
+ * a slow name server or an aggregator host dropping connects holds up the
+ * start but never the sampling. An aggregator that cannot be reached yet is
+ * not an error: the agent keeps connecting again while it samples.
+ *
+ * @param a agent to initialize
+ * @param endpoint "HOST:PORT" or "unix:PATH" of the aggregator
+ * @param node name of the node, truncated to 63 bytes
+ * @param batch samples to send with one write
+ */
+void StartAgent(struct agent *a, const char *endpoint, const char *node,
+                int batch) {
+  memset(a, 0, sizeof(*a));
+  a->endpoint = endpoint;
+  snprintf(a->node, sizeof(a->node), "%s", node);
+  a->fd = -1;
+  a->batch = batch;
+  a->size = 1 << 16;
+  a->buf = malloc(a->size);
+  if (a->buf == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  ResolveAgent(a);
+  if (StartConnect(a) < 0) {
+    FailConnect(a, errno);
+  }
+}
+
+/**
+ * @brief send as much of the buffered frames as the socket takes
+ *
+ * While disconnected, the agent connects again at most every
+ * AGENT_RETRY_NS; until then the buffered samples are dropped. A connect
+ * under way is only checked, never waited for, and the samples are kept
+ * until it completes or fails after CONNECT_TIMEOUT_MS.
+ *
+ * @param a the agent
+ */
+void FlushAgent(struct agent *a) {
+  if (a->fd < 0 && MonotonicNow() >= a->retry_ns && StartConnect(a) < 0) {
+    FailConnect(a, errno);
+  }
+  if (a->fd >= 0 && a->connecting) {
+    CheckConnect(a);
+  }
+  if (a->fd < 0) {
+    a->dropped += a->queued;
+    a->queued = 0;
+    a->len = 0;
+    return;
+  }
+  if (a->connecting) {
+    return; // kept until the connection is up
+  }
+  while (a->sent < a->len) {
+    ssize_t n = send(a->fd, a->buf + a->sent, a->len - a->sent,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN) {
+        DisconnectAgent(a, strerror(errno));
+      }
+      return; // the rest goes out with the next batch
+    }
+    a->sent += n;
+  }
+  a->len = 0;
+  a->sent = 0;
+  a->queued = 0;
+}
+
+/**
+ * @brief append a frame to the buffer of the agent
+ *
+ * @param a the agent
+ * @param hdr header of the frame, len set
+ * @param p payload of the frame
+ */
+static void AppendFrame(struct agent *a, const struct frame_header *hdr,
+                       const struct frame_parts *p) {
+  size_t need = sizeof(*hdr) + hdr->len;
+  if (a->sent > 0) {
+    memmove(a->buf, a->buf + a->sent, a->len - a->sent);
+    a->len -= a->sent;
+    a->sent = 0;
+  }
+  if (a->len + need > AGENT_MAX_BUFFER && a->fd >= 0) {
+    DisconnectAgent(a, "aggregator is not reading");
+  }
+  while (a->len + need > a->size) {
+    a->size *= 2;
+    a->buf = realloc(a->buf, a->size);
+    if (a->buf == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  char *out = a->buf + a->len;
+  memcpy(out, hdr, sizeof(*hdr));
+  memcpy(out + sizeof(*hdr), &p->head, p->head_len);
+  if (p->body_len > 0) {
+    memcpy(out + sizeof(*hdr) + p->head_len, p->body, p->body_len);
+  }
+  a->len += need;
+}
+
+/**
+ * @brief queue the latest sample of a collector, sending once a batch is
+ * complete
+ *
+ * The frames are those the child programs send, except that the cpu frame
+ * leaves out the utilization of each core, which the aggregator does not
+ * show.
+ *
+ * @param a the agent
+ * @param s latest samples
+ * @param source which collector the sample came from
+ * @param seq iteration of the sample
+ */
+void QueueSample(struct agent *a, const struct samples *s, int source,
+                 int seq) {
+  struct frame_header hdr;
+  struct frame_parts p;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.seq = seq;
+  hdr.missed = s->missed[source];
+  hdr.timestamp = s->timestamp[source];
+  hdr.interval = s->interval[source];
+  if (source == SOURCE_MEM) {
+    PackMemFrame(&hdr, &s->mem, &p);
+  } else if (source == SOURCE_USER) {
+    PackUserFrame(&hdr, &s->users, &p);
+  } else {
+    struct cpu_usage total = s->cpu;
+    total.core_count = 0;
+    PackCpuFrame(&hdr, &total, &p);
+  }
+  AppendFrame(a, &hdr, &p);
+  a->queued++;
+  if (a->queued >= a->batch) {
+    FlushAgent(a);
+  }
+}
+
+/**
+ * @brief send what is left, waiting a moment for the aggregator, and close
+ *
+ * @param a the agent
+ */
+void StopAgent(struct agent *a) {
+  FlushAgent(a);
+  while (a->fd >= 0 && a->len > 0) {
+    struct pollfd p = {a->fd, POLLOUT, 0};
+    if (poll(&p, 1, CONNECT_TIMEOUT_MS) <= 0) {
+      a->dropped += a->queued;
+      break;
+    }
+    FlushAgent(a);
+  }
+  if (a->fd >= 0) {
+    close(a->fd);
+  }
+  if (a->dropped > 0) {
+    fprintf(stderr, "agent: dropped %lld samples\n", a->dropped);
+  }
+  free(a->buf);
+}
+
+/**
+ * @brief initialize an empty cluster
+ *
+ * @param c cluster to initialize
+ */
+void InitCluster(struct cluster *c) {
+  memset(c, 0, sizeof(*c));
+  c->cap = 64;
+  c->nodes = calloc(c->cap, sizeof(struct cluster_node *));
+  c->scratch = calloc(c->cap, sizeof(double));
+  if (c->nodes == NULL || c->scratch == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  InitCpuUsage(&c->cpu, 1); // the agents send no cores
+}
+
+/**
+ * @brief find the node an agent says hello as, adding it if it is new
+ *
+ * The nodes are kept sorted, so a node is found by binary search and the
+ * table is printed in order of name.
+ *
+ * @param c the cluster
+ * @param name name of the node
+ * @return the node, with the connection counted
+ */
+struct cluster_node *JoinCluster(struct cluster *c, const char *name) {
+  int lo = 0;
+  int hi = c->count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(c->nodes[mid]->name, name);
+    if (cmp == 0) {
+      c->nodes[mid]->connections++;
+      return c->nodes[mid];
+    }
+    if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (c->count == c->cap) {
+    c->cap *= 2;
+    c->nodes = realloc(c->nodes, c->cap * sizeof(struct cluster_node *));
+    c->scratch = realloc(c->scratch, c->cap * sizeof(double));
+    if (c->nodes == NULL || c->scratch == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  struct cluster_node *n = calloc(1, sizeof(struct cluster_node));
+  if (n == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  snprintf(n->name, sizeof(n->name), "%s", name);
+  n->connections = 1;
+  memmove(&c->nodes[lo + 1], &c->nodes[lo],
+          (c->count - lo) * sizeof(struct cluster_node *));
+  c->nodes[lo] = n;
+  c->count++;
+  return n;
+}
+
+/**
+ * @brief store a sample received from a node as its latest
+ *
+ * @param c the cluster
+ * @param n the node the frame came from
+ * @param hdr header of the frame
+ * @param payload payload of the frame
+ * @param now_ns CLOCK_MONOTONIC when it arrived
+ * @return 0 on success, -1 if the frame is malformed
+ */
+int MergeFrame(struct cluster *c, struct cluster_node *n,
+               const struct frame_header *hdr, const char *payload,
+               long long now_ns) {
+  int source;
+  if (hdr->type == FRAME_MEM) {
+    source = SOURCE_MEM;
+    if (DecodeMemFrame(payload, hdr->len, &n->mem) < 0) {
+      return -1;
+    }
+  } else if (hdr->type == FRAME_CPU) {
+    source = SOURCE_CPU;
+    if (DecodeCpuFrame(payload, hdr->len, &c->cpu) < 0) {
+      return -1;
+    }
+    n->cpu = c->cpu.usage;
+    n->iowait = c->cpu.iowait;
+  } else if (hdr->type == FRAME_USER) {
+    source = SOURCE_USER;
+    if (DecodeUserFrame(payload, hdr->len, &c->users) < 0) {
+      return -1;
+    }
+    n->users = c->users.count;
+  } else {
+    return -1;
+  }
+  n->have[source] = 1;
+  n->missed -= n->missed_by[source];
+  n->missed_by[source] = hdr->missed;
+  n->missed += hdr->missed;
+  n->timestamp = hdr->timestamp;
+  n->interval = hdr->interval;
+  n->last_ns = now_ns;
+  n->samples++;
+  return 0;
+}
+
+/**
+ * @brief compare two doubles for qsort
+ *
+ * @param a the first double
+ * @param b the second double
+ * @return negative, zero or positive as a is below, equal to or above b
+ */
+static int CompareDouble(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief print the spread of a value over the nodes
+ *
+ * @param out where to print
+ * @param label name of the value
+ * @param values the value of every node that is up, reordered
+ * @param n number of values
+ * @param unit printed after every value
+ */
+static void PrintSpread(FILE *out, const char *label, double *values, int n,
+                        const char *unit) {
+  if (n == 0) {
+    fprintf(out, "%-8s n/a\n", label);
+    return;
+  }
+  qsort(values, n, sizeof(double), CompareDouble);
+  int ranks[3] = {50, 90, 99};
+  double p[3];
+  for (int k = 0; k < 3; k++) {
+    int rank = (int)((ranks[k] * (long long)n + 99) / 100); // nearest rank
+    p[k] = values[rank - 1];
+  }
+  fprintf(out,
+          "%-8s min %.2f%s  p50 %.2f%s  p90 %.2f%s  p99 %.2f%s  max %.2f%s\n",
+          label, values[0], unit, p[0], unit, p[1], unit, p[2], unit,
+          values[n - 1], unit);
+}
+
+/**
+ * @brief check whether a node sent something recently enough to be up
+ *
+ * An adaptive agent samples an idle node less often, so the period is the
+ * longer of the display period and the interval of its latest sample.
+ *
+ * @param n the node
+ * @param now_ns CLOCK_MONOTONIC of the display
+ * @param period_ns time between two displays
+ * @return 1 if the node is fresh, 0 if it is late
+ */
+static int IsFresh(const struct cluster_node *n, long long now_ns,
+                   long long period_ns) {
+  long long period = n->interval > period_ns ? n->interval : period_ns;
+  return now_ns - n->last_ns <= NODE_STALE_PERIODS * period;
+}
+
+/**
+ * @brief Displaying the latest values of every node and their spread
+ *
+ *    A node is up while an agent is connected as it and sent something in
+ *    the last NODE_STALE_PERIODS periods, or sampling intervals of an
+ *    adaptive agent; only nodes that are up count towards the fleet figures.
+ *
+ * @param out where to print
+ * @param c the cluster
+ * @param now_ns CLOCK_MONOTONIC of the display
+ * @param period_ns time between two displays
+ */
+void PrintCluster(FILE *out, struct cluster *c, long long now_ns,
+                  long long period_ns) {
+  int up = 0;
+  int cpu_count = 0;
+  int mem_count = 0;
+  int users = 0;
+  double used = 0;
+  double total = 0;
+  double *cpu = c->scratch;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Cluster ### (node, state, cpu, memory used / total, "
+               "users, missed, age)\n");
+  for (int i = 0; i < c->count; i++) {
+    struct cluster_node *n = c->nodes[i];
+    const char *state = "down";
+    if (n->connections > 0) {
+      state = IsFresh(n, now_ns, period_ns) ? "up" : "late";
+    }
+    fprintf(out, "%-24s %-4s", n->name, state);
+    if (n->have[SOURCE_CPU]) {
+      fprintf(out, " %6.2f%%", n->cpu);
+    } else {
+      fprintf(out, " %7s", "n/a");
+    }
+    if (n->have[SOURCE_MEM]) {
+      fprintf(out, "  %6.2f GB / %6.2f GB", n->mem.phys_used / 1e9,
+              n->mem.total_phys / 1e9);
+    } else {
+      fprintf(out, "  %20s", "n/a");
+    }
+    fprintf(out, "  %3d users  %lld missed  %.1fs ago\n", n->users, n->missed,
+            (now_ns - n->last_ns) * 1e-9);
+    if (strcmp(state, "up") != 0) {
+      continue;
+    }
+    up++;
+    users += n->users;
+    if (n->have[SOURCE_CPU]) {
+      cpu[cpu_count++] = n->cpu;
+    }
+    if (n->have[SOURCE_MEM]) {
+      used += n->mem.phys_used;
+      total += n->mem.total_phys;
+    }
+  }
+  fprintf(out, "Fleet: %d of %d nodes up, %.2f GB / %.2f GB used, %d users\n",
+          up, c->count, used / 1e9, total / 1e9, users);
+  PrintSpread(out, "CPU", cpu, cpu_count, "%");
+  // the values of cpu are printed, so memory can reuse the scratch
+  for (int i = 0; i < c->count; i++) {
+    struct cluster_node *n = c->nodes[i];
+    if (n->connections > 0 && n->have[SOURCE_MEM] && n->mem.total_phys > 0 &&
+        IsFresh(n, now_ns, period_ns)) {
+      c->scratch[mem_count++] = n->mem.phys_used * 100.0 / n->mem.total_phys;
+    }
+  }
+  PrintSpread(out, "Memory", c->scratch, mem_count, "%");
+}
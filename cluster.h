@@ -0,0 +1,99 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "frame.h"
+#include "render.h"
+
+// bytes an agent buffers for a slow aggregator before giving up on it
+#define AGENT_MAX_BUFFER (1 << 20)
+// how long an agent waits before connecting again
+#define AGENT_RETRY_NS 1000000000LL
+// addresses of the aggregator an agent tries in turn
+#define AGENT_ADDRS 4
+// a node that sent nothing for this many display periods is shown as down
+#define NODE_STALE_PERIODS 3
+
+/**
+ * @brief the sending side, in sys_monitoring_tool --agent
+ *
+ * Samples are packed as frames into one buffer and sent with a single write
+ * once batch of them are queued. The socket never blocks the tool: what the
+ * aggregator does not take yet stays buffered, and while it cannot be reached
+ * the samples are dropped and counted.
+ */
+struct agent {
+  const char *endpoint; // "HOST:PORT" or "unix:PATH"
+  char node[64];        // name sent in the hello frame
+  int fd;               // -1 while disconnected
+  int connecting;       // 1 while the connect on fd is under way
+  int warned;           // 1 once a failed connect was reported
+  struct sockaddr_storage addrs[AGENT_ADDRS]; // resolved once at the start
+  socklen_t addr_lens[AGENT_ADDRS];
+  int addr_count;       // entries of addrs
+  int addr_next;        // the address connected or tried next
+  int batch;            // samples per write
+  int queued;           // samples in buf not handed to the socket yet
+  char *buf;            // frames not sent yet
+  size_t len;           // bytes in buf
+  size_t sent;          // bytes of buf already sent
+  size_t size;          // size of buf
+  long long retry_ns;   // CLOCK_MONOTONIC of the next connect attempt
+  long long connect_ns; // CLOCK_MONOTONIC the connect under way times out
+  long long dropped;    // samples lost while disconnected
+};
+
+/**
+ * @brief the latest values an aggregator received from one node
+ */
+struct cluster_node {
+  char name[64];
+  int connections;           // agents currently sending as this node
+  long long last_ns;         // CLOCK_MONOTONIC of the last frame
+  long long samples;         // frames received in total
+  int have[SOURCE_NUM];      // 1 once a sample of the collector arrived
+  long long timestamp;       // CLOCK_REALTIME of the latest sample
+  long long interval;        // nanoseconds the latest sample covers
+  long long missed;          // deadlines missed, over all collectors
+  long long missed_by[SOURCE_NUM];
+  struct mem_usage mem;
+  double cpu;                // utilization in percent
+  double iowait;
+  int users;                 // number of sessions
+};
+
+/**
+ * @brief every node an aggregator heard from, sorted by name
+ *
+ * Nodes are allocated one by one, so a connection can keep a pointer to its
+ * node while others are inserted. A node that disconnects is kept and shown
+ * as down.
+ */
+struct cluster {
+  struct cluster_node **nodes;
+  int count;
+  int cap;
+  struct cpu_usage cpu;   // scratch to decode cpu frames into
+  struct user_list users; // scratch to decode user frames into
+  double *scratch;        // cap values, for computing percentiles
+};
+
+int ListenEndpoint(const char *endpoint);
+void StartAgent(struct agent *a, const char *endpoint, const char *node,
+                int batch);
+void QueueSample(struct agent *a, const struct samples *s, int source,
+                 int seq);
+void FlushAgent(struct agent *a);
+void StopAgent(struct agent *a);
+void InitCluster(struct cluster *c);
+struct cluster_node *JoinCluster(struct cluster *c, const char *name);
+int MergeFrame(struct cluster *c, struct cluster_node *n,
+               const struct frame_header *hdr, const char *payload,
+               long long now_ns);
+void PrintCluster(FILE *out, struct cluster *c, long long now_ns,
+                  long long period_ns);
+
+#endif
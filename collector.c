@@ -0,0 +1,320 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "collector.h"
+#include "profile.h"
+
+/**
+ * @brief wait until the slot of the given collector is empty
+ *
+ * Must be called with the lock held.
+ *
+ * @param c the collector
+ * @param source which slot to wait for
+ */
+static void WaitEmpty(struct collector *c, int source) {
+  while (c->full[source]) {
+    pthread_cond_wait(&c->cond, &c->lock);
+  }
+}
+
+/**
+ * @brief mark the slot of the given collector as full and wake the renderer
+ *
+ * Must be called with the lock held.
+ *
+ * @param c the collector
+ * @param source which slot was filled
+ * @param t ticker of the collector thread
+ * @param tick tick the sample was taken on
+ */
+static void Publish(struct collector *c, int source, const struct ticker *t,
+                    long long tick) {
+  c->slots.timestamp[source] = TickTime(t, tick);
+  c->slots.missed[source] = t->missed;
+  c->slots.interval[source] = t->interval;
+  c->full[source] = 1;
+  pthread_cond_broadcast(&c->cond);
+  pthread_mutex_unlock(&c->lock);
+}
+
+/**
+ * @brief hand the bytes a collector just parsed over to the recorder, if
+ * there is one
+ *
+ * @param c the collector
+ * @param file e.g. CAPTURE_STAT
+ * @param last returns the bytes of the last read, e.g. LastCpuStat
+ * @param t ticker of the collector thread
+ * @param tick tick the bytes were read on
+ */
+static void Capture(struct collector *c, int file,
+                    const char *(*last)(size_t *len), const struct ticker *t,
+                    long long tick) {
+  if (c->recorder != NULL) {
+    size_t len;
+    const char *buf = last(&len);
+    CaptureFile(c->recorder, file, buf, len, TickTime(t, tick), t->missed);
+  }
+}
+
+/**
+ * @brief thread sampling memory information
+ *
+ * @param arg the collector
+ * @return NULL
+ */
+static void *MemoryThread(void *arg) {
+  struct collector *c = arg;
+  struct mem_usage usage;
+  struct ticker ticker;
+  long pre = 0;
+  StartProfile(PROFILE_MEM);
+  InitTicker(&ticker, c->period, c->start, c->real);
+  SetAdaptive(&ticker, c->max_period);
+  for (int i = 0; i < c->sample_size; i++) {
+    long long tick = WaitTick(&ticker);
+    MeasureMemory(&usage);
+    Capture(c, CAPTURE_MEMINFO, LastMeminfo, &ticker, tick);
+    if (i > 0 && usage.total_phys > 0) {
+      AdaptTicker(&ticker, (usage.phys_used - pre) * 100.0 / usage.total_phys);
+    }
+    pre = usage.phys_used;
+    pthread_mutex_lock(&c->lock);
+    WaitEmpty(c, SOURCE_MEM);
+    long long stage = StageStart();
+    c->slots.mem = usage;
+    Publish(c, SOURCE_MEM, &ticker, tick);
+    StageEnd(PROFILE_MEM, STAGE_SERIALIZE, stage);
+  }
+  StopProfile(PROFILE_MEM);
+  return NULL;
+}
+
+/**
+ * @brief thread sampling user information
+ *
+ * The list is swapped with the slot, so both keep their allocations.
+ *
+ * @param arg the collector
+ * @return NULL
+ */
+static void *UserThread(void *arg) {
+  struct collector *c = arg;
+  struct user_list list = {0, 0, NULL};
+  struct ticker ticker;
+  int pre = 0;
+  StartProfile(PROFILE_USER);
+  InitTicker(&ticker, c->period, c->start, c->real);
+  SetAdaptive(&ticker, c->max_period);
+  for (int i = 0; i < c->sample_size; i++) {
+    long long tick = WaitTick(&ticker);
+    if (ReadUsers(&list) < 0) {
+      perror("getutent"); // show an empty list rather than stop the tool
+      list.count = 0;
+    }
+    Capture(c, CAPTURE_UTMP, LastUtmp, &ticker, tick);
+    // a login or logout counts as a fast change
+    AdaptTicker(&ticker, i > 0 && list.count != pre ? ADAPT_FAST : 0);
+    pre = list.count;
+    pthread_mutex_lock(&c->lock);
+    WaitEmpty(c, SOURCE_USER);
+    long long stage = StageStart();
+    struct user_list tmp = c->slots.users;
+    c->slots.users = list;
+    list = tmp;
+    Publish(c, SOURCE_USER, &ticker, tick);
+    StageEnd(PROFILE_USER, STAGE_SERIALIZE, stage);
+  }
+  StopProfile(PROFILE_USER);
+  free(list.sessions);
+  return NULL;
+}
+
+/**
+ * @brief thread sampling cpu information
+ *
+ * @param arg the collector
+ * @return NULL
+ */
+static void *CpuThread(void *arg) {
+  struct collector *c = arg;
+  struct cpu_sample pre;
+  struct cpu_sample aft;
+  struct cpu_usage usage;
+  InitCpuSample(&pre, c->slots.cpu.core_num);
+  InitCpuSample(&aft, c->slots.cpu.core_num);
+  InitCpuUsage(&usage, c->slots.cpu.core_num);
+  struct ticker ticker;
+  double last = 0;
+  StartProfile(PROFILE_CPU);
+  InitTicker(&ticker, c->period, c->start, c->real);
+  SetAdaptive(&ticker, c->max_period);
+  ReadCpuSample(&pre); // counters the first period is compared with
+  Capture(c, CAPTURE_STAT, LastCpuStat, &ticker, 0);
+  for (int i = 0; i < c->sample_size; i++) {
+    long long tick = WaitTick(&ticker);
+    MeasureCpu(&pre, &aft, &usage);
+    Capture(c, CAPTURE_STAT, LastCpuStat, &ticker, tick);
+    if (i > 0) {
+      AdaptTicker(&ticker, CpuChange(&usage, last));
+    }
+    last = usage.usage;
+    pthread_mutex_lock(&c->lock);
+    WaitEmpty(c, SOURCE_CPU);
+    long long stage = StageStart();
+    double *cores = c->slots.cpu.cores;
+    memcpy(cores, usage.cores, usage.core_count * sizeof(double));
+    c->slots.cpu = usage;
+    c->slots.cpu.cores = cores;
+    Publish(c, SOURCE_CPU, &ticker, tick);
+    StageEnd(PROFILE_CPU, STAGE_SERIALIZE, stage);
+  }
+  StopProfile(PROFILE_CPU);
+  free(pre.cores);
+  free(pre.online);
+  free(aft.cores);
+  free(aft.online);
+  free(usage.cores);
+  return NULL;
+}
+
+/**
+ * @brief start the collector threads
+ *
+ * SIGINT and SIGTSTP are blocked in the collector threads, so the handlers of
+ * sys_monitoring_tool always run on the main thread.
+ *
+ * @param c collector to start
+ * @param sources for each source, 1 if its thread should be started
+ * @param sample_size number of samples each thread takes
+ * @param period microseconds between samples, the shortest if adaptive
+ * @param max_period longest microseconds between samples, period unless
+ * adaptive
+ * @param start CLOCK_MONOTONIC of tick 0, shared by all threads
+ * @param real CLOCK_REALTIME of tick 0
+ * @param recorder gets the bytes every thread parsed, NULL for none
+ */
+void StartCollector(struct collector *c, const int *sources, int sample_size,
+                    long long period, long long max_period, long long start,
+                    long long real, struct recorder *recorder) {
+  void *(*thread_funcs[SOURCE_NUM])(void *) = {MemoryThread, UserThread,
+                                               CpuThread};
+  memset(c, 0, sizeof(*c));
+  pthread_mutex_init(&c->lock, NULL);
+  pthread_cond_init(&c->cond, NULL);
+  c->sample_size = sample_size;
+  c->period = period;
+  c->max_period = max_period;
+  c->start = start;
+  c->real = real;
+  c->recorder = recorder;
+  InitSamples(&c->slots, 0, 0);
+
+  sigset_t block, old;
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTSTP);
+  pthread_sigmask(SIG_BLOCK, &block, &old);
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (sources[i] == 0) {
+      continue;
+    }
+    int err = pthread_create(&c->threads[i], NULL, thread_funcs[i], c);
+    if (err != 0) {
+      fprintf(stderr, "pthread_create: %s\n", strerror(err));
+      exit(1);
+    }
+    c->running[i] = 1;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief take the next sample of whichever collector publishes first
+ *
+ * The sample is moved out of its slot into out, so the collector thread can
+ * continue while the sample is displayed.
+ *
+ * @param c the collector
+ * @param out where to store the sample
+ * @param timeout_ms how long to wait at most, in milliseconds
+ * @return the collector the sample came from, -1 on timeout
+ */
+int WaitCollected(struct collector *c, struct samples *out, int timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&c->lock);
+  int source = -1;
+  while (source < 0) {
+    for (int i = 0; i < SOURCE_NUM && source < 0; i++) {
+      if (c->full[i]) {
+        source = i;
+      }
+    }
+    if (source < 0 &&
+        pthread_cond_timedwait(&c->cond, &c->lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  long long stage = StageStart();
+  if (source == SOURCE_MEM) {
+    out->mem = c->slots.mem;
+  } else if (source == SOURCE_USER) {
+    // swap, so both lists keep their allocations
+    struct user_list tmp = out->users;
+    out->users = c->slots.users;
+    c->slots.users = tmp;
+  } else if (source == SOURCE_CPU) {
+    double *cores = out->cpu.cores;
+    int core_num = out->cpu.core_num;
+    out->cpu = c->slots.cpu;
+    out->cpu.cores = cores;
+    out->cpu.core_num = core_num;
+    if (out->cpu.core_count > core_num) {
+      out->cpu.core_count = core_num;
+    }
+    memcpy(cores, c->slots.cpu.cores, out->cpu.core_count * sizeof(double));
+  }
+  if (source >= 0) {
+    out->timestamp[source] = c->slots.timestamp[source];
+    out->missed[source] = c->slots.missed[source];
+    out->interval[source] = c->slots.interval[source];
+    c->full[source] = 0;
+    pthread_cond_broadcast(&c->cond);
+    StageEnd(source, STAGE_RECEIVE, stage); // parts are numbered as sources
+  }
+  pthread_mutex_unlock(&c->lock);
+  return source;
+}
+
+/**
+ * @brief wait for all collector threads to finish and release the collector
+ *
+ * Every sample of the started threads must have been shown before, otherwise
+ * the threads are still waiting for their slot to be emptied.
+ *
+ * @param c the collector
+ */
+void StopCollector(struct collector *c) {
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (c->running[i] == 1) {
+      pthread_join(c->threads[i], NULL);
+    }
+  }
+  free(c->slots.cpu.cores);
+  free(c->slots.users.sessions);
+  pthread_cond_destroy(&c->cond);
+  pthread_mutex_destroy(&c->lock);
+}
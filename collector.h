@@ -0,0 +1,39 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <pthread.h>
+
+#include "capture.h"
+#include "render.h"
+#include "sched.h"
+
+/**
+ * @brief in-process collector, running the memory, user and cpu collectors
+ * as threads of sys_monitoring_tool
+ *
+ * Each collector thread publishes its latest sample into a one-sample slot
+ * and waits until the renderer has taken it, the same way a child program
+ * blocks on a full pipe.
+ */
+struct collector {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int sample_size;
+  long long period; // microseconds between samples, the shortest if adaptive
+  long long max_period; // longest microseconds between samples
+  long long start;  // CLOCK_MONOTONIC of tick 0, shared by all threads
+  long long real;   // CLOCK_REALTIME of tick 0
+  int running[SOURCE_NUM]; // which collector threads were started
+  int full[SOURCE_NUM];    // a sample is waiting to be shown
+  pthread_t threads[SOURCE_NUM];
+  struct samples slots; // one slot for each collector
+  struct recorder *recorder; // gets the bytes parsed, NULL unless recording
+};
+
+void StartCollector(struct collector *c, const int *sources, int sample_size,
+                    long long period, long long max_period, long long start,
+                    long long real, struct recorder *recorder);
+int WaitCollected(struct collector *c, struct samples *out, int timeout_ms);
+void StopCollector(struct collector *c);
+
+#endif
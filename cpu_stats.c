@@ -1,125 +1,527 @@
-
-
-#include <signal.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "cpu_stats.h"
+#include "procfs.h"
+#include "profile.h"
+
+static int stat_fd = -1;      // /proc/stat, kept open between samples
+static char *stat_buf = NULL; // buffer the cpu lines are read into
+static size_t stat_size = 0;  // size of stat_buf
+static size_t stat_len = 0;   // bytes of stat_buf the last read filled
+static int root_cores = 0;    // cores of the captured /proc/stat, once counted
+
 /**
- * @brief Displaying the number of cores of current system.
+ * @brief Get the number of online cores of current system.
  *
- * @return void
+ * With --root, the cores are counted in the captured /proc/stat instead, so
+ * a fixture of a bigger machine is sampled with all of its cores. A fixture
+ * does not change, so they are counted on the first call only.
+ *
+ * @return the number of cores
  */
-void ShowCore() {
-  printf("----------------------------\n");
+int GetCoreNum() {
+  if (HasProcRoot() && root_cores > 0) {
+    return root_cores;
+  }
+  if (HasProcRoot()) {
+    char path[8192];
+    char line[256];
+    int count = 0;
+    FILE *f = fopen(ProcPath("/proc/stat", path, sizeof(path)), "r");
+    if (f == NULL) {
+      perror("fopen");
+      exit(1);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+      if (strncmp(line, "cpu", 3) == 0 && line[3] >= '0' && line[3] <= '9') {
+        count++;
+      }
+    }
+    fclose(f);
+    root_cores = count > 0 ? count : 1;
+    return root_cores;
+  }
   int core_num = sysconf(_SC_NPROCESSORS_ONLN);
   if (core_num == -1) {
     perror("sysconf");
     exit(1);
   }
-  printf("Number of cores: %d\n", core_num);
+  return core_num;
 }
 
 /**
- * @brief Displaying the utilization percentage of CPU by reading file
- * /proc/stat
+ * @brief Get the number of possible cpu ids, one past the highest one.
  *
- * @param period indicate how frequently to sample in seconds
+ * The counters of a core are stored at its id, so the storage must cover
+ * cores that are offline now and may come online later. The ids are read
+ * from /sys/devices/system/cpu/possible, e.g. "0-7" or "0,2-5"; with --root
+ * and no such file captured, the cpuN lines of the captured /proc/stat are
+ * used instead.
  *
- * @return the utilization percentage of CPU
+ * @return the number of cpu ids
  */
-double ShowCpu(int period) {
-  unsigned long long pre[4];
-  unsigned long long aft[4];
-  unsigned long long diff[4];
-  char cpu[10];
-  FILE *fp;
-  fp = fopen("/proc/stat", "r"); // open cpu information file
-  fscanf(fp, "%s %llu %llu %llu %llu", cpu, &pre[0], &pre[1], &pre[2],
-         &pre[3]); // read initial cpu values
-  sleep(period);   // wait for period of time
-  rewind(fp);      // refresh the file
-  fscanf(fp, "%s %llu %llu %llu %llu", cpu, &aft[0], &aft[1], &aft[2],
-         &aft[3]); // read current cpu values
-  fclose(fp);
-  for (int i = 0; i < 4; i++) {
-    diff[i] = aft[i] - pre[i]; // caculate differences
+int GetCoreSlots() {
+  char buf[256];
+  int fd = OpenProc("/sys/devices/system/cpu/possible", O_RDONLY);
+  if (fd >= 0) {
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    int highest = -1;
+    int n = -1;
+    for (ssize_t i = 0; i < len; i++) {
+      if (buf[i] >= '0' && buf[i] <= '9') {
+        n = (n < 0 ? 0 : n * 10) + (buf[i] - '0');
+      } else {
+        highest = n > highest ? n : highest;
+        n = -1;
+      }
+    }
+    highest = n > highest ? n : highest;
+    if (highest >= 0) {
+      return highest + 1;
+    }
+  }
+  if (HasProcRoot() && root_cores > 0) {
+    return root_cores;
+  }
+  if (HasProcRoot()) {
+    char path[8192];
+    char line[256];
+    int slots = 1;
+    FILE *f = fopen(ProcPath("/proc/stat", path, sizeof(path)), "r");
+    if (f == NULL) {
+      perror("fopen");
+      exit(1);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+      int id;
+      if (sscanf(line, "cpu%d", &id) == 1 && id >= slots) {
+        slots = id + 1;
+      }
+    }
+    fclose(f);
+    return slots;
   }
-  unsigned long long percent = diff[0] + diff[1] + diff[2];
-  unsigned long long total = percent + diff[3];
-  printf("CPU usage: %.2f%%\n",
-         (double)percent / (double)total * 100); // caculate cpu usage
-  return (double)percent / (double)total * 100;
+  long slots = sysconf(_SC_NPROCESSORS_CONF);
+  if (slots == -1) {
+    perror("sysconf");
+    exit(1);
+  }
+  return slots;
 }
 
 /**
- * @brief Displaying cpu usage in graphic form
- *
- *    The number of symbol "|" is equals to number of percentage
- *
- * @param cpu used cpu percentage
+ * @brief Displaying the number of cores of current system.
  *
+ * @param out where to print
  * @return void
  */
-void CpuGraph(double cpu) {
-  printf("\t");
-  for (int i = 0; i < (int)cpu; i++) {
-    printf("|");
+void ShowCore(FILE *out) {
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "Number of cores: %d\n", GetCoreNum());
+}
+
+/**
+ * @brief allocate the counters of a sample for the given number of cores
+ *
+ * @param sample sample to initialize
+ * @param core_num number of cpu ids the sample can hold, see GetCoreSlots
+ */
+void InitCpuSample(struct cpu_sample *sample, int core_num) {
+  sample->core_num = core_num;
+  sample->core_count = 0;
+  memset(sample->total, 0, sizeof(sample->total));
+  sample->want_counters = 0;
+  memset(&sample->counters, 0, sizeof(sample->counters));
+  sample->cores = calloc(core_num, CPU_FIELDS * sizeof(unsigned long long));
+  sample->online = calloc(core_num, 1);
+  if (sample->cores == NULL || sample->online == NULL) {
+    perror("calloc");
+    exit(1);
   }
-  printf("%.2f\n", cpu * 0.01);
 }
 
 /**
- * @brief main function for getting cpu info
+ * @brief parse the ten counters following a cpu label
  *
- * Sample once every 1 sec and sample total of 10 times in default
- * Able to take command line argument to print each itertion in graphic,
- * sequential or refreshing form.
+ * Missing trailing counters (older kernels) are left as zero.
  *
- * @param argc
- * @param argv
- * @return int
+ * @param p first character after the label
+ * @param end end of the buffer
+ * @param fields where to store the counters
+ * @return pointer to the start of the next line
  */
+static const char *ParseCpuFields(const char *p, const char *end,
+                                  unsigned long long *fields) {
+  for (int i = 0; i < CPU_FIELDS; i++) {
+    fields[i] = 0;
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+      fields[i] = fields[i] * 10 + (*p - '0');
+      p++;
+    }
+  }
+  while (p < end && *p != '\n') {
+    p++;
+  }
+  return p < end ? p + 1 : end;
+}
 
-int main(int argc, char *argv[]) {
-  const char *special_string =
-      "##SPECIAL_STRING##"; // indicate one iteration has done
-  setbuf(stdout, NULL);     // disable buff
-  int sample_size = 10;
-  int period = 1;
-  int graphic_state = 0;
-  double cpu = 0;
+/**
+ * @brief a line after the cpu lines and where its value is stored
+ */
+struct counter_key {
+  const char *name; // the key, with the space after it
+  size_t len;
+  size_t offset;
+};
 
-  // set the ctrl-c signal and ctrl-z to be ignored
-  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
-      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
-    perror("signal");
-    exit(1);
+#define COUNTER_KEY(name, field)                                               \
+  { name " ", sizeof(name), offsetof(struct stat_counters, field) }
+
+// wanted lines, of the intr and softirq lines only the total is kept
+static const struct counter_key counter_keys[] = {
+    COUNTER_KEY("intr", intr),
+    COUNTER_KEY("ctxt", ctxt),
+    COUNTER_KEY("processes", processes),
+    COUNTER_KEY("procs_running", procs_running),
+    COUNTER_KEY("procs_blocked", procs_blocked),
+    COUNTER_KEY("softirq", softirq),
+};
+
+#define COUNTER_KEY_NUM (sizeof(counter_keys) / sizeof(counter_keys[0]))
+
+/**
+ * @brief parse the lines of /proc/stat after the cpu lines
+ *
+ * The intr line holds a counter for every interrupt line and can be tens of
+ * kilobytes long; only its first number is parsed and the rest skipped with
+ * memchr.
+ *
+ * @param p start of the first line after the cpu lines
+ * @param end end of the buffer
+ * @param c where to store the counters
+ * @return 1 if the softirq line, the last one, was reached, 0 otherwise
+ */
+static int ParseCounters(const char *p, const char *end,
+                         struct stat_counters *c) {
+  while (p < end) {
+    for (size_t k = 0; k < COUNTER_KEY_NUM; k++) {
+      const struct counter_key *key = &counter_keys[k];
+      if ((size_t)(end - p) > key->len &&
+          memcmp(p, key->name, key->len) == 0) {
+        unsigned long long n = 0;
+        const char *d = p + key->len;
+        while (d < end && *d >= '0' && *d <= '9') {
+          n = n * 10 + (*d - '0');
+          d++;
+        }
+        *(unsigned long long *)((char *)c + key->offset) = n;
+        if (key->offset == offsetof(struct stat_counters, softirq)) {
+          return d < end; // the whole number was read
+        }
+        break;
+      }
+    }
+    p = memchr(p, '\n', end - p);
+    if (p == NULL) {
+      return 0;
+    }
+    p++;
   }
+  return 0;
+}
 
-  // loop through all command line arguments
-  // set corresponding flag
-  if (argc > 1) {
-    for (int i = 1; i < argc; i++) {
-      if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
-          (sample_size > 0)) {
-        continue;
-      } else if (sscanf(argv[i], "--tdelay=%d", &period) == 1 && (period > 0)) {
-        continue;
-      } else if (strcmp(argv[i], "--graphics") == 0) {
-        graphic_state = 1;
+/**
+ * @brief parse the cpu lines of /proc/stat content in a single pass
+ *
+ * Parsing stops at the first line that is not a cpu line, since the kernel
+ * prints all of them first, unless the counters after them are wanted too.
+ * Offline cpus have no line, so each core is stored at the row of its id.
+ *
+ * @param buf content of /proc/stat
+ * @param len number of bytes in buf
+ * @param sample where to store the counters
+ * @return 1 if everything wanted was parsed, 0 if buf ended first
+ */
+int ParseCpuStat(const char *buf, size_t len, struct cpu_sample *sample) {
+  const char *p = buf;
+  const char *end = buf + len;
+  sample->core_count = 0;
+  memset(sample->online, 0, sample->core_num);
+  while (p < end) {
+    if (end - p < 4 || strncmp(p, "cpu", 3) != 0) {
+      if (sample->want_counters) {
+        return ParseCounters(p, end, &sample->counters);
       }
+      return end - p >= 4;
+    }
+    p += 3;
+    if (*p == ' ') {
+      p = ParseCpuFields(p, end, sample->total);
+      continue;
+    }
+    int id = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      id = id * 10 + (*p - '0');
+      p++;
+    }
+    if (id < sample->core_num) {
+      p = ParseCpuFields(p, end, sample->cores + id * CPU_FIELDS);
+      sample->online[id] = 1;
+      if (id >= sample->core_count) {
+        sample->core_count = id + 1;
+      }
+    } else {
+      // an id beyond the ones we allocated for, ignore the line
+      while (p < end && *p != '\n') {
+        p++;
+      }
+      p = p < end ? p + 1 : end;
     }
   }
+  return 0;
+}
 
-  // print out information in the required format
-  for (int i = 0; i < sample_size; i++) {
-    ShowCore();
-    cpu = ShowCpu(period);
-    if (graphic_state == 1) {
-      CpuGraph(cpu);
+/**
+ * @brief read one sample of all cpu lines from /proc/stat
+ *
+ * The file is kept open and read with one pread into a buffer sized for the
+ * number of cores, which is only grown if the cpu lines do not fit. With
+ * want_counters the buffer grows to the whole file once, so the cpu lines
+ * and the counters still come from a single read.
+ *
+ * @param sample where to store the counters
+ */
+void ReadCpuSample(struct cpu_sample *sample) {
+  if (stat_fd < 0) {
+    stat_fd = OpenProc("/proc/stat", O_RDONLY);
+    if (stat_fd < 0) {
+      perror("open");
+      exit(1);
+    }
+    // about 80 bytes per cpu line, leave room for the start of "intr"
+    stat_size = (sample->core_num + 1) * 128 + 256;
+    stat_buf = malloc(stat_size);
+    if (stat_buf == NULL) {
+      perror("malloc");
+      exit(1);
     }
-    printf("%s\n", special_string);
   }
+  while (1) {
+    long long start = StageStart();
+    ssize_t len = pread(stat_fd, stat_buf, stat_size, 0);
+    if (len < 0) {
+      perror("pread");
+      exit(1);
+    }
+    StageEnd(PROFILE_CPU, STAGE_READ, start);
+    start = StageStart();
+    stat_len = len;
+    int complete = ParseCpuStat(stat_buf, len, sample);
+    StageEnd(PROFILE_CPU, STAGE_PARSE, start);
+    if (complete || (size_t)len < stat_size) {
+      return;
+    }
+    // cpu lines did not fit, grow the buffer and read again
+    stat_size *= 2;
+    stat_buf = realloc(stat_buf, stat_size);
+    if (stat_buf == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * @brief the bytes of /proc/stat the last ReadCpuSample() parsed
+ *
+ * Without want_counters this is only the start of the file, up to a little
+ * after the cpu lines.
+ *
+ * @param len where to store the number of bytes
+ * @return the bytes, valid until the next read
+ */
+const char *LastCpuStat(size_t *len) {
+  *len = stat_len;
+  return stat_buf;
+}
+
+/**
+ * @brief caculate the share of each counter between two cpu lines
+ *
+ *    guest and guest_nice are already included in user and nice, so they are
+ *    not added to the total again.
+ *
+ * @param pre counters of the earlier sample
+ * @param aft counters of the later sample
+ * @param share where to store the share of each counter in percentage
+ * @return the utilization percentage (time not idle or waiting for io)
+ */
+double CpuShare(const unsigned long long *pre, const unsigned long long *aft,
+                double *share) {
+  unsigned long long diff[CPU_FIELDS];
+  unsigned long long total = 0;
+  for (int i = 0; i < CPU_FIELDS; i++) {
+    diff[i] = aft[i] > pre[i] ? aft[i] - pre[i] : 0;
+    if (i < CPU_GUEST) {
+      total += diff[i];
+    }
+  }
+  for (int i = 0; i < CPU_FIELDS; i++) {
+    share[i] = total == 0 ? 0 : (double)diff[i] / (double)total * 100;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  return (double)(total - diff[CPU_IDLE] - diff[CPU_IOWAIT]) / (double)total *
+         100;
+}
+
+/**
+ * @brief allocate the per-core utilization of a usage for the given number
+ * of cores
+ *
+ * @param usage usage to initialize
+ * @param core_num number of cores the usage can hold
+ */
+void InitCpuUsage(struct cpu_usage *usage, int core_num) {
+  memset(usage, 0, sizeof(*usage));
+  usage->core_num = core_num;
+  usage->cores = calloc(core_num, sizeof(double));
+  if (usage->cores == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+}
+
+/**
+ * @brief caculate the utilization between two samples of /proc/stat
+ *
+ * @param pre sample at the start of the period
+ * @param aft sample at the end of the period
+ * @param usage where to store the utilization
+ */
+void CompareCpu(const struct cpu_sample *pre, const struct cpu_sample *aft,
+                struct cpu_usage *usage) {
+  double share[CPU_FIELDS];
+  usage->usage = CpuShare(pre->total, aft->total, share);
+  usage->user = share[CPU_USER] + share[CPU_NICE];
+  usage->system = share[CPU_SYSTEM] + share[CPU_IRQ] + share[CPU_SOFTIRQ];
+  usage->iowait = share[CPU_IOWAIT];
+  usage->steal = share[CPU_STEAL];
+  unsigned long long ticks = 0;
+  for (int i = 0; i < CPU_GUEST; i++) {
+    ticks += aft->total[i] > pre->total[i] ? aft->total[i] - pre->total[i] : 0;
+  }
+  usage->resolution = ticks > 0 ? 100.0 / ticks : 0;
+  int count =
+      pre->core_count < aft->core_count ? pre->core_count : aft->core_count;
+  if (count > usage->core_num) {
+    count = usage->core_num;
+  }
+  for (int i = 0; i < count; i++) {
+    // a core offline in either sample has no utilization over the period
+    usage->cores[i] = pre->online[i] && aft->online[i]
+                          ? CpuShare(pre->cores + i * CPU_FIELDS,
+                                     aft->cores + i * CPU_FIELDS, share)
+                          : CPU_OFFLINE;
+  }
+  usage->core_count = count;
+}
+
+/**
+ * @brief Measuring the utilization percentage of CPU since the previous
+ * sample by reading file /proc/stat
+ *
+ *    The new counters are read into aft, then pre and aft are swapped, so pre
+ *    always holds the latest sample for the next call. The caller decides
+ *    when to sample; pre must have been read once before the first call.
+ *
+ * @param pre preallocated sample holding the previous counters
+ * @param aft preallocated sample the current counters are read into
+ * @param usage where to store the utilization
+ */
+void MeasureCpu(struct cpu_sample *pre, struct cpu_sample *aft,
+                struct cpu_usage *usage) {
+  ReadCpuSample(aft); // read current cpu values
+  CompareCpu(pre, aft, usage);
+  struct cpu_sample tmp = *pre;
+  *pre = *aft;
+  *aft = tmp;
+}
+
+/**
+ * @brief how much the cpu usage changed beyond the resolution of /proc/stat
+ *
+ * Either sample may be off by one clock tick of the counters, which is worth
+ * several percent over a short period on a small machine, so that much of a
+ * change is left out.
+ *
+ * @param usage the latest sample
+ * @param last the usage of the sample before
+ * @return the change in percentage points, 0 if within the resolution
+ */
+double CpuChange(const struct cpu_usage *usage, double last) {
+  double change =
+      usage->usage > last ? usage->usage - last : last - usage->usage;
+  change -= 2 * usage->resolution;
+  return change > 0 ? change : 0;
+}
+
+/**
+ * @brief Displaying the utilization percentage of CPU
+ *
+ *    Shows the total utilization, a user/system/iowait/steal breakdown and,
+ *    if core_state is set, the utilization of every core measured, labeled
+ *    with its cpu id.
+ *
+ * @param out where to print
+ * @param usage utilization to display
+ * @param core_state if 1, then show the utilization of each core
+ */
+void PrintCpu(FILE *out, const struct cpu_usage *usage, int core_state) {
+  fprintf(out, "CPU usage: %.2f%%\n", usage->usage);
+  fprintf(out, "user: %.2f%% system: %.2f%% iowait: %.2f%% steal: %.2f%%\n",
+          usage->user, usage->system, usage->iowait, usage->steal);
+  if (core_state == 1) {
+    int shown = 0;
+    for (int i = 0; i < usage->core_count; i++) {
+      if (usage->cores[i] < 0) {
+        continue; // offline, the others keep their id
+      }
+      // eight cores per line keeps large machines readable
+      fprintf(out, "%scpu%-3d %6.2f%%",
+              shown == 0 ? "" : shown % 8 == 0 ? "\n" : "  ", i,
+              usage->cores[i]);
+      shown++;
+    }
+    if (shown > 0) {
+      fputc('\n', out);
+    }
+  }
+}
+
+/**
+ * @brief Displaying cpu usage in graphic form
+ *
+ *    The number of symbol "|" is equals to number of percentage, printed
+ *    as one string rather than one character at a time.
+ *
+ * @param out where to print
+ * @param cpu used cpu percentage
+ *
+ * @return void
+ */
+void CpuGraph(FILE *out, double cpu) {
+  static const char bars[] = "||||||||||||||||||||||||||||||||||||||||||||||||||"
+                             "||||||||||||||||||||||||||||||||||||||||||||||||||";
+  int n = cpu < 0 ? 0 : cpu > 100 ? 100 : (int)cpu;
+  fprintf(out, "\t%.*s%.2f\n", n, bars, cpu * 0.01);
 }
@@ -0,0 +1,89 @@
+#ifndef CPU_STATS_H
+#define CPU_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// order of the ten counters on every cpu line of /proc/stat
+#define CPU_USER 0
+#define CPU_NICE 1
+#define CPU_SYSTEM 2
+#define CPU_IDLE 3
+#define CPU_IOWAIT 4
+#define CPU_IRQ 5
+#define CPU_SOFTIRQ 6
+#define CPU_STEAL 7
+#define CPU_GUEST 8
+#define CPU_GUEST_NICE 9
+#define CPU_FIELDS 10
+
+// utilization of a core missing from either sample, e.g. one taken offline
+#define CPU_OFFLINE -1.0
+
+/**
+ * @brief the lines of /proc/stat after the cpu lines
+ */
+struct stat_counters {
+  unsigned long long intr;          // interrupts serviced since boot
+  unsigned long long ctxt;          // context switches since boot
+  unsigned long long processes;     // tasks created since boot
+  unsigned long long procs_running; // tasks runnable right now
+  unsigned long long procs_blocked; // tasks waiting for io right now
+  unsigned long long softirq;       // softirqs serviced since boot
+};
+
+/**
+ * @brief counters of one sample of /proc/stat
+ *
+ * total holds the aggregate "cpu" line, cores holds one row of CPU_FIELDS
+ * counters for each "cpuN" line at row N, so a core keeps its row when
+ * another one goes offline. cores is allocated once for core_num rows, one
+ * per possible cpu id, so sampling never allocates. The lines after the cpu
+ * lines are only parsed, from the same read, when want_counters is set.
+ */
+struct cpu_sample {
+  int core_num;                         // number of rows allocated in cores
+  int core_count;                       // one past the highest cpuN line read
+  unsigned long long total[CPU_FIELDS]; // aggregate cpu line
+  unsigned long long *cores;            // core_num * CPU_FIELDS counters
+  unsigned char *online;                // 1 for each row read this sample
+  int want_counters;                    // 1 to parse counters as well
+  struct stat_counters counters;
+};
+
+/**
+ * @brief utilization over one period as shown on screen, in percentage
+ *
+ * cores is allocated once for core_num entries, like struct cpu_sample.
+ */
+struct cpu_usage {
+  int core_num;   // number of entries allocated in cores
+  int core_count; // one past the highest core measured
+  double usage;   // time not idle or waiting for io
+  double user;    // user + nice
+  double system;  // system + irq + softirq
+  double iowait;
+  double steal;
+  double resolution; // percentage points one tick of /proc/stat is worth
+  double *cores; // utilization of each core by id, or CPU_OFFLINE
+};
+
+int GetCoreNum();
+int GetCoreSlots();
+void ShowCore(FILE *out);
+void InitCpuSample(struct cpu_sample *sample, int core_num);
+void InitCpuUsage(struct cpu_usage *usage, int core_num);
+int ParseCpuStat(const char *buf, size_t len, struct cpu_sample *sample);
+void ReadCpuSample(struct cpu_sample *sample);
+const char *LastCpuStat(size_t *len);
+double CpuShare(const unsigned long long *pre, const unsigned long long *aft,
+                double *share);
+void CompareCpu(const struct cpu_sample *pre, const struct cpu_sample *aft,
+                struct cpu_usage *usage);
+void MeasureCpu(struct cpu_sample *pre, struct cpu_sample *aft,
+                struct cpu_usage *usage);
+double CpuChange(const struct cpu_usage *usage, double last);
+void PrintCpu(FILE *out, const struct cpu_usage *usage, int core_state);
+void CpuGraph(FILE *out, double cpu);
+
+#endif
@@ -0,0 +1,133 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu_stats.h"
+#include "frame.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for getting cpu info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines so the work done per sample does not add up.
+ * --tdelay also takes periods such as 500ms or 250us.
+ * Able to take command line argument to print each itertion in graphic,
+ * sequential or refreshing form, and to show the usage of every core.
+ * With --binary, every sample is written as a frame for sys_monitoring_tool
+ * instead.
+ * With --self-stats, the time spent in each stage is shown at the end, or
+ * sent to sys_monitoring_tool after the last frame.
+ * With --root=DIR, the files below DIR are read instead of the system's.
+ * With --adaptive=MIN,MAX, the time between samples grows from MIN up to
+ * MAX while the cpu usage barely changes, and is MIN again after a fast change.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  long long max_period = 0; // longest period with --adaptive
+  struct ticker ticker;
+  struct frame_header hdr;
+  int graphic_state = 0;
+  int core_state = 0;
+  int binary_state = 0;
+  struct cpu_sample pre;
+  struct cpu_sample aft;
+  struct cpu_usage usage;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+          (sample_size > 0)) {
+        continue;
+      } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+                 ParsePeriod(argv[i] + 9, &period)) {
+        continue;
+      } else if (ParseEpoch(argv[i], &start, &real)) {
+        continue;
+      } else if (ParseAdaptive(argv[i], &period, &max_period)) {
+        continue;
+      } else if (ParseRoot(argv[i])) {
+        continue;
+      } else if (strcmp(argv[i], "--graphics") == 0) {
+        graphic_state = 1;
+      } else if (strcmp(argv[i], "--cores") == 0) {
+        core_state = 1;
+      } else if (strcmp(argv[i], "--binary") == 0) {
+        binary_state = 1;
+      } else if (strcmp(argv[i], "--self-stats") == 0) {
+        EnableProfile();
+      }
+    }
+  }
+
+  // allocate sample buffers once, sized for the online cores
+  InitCpuSample(&pre, GetCoreSlots());
+  InitCpuSample(&aft, GetCoreSlots());
+  InitCpuUsage(&usage, GetCoreSlots());
+
+  // read the counters the first period is compared with
+  StartProfile(PROFILE_CPU);
+  InitTicker(&ticker, period, start, real);
+  if (max_period > 0) {
+    SetAdaptive(&ticker, max_period);
+  }
+  ReadCpuSample(&pre);
+
+  // print out information in the required format
+  for (int i = 0; i < sample_size; i++) {
+    long long tick = WaitTick(&ticker);
+    double last = usage.usage;
+    MeasureCpu(&pre, &aft, &usage);
+    if (i > 0) {
+      AdaptTicker(&ticker, CpuChange(&usage, last));
+    }
+    long long stage = StageStart();
+    if (binary_state == 1) {
+      // sys_monitoring_tool renders the sample itself
+      InitFrameHeader(&hdr, i, &ticker, tick);
+      WriteCpuFrame(STDOUT_FILENO, &hdr, &usage);
+      StageEnd(PROFILE_CPU, STAGE_SERIALIZE, stage);
+      continue;
+    }
+    ShowCore(stdout);
+    PrintCpu(stdout, &usage, core_state);
+    if (graphic_state == 1) {
+      CpuGraph(stdout, usage.usage);
+    }
+    fflush(stdout); // one write per sample
+    StageEnd(PROFILE_CPU, STAGE_RENDER, stage);
+  }
+  StopProfile(PROFILE_CPU);
+  if (profile_state == 1 && binary_state == 1) {
+    // sent after the last sample, for sys_monitoring_tool --self-stats
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.seq = sample_size;
+    hdr.timestamp = RealtimeNow();
+    WriteStatsFrame(STDOUT_FILENO, &hdr, PROFILE_CPU);
+  } else if (profile_state == 1) {
+    PrintProfile(stdout);
+  }
+  if (ticker.missed > 0) {
+    fprintf(stderr, "cpu_stats: missed %lld deadlines\n", ticker.missed);
+  }
+}
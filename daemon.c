@@ -0,0 +1,552 @@
+#define _GNU_SOURCE // for accept4 and pipe2
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "frame.h"
+#include "metrics.h"
+
+// path of the socket, removed again when the daemon is stopped by a signal
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+// name of each collector in the text snapshot
+static const char *metric_sources[SOURCE_NUM] = {"memory", "user", "cpu"};
+
+/**
+ * @brief a client connected to the socket
+ *
+ * The client first sends a request line, "text" or "binary", and is then sent
+ * the snapshot it asked for; the connection is closed after it.
+ */
+struct client {
+  int fd;
+  struct snapshot *snap; // NULL while the request is read
+  size_t off;            // bytes of snap already sent
+  size_t req_len;        // bytes of the request read so far
+  char req[16];
+};
+
+/**
+ * @brief handler for the signals that stop the daemon
+ *
+ * @param sig
+ */
+static void RemoveSocket(int sig) {
+  unlink(socket_path);
+  _exit(0);
+}
+
+/**
+ * @brief copy serialized samples into a new snapshot
+ *
+ * @param data the serialized samples
+ * @param len bytes in data
+ * @return the snapshot, with one reference
+ */
+static struct snapshot *NewSnapshot(const char *data, size_t len) {
+  struct snapshot *snap = malloc(sizeof(*snap) + len);
+  if (snap == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  snap->refs = 1;
+  snap->len = len;
+  if (len > 0) {
+    memcpy(snap->data, data, len);
+  }
+  return snap;
+}
+
+/**
+ * @brief drop a reference to a snapshot, freeing it with the last one
+ *
+ * Must be called with the lock held.
+ *
+ * @param snap the snapshot
+ */
+static void DropSnapshot(struct snapshot *snap) {
+  if (--snap->refs == 0) {
+    free(snap);
+  }
+}
+
+/**
+ * @brief print a label value, escaped as the text format requires
+ *
+ * @param out where to print
+ * @param value the value
+ */
+static void PrintLabel(FILE *out, const char *value) {
+  for (const char *c = value; *c != '\0'; c++) {
+    if (*c == '\\' || *c == '"') {
+      fputc('\\', out);
+      fputc(*c, out);
+    } else if (*c == '\n') {
+      fputs("\\n", out);
+    } else {
+      fputc(*c, out);
+    }
+  }
+}
+
+/**
+ * @brief print the statistics of every metric in the text exposition format
+ *
+ * @param out where to print
+ * @param set the statistics
+ */
+static void PrintStatsText(FILE *out, const struct metric_set *set) {
+  const char *names[3] = {"ewma", "mean", "stddev"};
+  const double quantiles[3] = {0.5, 0.95, 0.99};
+  for (int k = 0; k < 3; k++) {
+    fprintf(out, "# TYPE smt_metric_%s gauge\n", names[k]);
+    for (int i = 0; i < METRIC_NUM; i++) {
+      const struct metric *m = &set->m[i];
+      if (m->count > 0) {
+        double v = k == 0 ? m->ewma : k == 1 ? m->mean : Stddev(m);
+        fprintf(out, "smt_metric_%s{metric=\"%s\"} %g\n", names[k],
+                metric_names[i], v);
+      }
+    }
+  }
+  fprintf(out, "# TYPE smt_metric summary\n");
+  for (int i = 0; i < METRIC_NUM; i++) {
+    const struct metric *m = &set->m[i];
+    if (m->count == 0) {
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      fprintf(out, "smt_metric{metric=\"%s\",quantile=\"%g\"} %g\n",
+              metric_names[i], quantiles[k], Quantile(m, quantiles[k]));
+    }
+    fprintf(out, "smt_metric_sum{metric=\"%s\"} %g\n", metric_names[i],
+            m->mean * m->count);
+    fprintf(out, "smt_metric_count{metric=\"%s\"} %lld\n", metric_names[i],
+            m->count);
+  }
+}
+
+/**
+ * @brief print the latest samples in the text exposition format
+ *
+ * One "name value" line per metric, each preceded by its type, so the text
+ * can be read by a person or scraped as is.
+ *
+ * @param out where to print
+ * @param s latest samples
+ * @param received number of samples received from each collector
+ */
+static void PrintText(FILE *out, const struct samples *s,
+                      const int *received) {
+  fprintf(out, "# TYPE smt_samples_total counter\n");
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    fprintf(out, "smt_samples_total{collector=\"%s\"} %d\n", metric_sources[i],
+            received[i]);
+  }
+  fprintf(out, "# TYPE smt_missed_deadlines_total counter\n");
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    fprintf(out, "smt_missed_deadlines_total{collector=\"%s\"} %lld\n",
+            metric_sources[i], s->missed[i]);
+  }
+  fprintf(out, "# TYPE smt_sample_timestamp_seconds gauge\n");
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (received[i] > 0) {
+      fprintf(out, "smt_sample_timestamp_seconds{collector=\"%s\"} %.9f\n",
+              metric_sources[i], s->timestamp[i] * 1e-9);
+    }
+  }
+  fprintf(out, "# TYPE smt_sample_interval_seconds gauge\n");
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (received[i] > 0) {
+      fprintf(out, "smt_sample_interval_seconds{collector=\"%s\"} %.9f\n",
+              metric_sources[i], s->interval[i] * 1e-9);
+    }
+  }
+
+  if (received[SOURCE_MEM] > 0) {
+    const char *names[4] = {"phys_used", "phys_total", "virtual_used",
+                            "virtual_total"};
+    long values[4] = {s->mem.phys_used, s->mem.total_phys,
+                      s->mem.virtual_used, s->mem.total_virtual};
+    for (int i = 0; i < 4; i++) {
+      fprintf(out, "# TYPE smt_memory_%s_bytes gauge\n", names[i]);
+      fprintf(out, "smt_memory_%s_bytes %ld\n", names[i], values[i]);
+    }
+    fprintf(out, "# TYPE smt_memory_available_bytes gauge\n");
+    fprintf(out, "smt_memory_available_bytes %llu\n",
+            s->mem.info.mem_available * 1024);
+  }
+
+  if (received[SOURCE_CPU] > 0) {
+    const char *names[5] = {"usage", "user", "system", "iowait", "steal"};
+    double values[5] = {s->cpu.usage, s->cpu.user, s->cpu.system,
+                        s->cpu.iowait, s->cpu.steal};
+    for (int i = 0; i < 5; i++) {
+      fprintf(out, "# TYPE smt_cpu_%s_percent gauge\n", names[i]);
+      fprintf(out, "smt_cpu_%s_percent %.2f\n", names[i], values[i]);
+    }
+    fprintf(out, "# TYPE smt_cpu_core_usage_percent gauge\n");
+    for (int i = 0; i < s->cpu.core_count; i++) {
+      if (s->cpu.cores[i] >= 0) { // offline cores have no value
+        fprintf(out, "smt_cpu_core_usage_percent{core=\"%d\"} %.2f\n", i,
+                s->cpu.cores[i]);
+      }
+    }
+  }
+
+  if (received[SOURCE_USER] > 0) {
+    fprintf(out, "# TYPE smt_users gauge\n");
+    fprintf(out, "smt_users %d\n", s->users.count);
+    fprintf(out, "# TYPE smt_user_session gauge\n");
+    for (int i = 0; i < s->users.count; i++) {
+      const struct session *u = &s->users.sessions[i];
+      fprintf(out, "smt_user_session{name=\"");
+      PrintLabel(out, u->name);
+      fprintf(out, "\",line=\"");
+      PrintLabel(out, u->line);
+      fprintf(out, "\",host=\"");
+      PrintLabel(out, u->host);
+      fprintf(out, "\"} 1\n");
+    }
+  }
+
+  if (s->metrics != NULL) {
+    PrintStatsText(out, s->metrics);
+  }
+}
+
+/**
+ * @brief print the latest samples as frames, one for each collector
+ *
+ * The frames are the same as the child programs send and the history file
+ * holds, so they are decoded with the functions of frame.c.
+ *
+ * @param out where to print
+ * @param s latest samples
+ * @param received number of samples received from each collector
+ */
+static void PrintFrames(FILE *out, const struct samples *s,
+                        const int *received) {
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (received[i] == 0) {
+      continue;
+    }
+    struct frame_header hdr;
+    struct frame_parts p;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.seq = received[i] - 1;
+    hdr.missed = s->missed[i];
+    hdr.timestamp = s->timestamp[i];
+    hdr.interval = s->interval[i];
+    if (i == SOURCE_MEM) {
+      PackMemFrame(&hdr, &s->mem, &p);
+    } else if (i == SOURCE_USER) {
+      PackUserFrame(&hdr, &s->users, &p);
+    } else {
+      PackCpuFrame(&hdr, &s->cpu, &p);
+    }
+    fwrite(&hdr, sizeof(hdr), 1, out);
+    fwrite(&p.head, p.head_len, 1, out);
+    if (p.body_len > 0) {
+      fwrite(p.body, p.body_len, 1, out);
+    }
+  }
+}
+
+/**
+ * @brief read the request of a client and pick the snapshot it asked for
+ *
+ * @param sv the server
+ * @param c the client
+ * @return 0 if the request is not complete yet, 1 if it was read, -1 if the
+ * client should be closed
+ */
+static int ReadRequest(struct server *sv, struct client *c) {
+  ssize_t n = read(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len);
+  if (n < 0) {
+    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+  }
+  c->req_len += n;
+  c->req[c->req_len] = '\0';
+  char *end = strchr(c->req, '\n');
+  if (end == NULL && n > 0 && c->req_len < sizeof(c->req) - 1) {
+    return 0; // more to come
+  }
+  if (end != NULL) {
+    *end = '\0';
+  }
+  c->req[strcspn(c->req, "\r")] = '\0';
+
+  pthread_mutex_lock(&sv->lock);
+  if (strcmp(c->req, "text") == 0 || c->req[0] == '\0') {
+    c->snap = sv->text;
+  } else if (strcmp(c->req, "binary") == 0) {
+    c->snap = sv->binary;
+  }
+  if (c->snap != NULL) {
+    c->snap->refs++;
+  }
+  pthread_mutex_unlock(&sv->lock);
+  if (c->snap == NULL) {
+    const char *msg = "unknown request, send text or binary\n";
+    send(c->fd, msg, strlen(msg), MSG_NOSIGNAL | MSG_DONTWAIT);
+    return -1;
+  }
+  return 1;
+}
+
+/**
+ * @brief continue serving a client that is ready
+ *
+ * @param sv the server
+ * @param c the client
+ * @return 1 if the client is done and should be closed, 0 otherwise
+ */
+static int ServeClient(struct server *sv, struct client *c) {
+  if (c->snap == NULL) {
+    int ready = ReadRequest(sv, c);
+    if (ready <= 0) {
+      return ready < 0;
+    }
+  }
+  while (c->off < c->snap->len) {
+    ssize_t n = send(c->fd, c->snap->data + c->off, c->snap->len - c->off,
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno != EAGAIN; // wait until the client reads some
+    }
+    c->off += n;
+  }
+  return 1;
+}
+
+/**
+ * @brief close the connection of a client
+ *
+ * @param sv the server
+ * @param c the client
+ */
+static void CloseClient(struct server *sv, struct client *c) {
+  close(c->fd);
+  if (c->snap != NULL) {
+    pthread_mutex_lock(&sv->lock);
+    DropSnapshot(c->snap);
+    pthread_mutex_unlock(&sv->lock);
+  }
+}
+
+/**
+ * @brief thread accepting and serving the clients
+ *
+ * All clients are multiplexed with one poll(), so a slow client never delays
+ * the others.
+ *
+ * @param arg the server
+ * @return NULL
+ */
+static void *ServerThread(void *arg) {
+  struct server *sv = arg;
+  struct client *clients = calloc(MAX_CLIENTS, sizeof(struct client));
+  struct pollfd *fds = calloc(MAX_CLIENTS + 2, sizeof(struct pollfd));
+  int count = 0;
+  if (clients == NULL || fds == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  while (1) {
+    fds[0].fd = sv->wake[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = sv->listen_fd;
+    fds[1].events = POLLIN;
+    for (int i = 0; i < count; i++) {
+      fds[i + 2].fd = clients[i].fd;
+      fds[i + 2].events = clients[i].snap == NULL ? POLLIN : POLLOUT;
+    }
+    if (poll(fds, count + 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll");
+      exit(1);
+    }
+    if (fds[0].revents != 0) {
+      break; // StopServer
+    }
+    // backwards, so the last client can be moved into a closed slot
+    for (int i = count - 1; i >= 0; i--) {
+      if (fds[i + 2].revents != 0 && ServeClient(sv, &clients[i])) {
+        CloseClient(sv, &clients[i]);
+        clients[i] = clients[--count];
+      }
+    }
+    if (fds[1].revents != 0) {
+      int fd;
+      while ((fd = accept4(sv->listen_fd, NULL, NULL,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        if (count == MAX_CLIENTS) {
+          close(fd);
+          continue;
+        }
+        memset(&clients[count], 0, sizeof(struct client));
+        clients[count++].fd = fd;
+      }
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    CloseClient(sv, &clients[i]);
+  }
+  free(clients);
+  free(fds);
+  return NULL;
+}
+
+/**
+ * @brief create the listening socket, replacing the one of a daemon that no
+ * longer runs
+ *
+ * @param path where to create the socket
+ * @return the socket
+ */
+static int ListenSocket(const char *path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    exit(1);
+  }
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("socket");
+    exit(1);
+  }
+  struct stat st;
+  if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) &&
+      connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+      errno == ECONNREFUSED) {
+    unlink(path); // left behind by a daemon that was killed
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror(path);
+    exit(1);
+  }
+  if (listen(fd, SOMAXCONN) < 0) {
+    perror("listen");
+    exit(1);
+  }
+  return fd;
+}
+
+/**
+ * @brief start serving snapshots on a Unix socket
+ *
+ * Until the first samples are published, clients get empty snapshots.
+ * SIGINT and SIGTERM remove the socket and end the program.
+ *
+ * @param sv server to start
+ * @param path where to create the socket
+ */
+void StartServer(struct server *sv, const char *path) {
+  memset(sv, 0, sizeof(*sv));
+  sv->listen_fd = ListenSocket(path);
+  strcpy(socket_path, path);
+  if (pipe2(sv->wake, O_CLOEXEC) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  pthread_mutex_init(&sv->lock, NULL);
+  sv->text = NewSnapshot(NULL, 0);
+  sv->binary = NewSnapshot(NULL, 0);
+  sv->text_out = open_memstream(&sv->text_buf, &sv->text_len);
+  sv->binary_out = open_memstream(&sv->binary_buf, &sv->binary_len);
+  if (sv->text_out == NULL || sv->binary_out == NULL) {
+    perror("open_memstream");
+    exit(1);
+  }
+  if (signal(SIGINT, RemoveSocket) == SIG_ERR ||
+      signal(SIGTERM, RemoveSocket) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // the handlers always run on the thread that samples
+  sigset_t block, old;
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTERM);
+  sigaddset(&block, SIGTSTP);
+  pthread_sigmask(SIG_BLOCK, &block, &old);
+  int err = pthread_create(&sv->thread, NULL, ServerThread, sv);
+  if (err != 0) {
+    fprintf(stderr, "pthread_create: %s\n", strerror(err));
+    exit(1);
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief serialize the latest samples and serve them from now on
+ *
+ * Both forms are built here, once per sample, and swapped in under the lock.
+ * Clients still sending the previous snapshots keep them until they are done.
+ *
+ * @param sv the server
+ * @param s latest samples
+ * @param received number of samples received from each collector
+ */
+void PublishSamples(struct server *sv, const struct samples *s,
+                    const int *received) {
+  rewind(sv->text_out);
+  PrintText(sv->text_out, s, received);
+  fflush(sv->text_out);
+  struct snapshot *text = NewSnapshot(sv->text_buf, ftell(sv->text_out));
+  rewind(sv->binary_out);
+  PrintFrames(sv->binary_out, s, received);
+  fflush(sv->binary_out);
+  struct snapshot *binary = NewSnapshot(sv->binary_buf, ftell(sv->binary_out));
+
+  pthread_mutex_lock(&sv->lock);
+  DropSnapshot(sv->text);
+  DropSnapshot(sv->binary);
+  sv->text = text;
+  sv->binary = binary;
+  pthread_mutex_unlock(&sv->lock);
+}
+
+/**
+ * @brief stop serving, closing all connections and removing the socket
+ *
+ * @param sv the server
+ */
+void StopServer(struct server *sv) {
+  if (write(sv->wake[1], "", 1) < 0) {
+    perror("write");
+    exit(1);
+  }
+  pthread_join(sv->thread, NULL);
+  close(sv->listen_fd);
+  close(sv->wake[0]);
+  close(sv->wake[1]);
+  unlink(socket_path);
+  DropSnapshot(sv->text);
+  DropSnapshot(sv->binary);
+  fclose(sv->text_out);
+  fclose(sv->binary_out);
+  free(sv->text_buf);
+  free(sv->binary_buf);
+  pthread_mutex_destroy(&sv->lock);
+}
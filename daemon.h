@@ -0,0 +1,52 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "render.h"
+
+// most clients served at the same time, more are turned away
+#define MAX_CLIENTS 1024
+
+/**
+ * @brief one serialized form of the latest samples
+ *
+ * A snapshot is never changed once published. Clients that are still being
+ * sent an older one keep it alive with a reference.
+ */
+struct snapshot {
+  int refs;    // references, changed with the server lock held
+  size_t len;  // bytes in data
+  char data[];
+};
+
+/**
+ * @brief serves the latest samples to local clients over a Unix socket
+ *
+ * The samples are serialized once by the thread that receives them; a server
+ * thread only sends the finished snapshots, so the cost of sampling does not
+ * depend on the number of clients.
+ */
+struct server {
+  int listen_fd;
+  int wake[2]; // pipe to stop the server thread
+  pthread_t thread;
+  pthread_mutex_t lock;
+  struct snapshot *text;   // text exposition format
+  struct snapshot *binary; // one frame of each collector
+  FILE *text_out;          // where the next text snapshot is built
+  char *text_buf;
+  size_t text_len;
+  FILE *binary_out; // where the next binary snapshot is built
+  char *binary_buf;
+  size_t binary_len;
+};
+
+void StartServer(struct server *sv, const char *path);
+void PublishSamples(struct server *sv, const struct samples *s,
+                    const int *received);
+void StopServer(struct server *sv);
+
+#endif
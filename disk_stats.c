@@ -0,0 +1,264 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "disk_stats.h"
+#include "procfs.h"
+
+// position of each kept counter among the fields after the device name
+static const int disk_columns[DISK_COUNTERS] = {0, 2, 3, 4, 6, 7, 9};
+
+/**
+ * @brief initialize the table of block devices
+ *
+ * @param t table to initialize
+ */
+void InitDiskTable(struct disk_table *t) {
+  memset(t, 0, sizeof(*t));
+  t->fd = OpenProc("/proc/diskstats", O_RDONLY);
+  if (t->fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  t->size = 16384; // about 100 bytes per device
+  t->buf = malloc(t->size);
+  t->cap = 64;
+  t->devs = calloc(t->cap, sizeof(struct disk_dev));
+  if (t->buf == NULL || t->devs == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+}
+
+/**
+ * @brief parse an unsigned decimal number, skipping the spaces before it
+ *
+ * @param p where to start, moved past the number
+ * @param end end of the buffer
+ * @return the number, 0 if there is none
+ */
+static unsigned long long ParseNumber(const char **p, const char *end) {
+  const char *c = *p;
+  unsigned long long n = 0;
+  while (c < end && *c == ' ') {
+    c++;
+  }
+  while (c < end && *c >= '0' && *c <= '9') {
+    n = n * 10 + (*c - '0');
+    c++;
+  }
+  *p = c;
+  return n;
+}
+
+/**
+ * @brief set up a device seen for the first time
+ *
+ * Whether it is a partition is looked up once in sysfs, not on every sample.
+ *
+ * @param d the device, with major, minor and name set
+ */
+static void NewDisk(struct disk_dev *d) {
+  char path[128];
+  char buf[8192];
+  snprintf(path, sizeof(path), "/sys/class/block/%s/partition", d->name);
+  d->partition = access(ProcPath(path, buf, sizeof(buf)), F_OK) == 0;
+  d->loop = strncmp(d->name, "loop", 4) == 0 || strncmp(d->name, "ram", 3) == 0;
+}
+
+/**
+ * @brief find the device of a line, moving it to the index of the line
+ *
+ * Devices keep their order in the file, so the device is normally already at
+ * that index and nothing is searched or moved.
+ *
+ * @param t the table
+ * @param i index of the line
+ * @param major major number of the device
+ * @param minor minor number of the device
+ * @param name name of the device
+ * @param name_len length of name
+ * @return the device, NULL if it was not seen before
+ */
+static struct disk_dev *FindDisk(struct disk_table *t, int i,
+                                 unsigned int major, unsigned int minor,
+                                 const char *name, size_t name_len) {
+  for (int k = i; k < t->count; k++) {
+    struct disk_dev *d = &t->devs[k];
+    if (d->major == major && d->minor == minor &&
+        strncmp(d->name, name, name_len) == 0 && d->name[name_len] == '\0') {
+      if (k != i) {
+        struct disk_dev tmp = t->devs[i];
+        t->devs[i] = *d;
+        *d = tmp;
+      }
+      return &t->devs[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief make room for a new device at index i
+ *
+ * The device that was at i is moved to the end, where it is found again if
+ * it still exists.
+ *
+ * @param t the table
+ * @param i index of the line of the new device
+ * @return the slot of the new device
+ */
+static struct disk_dev *InsertDisk(struct disk_table *t, int i) {
+  if (t->count == t->cap) {
+    t->cap *= 2;
+    t->devs = realloc(t->devs, t->cap * sizeof(struct disk_dev));
+    if (t->devs == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  if (i < t->count) {
+    t->devs[t->count] = t->devs[i];
+  }
+  t->count++;
+  memset(&t->devs[i], 0, sizeof(struct disk_dev));
+  return &t->devs[i];
+}
+
+/**
+ * @brief parse the content of /proc/diskstats in a single pass
+ *
+ * The counters of every device move to pre and the new ones are stored in
+ * cur. Devices that are no longer in the file are dropped.
+ *
+ * @param t the table
+ * @param buf content of /proc/diskstats
+ * @param len number of bytes in buf
+ */
+void ParseDiskStats(struct disk_table *t, const char *buf, size_t len) {
+  const char *p = buf;
+  const char *end = buf + len;
+  int i = 0;
+  while (p < end) {
+    unsigned int major = ParseNumber(&p, end);
+    unsigned int minor = ParseNumber(&p, end);
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    const char *name = p;
+    while (p < end && *p != ' ' && *p != '\n') {
+      p++;
+    }
+    size_t name_len = p - name;
+    if (name_len == 0 || name_len >= sizeof(t->devs[0].name)) {
+      while (p < end && *p != '\n') {
+        p++;
+      }
+      p = p < end ? p + 1 : end;
+      continue;
+    }
+
+    struct disk_dev *d = FindDisk(t, i, major, minor, name, name_len);
+    int fresh = d == NULL;
+    if (fresh) {
+      d = InsertDisk(t, i);
+      d->major = major;
+      d->minor = minor;
+      memcpy(d->name, name, name_len);
+      d->name[name_len] = '\0';
+      NewDisk(d);
+    } else {
+      memcpy(d->pre, d->cur, sizeof(d->cur));
+    }
+    int field = 0;
+    for (int k = 0; k < DISK_COUNTERS; k++) {
+      while (field < disk_columns[k]) {
+        ParseNumber(&p, end); // a counter that is not kept
+        field++;
+      }
+      d->cur[k] = ParseNumber(&p, end);
+      field++;
+    }
+    if (fresh) {
+      memcpy(d->pre, d->cur, sizeof(d->cur)); // nothing to compare with yet
+    }
+    while (p < end && *p != '\n') {
+      p++;
+    }
+    p = p < end ? p + 1 : end;
+    i++;
+  }
+  t->count = i;
+}
+
+/**
+ * @brief read one sample of /proc/diskstats
+ *
+ * The file is kept open and read with one pread into a buffer that is only
+ * grown if the file does not fit.
+ *
+ * @param t the table
+ * @param now_ns CLOCK_MONOTONIC of the sample in nanoseconds
+ */
+void ReadDiskTable(struct disk_table *t, long long now_ns) {
+  ssize_t len;
+  while ((len = pread(t->fd, t->buf, t->size, 0)) == (ssize_t)t->size) {
+    // more devices than the buffer holds, grow it and read again
+    t->size *= 2;
+    t->buf = realloc(t->buf, t->size);
+    if (t->buf == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  if (len < 0) {
+    perror("pread");
+    exit(1);
+  }
+  ParseDiskStats(t, t->buf, len);
+  t->elapsed_ns = t->last_ns != 0 ? now_ns - t->last_ns : 0;
+  t->last_ns = now_ns;
+}
+
+/**
+ * @brief Displaying the I/O of every device since the previous sample
+ *
+ *    r/s and w/s are the I/O operations per second, rkB/s and wkB/s the
+ *    throughput, await the average time an operation took and util the share
+ *    of the time the device was busy.
+ *
+ * @param out where to print
+ * @param t the table, sampled at least twice
+ */
+void PrintDisks(FILE *out, const struct disk_table *t) {
+  double secs = t->elapsed_ns * 1e-9;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Disks ###\n");
+  fprintf(out, "%-12s %9s %9s %11s %11s %9s %7s\n", "device", "r/s", "w/s",
+          "rkB/s", "wkB/s", "await ms", "util %");
+  for (int i = 0; i < t->count; i++) {
+    const struct disk_dev *d = &t->devs[i];
+    if ((t->skip_partitions && d->partition) || (t->skip_loop && d->loop)) {
+      continue;
+    }
+    unsigned long long diff[DISK_COUNTERS];
+    for (int k = 0; k < DISK_COUNTERS; k++) {
+      diff[k] = d->cur[k] - d->pre[k];
+    }
+    unsigned long long ios = diff[DISK_READS] + diff[DISK_WRITES];
+    double await = ios > 0 ? (double)(diff[DISK_READ_MS] + diff[DISK_WRITE_MS]) /
+                                 ios
+                           : 0;
+    double util = secs > 0 ? diff[DISK_IO_MS] / (secs * 10) : 0;
+    if (util > 100) {
+      util = 100;
+    }
+    fprintf(out, "%-12s %9.1f %9.1f %11.1f %11.1f %9.2f %7.1f\n", d->name,
+            secs > 0 ? diff[DISK_READS] / secs : 0,
+            secs > 0 ? diff[DISK_WRITES] / secs : 0,
+            secs > 0 ? diff[DISK_READ_SECT] / 2.0 / secs : 0,
+            secs > 0 ? diff[DISK_WRITE_SECT] / 2.0 / secs : 0, await, util);
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef DISK_STATS_H
+#define DISK_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// the counters of /proc/diskstats that are kept, in the order of the file
+#define DISK_READS 0      // reads completed
+#define DISK_READ_SECT 1  // sectors read
+#define DISK_READ_MS 2    // milliseconds spent reading
+#define DISK_WRITES 3     // writes completed
+#define DISK_WRITE_SECT 4 // sectors written
+#define DISK_WRITE_MS 5   // milliseconds spent writing
+#define DISK_IO_MS 6      // milliseconds spent doing I/O
+#define DISK_COUNTERS 7
+
+/**
+ * @brief one block device as remembered between samples
+ */
+struct disk_dev {
+  unsigned int major;
+  unsigned int minor;
+  char name[32];
+  int partition;                               // 1 if a partition of a disk
+  int loop;                                    // 1 if a loop or ram device
+  unsigned long long cur[DISK_COUNTERS];       // counters of the last sample
+  unsigned long long pre[DISK_COUNTERS];       // counters of the one before
+};
+
+/**
+ * @brief all block devices of /proc/diskstats
+ *
+ * devs is kept in the order of the file, so a device is normally found at
+ * the same index as in the previous sample. It only grows when more devices
+ * exist than ever before, so sampling does not allocate in steady state.
+ */
+struct disk_table {
+  int fd;                  // open /proc/diskstats
+  char *buf;               // buffer the file is read into
+  size_t size;             // size of buf
+  struct disk_dev *devs;   // devices in the order of the file
+  int count;               // number of devices in the file
+  int cap;                 // number of devices allocated in devs
+  long long last_ns;       // CLOCK_MONOTONIC of the last sample
+  long long elapsed_ns;    // time between the last two samples
+  int skip_partitions;     // if 1, then partitions are not shown
+  int skip_loop;           // if 1, then loop and ram devices are not shown
+};
+
+void InitDiskTable(struct disk_table *t);
+void ParseDiskStats(struct disk_table *t, const char *buf, size_t len);
+void ReadDiskTable(struct disk_table *t, long long now_ns);
+void PrintDisks(FILE *out, const struct disk_table *t);
+
+#endif
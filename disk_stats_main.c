@@ -0,0 +1,79 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "disk_stats.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for getting disk I/O info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines like the other collectors. Every sample shows the I/O
+ * of each block device since the previous one. --no-partitions leaves out
+ * partitions and --no-loop leaves out loop and ram devices. With --root=DIR,
+ * DIR/proc/diskstats is read instead.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  struct ticker ticker;
+  int skip_partitions = 0;
+  int skip_loop = 0;
+  struct disk_table table;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (ParseEpoch(argv[i], &start, &real)) {
+      continue;
+    } else if (ParseRoot(argv[i])) {
+      continue;
+    } else if (strcmp(argv[i], "--no-partitions") == 0) {
+      skip_partitions = 1;
+    } else if (strcmp(argv[i], "--no-loop") == 0) {
+      skip_loop = 1;
+    }
+  }
+
+  InitDiskTable(&table);
+  table.skip_partitions = skip_partitions;
+  table.skip_loop = skip_loop;
+
+  // read the counters the first period is compared with
+  InitTicker(&ticker, period, start, real);
+  ReadDiskTable(&table, MonotonicNow());
+
+  for (int i = 0; i < sample_size; i++) {
+    WaitTick(&ticker);
+    ReadDiskTable(&table, MonotonicNow());
+    PrintDisks(stdout, &table);
+    fflush(stdout);
+  }
+  if (ticker.missed > 0) {
+    fprintf(stderr, "disk_stats: missed %lld deadlines\n", ticker.missed);
+  }
+}
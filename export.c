@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "export.h"
+
+// name of each collector in the records
+static const char *record_sources[SOURCE_NUM] = {"memory", "user", "cpu"};
+
+/**
+ * @brief parse the --format=jsonl|csv argument
+ *
+ * @param arg command line argument
+ * @param format where to store FORMAT_JSONL or FORMAT_CSV
+ * @return 1 if arg was a valid --format, 0 otherwise
+ */
+int ParseFormat(const char *arg, int *format) {
+  if (strcmp(arg, "--format=jsonl") == 0) {
+    *format = FORMAT_JSONL;
+  } else if (strcmp(arg, "--format=csv") == 0) {
+    *format = FORMAT_CSV;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief print a string as a JSON string
+ *
+ * @param out where to print
+ * @param str the string
+ */
+static void PrintJsonString(FILE *out, const char *str) {
+  fputc('"', out);
+  for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', out);
+      fputc(*c, out);
+    } else if (*c < ' ') {
+      fprintf(out, "\\u%04x", *c);
+    } else {
+      fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/**
+ * @brief print a sample as one JSON object on one line
+ *
+ * @param out where to print
+ * @param s latest samples
+ * @param source which collector the sample came from
+ * @param seq iteration the sample belongs to
+ */
+static void PrintJsonRecord(FILE *out, const struct samples *s, int source,
+                            int seq) {
+  fprintf(out,
+          "{\"time\":%lld.%09lld,\"seq\":%d,\"collector\":\"%s\","
+          "\"missed\":%lld,\"interval\":%.6f",
+          s->timestamp[source] / 1000000000, s->timestamp[source] % 1000000000,
+          seq, record_sources[source], s->missed[source],
+          s->interval[source] * 1e-9);
+  if (source == SOURCE_MEM) {
+    fprintf(out,
+            ",\"phys_used\":%ld,\"phys_total\":%ld,\"virtual_used\":%ld,"
+            "\"virtual_total\":%ld",
+            s->mem.phys_used, s->mem.total_phys, s->mem.virtual_used,
+            s->mem.total_virtual);
+  } else if (source == SOURCE_CPU) {
+    fprintf(out,
+            ",\"usage\":%.2f,\"user\":%.2f,\"system\":%.2f,\"iowait\":%.2f,"
+            "\"steal\":%.2f",
+            s->cpu.usage, s->cpu.user, s->cpu.system, s->cpu.iowait,
+            s->cpu.steal);
+    if (s->core_state == 1) {
+      fprintf(out, ",\"cores\":[");
+      for (int i = 0; i < s->cpu.core_count; i++) {
+        if (i > 0) {
+          fputc(',', out);
+        }
+        if (s->cpu.cores[i] < 0) {
+          fprintf(out, "null"); // offline, the others keep their id
+        } else {
+          fprintf(out, "%.2f", s->cpu.cores[i]);
+        }
+      }
+      fputc(']', out);
+    }
+  } else {
+    fprintf(out, ",\"users\":%d,\"sessions\":[", s->users.count);
+    for (int i = 0; i < s->users.count; i++) {
+      const struct session *u = &s->users.sessions[i];
+      fprintf(out, i > 0 ? ",{\"name\":" : "{\"name\":");
+      PrintJsonString(out, u->name);
+      fprintf(out, ",\"line\":");
+      PrintJsonString(out, u->line);
+      fprintf(out, ",\"host\":");
+      PrintJsonString(out, u->host);
+      fputc('}', out);
+    }
+    fputc(']', out);
+  }
+  fputs("}\n", out);
+}
+
+/**
+ * @brief print the sessions as one quoted CSV field
+ *
+ * Each session is "name line host", sessions are separated by ';'.
+ *
+ * @param out where to print
+ * @param list the sessions
+ */
+static void PrintCsvSessions(FILE *out, const struct user_list *list) {
+  fputc('"', out);
+  for (int i = 0; i < list->count; i++) {
+    const struct session *u = &list->sessions[i];
+    char text[sizeof(u->name) + sizeof(u->line) + sizeof(u->host) + 3];
+    snprintf(text, sizeof(text), i > 0 ? ";%s %s %s" : "%s %s %s", u->name,
+             u->line, u->host);
+    for (const char *c = text; *c != '\0'; c++) {
+      if (*c == '"') {
+        fputc('"', out); // quotes are doubled inside a quoted field
+      }
+      fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/**
+ * @brief print a sample as one CSV row
+ *
+ * Every collector uses the same columns, the ones of the other collectors are
+ * left empty.
+ *
+ * @param out where to print
+ * @param s latest samples
+ * @param source which collector the sample came from
+ * @param seq iteration the sample belongs to
+ */
+static void PrintCsvRecord(FILE *out, const struct samples *s, int source,
+                           int seq) {
+  fprintf(out, "%lld.%09lld,%d,%s,%lld,%.6f,",
+          s->timestamp[source] / 1000000000, s->timestamp[source] % 1000000000,
+          seq, record_sources[source], s->missed[source],
+          s->interval[source] * 1e-9);
+  if (source == SOURCE_MEM) {
+    fprintf(out, "%ld,%ld,%ld,%ld,,,,,,,\n", s->mem.phys_used,
+            s->mem.total_phys, s->mem.virtual_used, s->mem.total_virtual);
+  } else if (source == SOURCE_CPU) {
+    fprintf(out, ",,,,%.2f,%.2f,%.2f,%.2f,%.2f,,\n", s->cpu.usage, s->cpu.user,
+            s->cpu.system, s->cpu.iowait, s->cpu.steal);
+  } else {
+    fprintf(out, ",,,,,,,,,%d,", s->users.count);
+    PrintCsvSessions(out, &s->users);
+    fputc('\n', out);
+  }
+}
+
+/**
+ * @brief print what comes before the first record
+ *
+ * @param out where to print
+ * @param format FORMAT_JSONL or FORMAT_CSV
+ */
+void PrintRecordHeader(FILE *out, int format) {
+  if (format == FORMAT_CSV) {
+    fprintf(out, "time,seq,collector,missed,interval,phys_used,phys_total,"
+                 "virtual_used,virtual_total,cpu_usage,cpu_user,cpu_system,"
+                 "cpu_iowait,cpu_steal,users,sessions\n");
+  }
+}
+
+/**
+ * @brief print one sample of a collector as one timestamped record
+ *
+ * Sizes are in bytes, utilization in percent and the time in seconds since
+ * the epoch of the tick the sample was taken on. The interval is the time in
+ * seconds since the sample before, which an adaptive collector varies.
+ *
+ * @param out where to print
+ * @param format FORMAT_JSONL or FORMAT_CSV
+ * @param s latest samples
+ * @param source which collector the sample came from
+ * @param seq iteration the sample belongs to
+ */
+void PrintRecord(FILE *out, int format, const struct samples *s, int source,
+                 int seq) {
+  if (format == FORMAT_JSONL) {
+    PrintJsonRecord(out, s, source, seq);
+  } else {
+    PrintCsvRecord(out, s, source, seq);
+  }
+}
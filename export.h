@@ -0,0 +1,18 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+
+#include "render.h"
+
+// output formats of sys_monitoring_tool besides the screen
+#define FORMAT_SCREEN 0 // refreshing or sequential display
+#define FORMAT_JSONL 1  // one JSON object per line
+#define FORMAT_CSV 2    // one comma separated row per line, after a header
+
+int ParseFormat(const char *arg, int *format);
+void PrintRecordHeader(FILE *out, int format);
+void PrintRecord(FILE *out, int format, const struct samples *s, int source,
+                 int seq);
+
+#endif
@@ -0,0 +1,400 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "frame.h"
+
+/**
+ * @brief fill in the header of the frame of a sample taken on a tick
+ *
+ * @param hdr header to fill in
+ * @param seq iteration the sample belongs to
+ * @param t ticker of the collector, for missed deadlines and the interval
+ * @param tick tick the sample was taken on, for the timestamp
+ */
+void InitFrameHeader(struct frame_header *hdr, uint32_t seq,
+                     const struct ticker *t, long long tick) {
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->seq = seq;
+  hdr->missed = t->missed;
+  hdr->timestamp = TickTime(t, tick);
+  hdr->interval = t->interval;
+}
+
+/**
+ * @brief write one frame with a single writev
+ *
+ * The payload is given in two parts, a fixed size head and a variable sized
+ * body, so arrays do not have to be copied into one buffer first.
+ *
+ * @param fd where to write the frame
+ * @param hdr header of the frame, len must already be set
+ * @param head first part of the payload
+ * @param head_len size of head
+ * @param body second part of the payload, may be NULL
+ * @param body_len size of body
+ */
+void WriteFrame(int fd, const struct frame_header *hdr, const void *head,
+                size_t head_len, const void *body, size_t body_len) {
+  struct iovec iov[3] = {{(void *)hdr, sizeof(*hdr)},
+                         {(void *)head, head_len},
+                         {(void *)body, body_len}};
+  size_t left = sizeof(*hdr) + head_len + body_len;
+  int iovcnt = body_len > 0 ? 3 : 2;
+  struct iovec *v = iov;
+  while (left > 0) {
+    ssize_t n = writev(fd, v, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("writev");
+      exit(1);
+    }
+    left -= n;
+    // skip what was written, only happens for frames larger than the pipe
+    while (iovcnt > 0 && (size_t)n >= v->iov_len) {
+      n -= v->iov_len;
+      v++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      v->iov_base = (char *)v->iov_base + n;
+      v->iov_len -= n;
+    }
+  }
+}
+
+/**
+ * @brief pack a memory sample as the payload of a FRAME_MEM frame
+ *
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param usage the sample
+ * @param p where to store the payload
+ */
+void PackMemFrame(struct frame_header *hdr, const struct mem_usage *usage,
+                  struct frame_parts *p) {
+  struct mem_frame f = {usage->phys_used, usage->total_phys,
+                        usage->virtual_used, usage->total_virtual,
+                        usage->info};
+  p->head.mem = f;
+  p->head_len = sizeof(f);
+  p->body = NULL;
+  p->body_len = 0;
+  hdr->type = FRAME_MEM;
+  hdr->len = p->head_len;
+}
+
+/**
+ * @brief pack a cpu sample as the payload of a FRAME_CPU frame
+ *
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param usage the sample, must outlive p
+ * @param p where to store the payload
+ */
+void PackCpuFrame(struct frame_header *hdr, const struct cpu_usage *usage,
+                  struct frame_parts *p) {
+  struct cpu_frame f = {usage->core_count, 0,           usage->usage,
+                        usage->user,       usage->system, usage->iowait,
+                        usage->steal};
+  p->head.cpu = f;
+  p->head_len = sizeof(f);
+  p->body = usage->cores;
+  p->body_len = usage->core_count * sizeof(double);
+  hdr->type = FRAME_CPU;
+  hdr->len = p->head_len + p->body_len;
+}
+
+/**
+ * @brief pack a user sample as the payload of a FRAME_USER frame
+ *
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param list the sample, must outlive p
+ * @param p where to store the payload
+ */
+void PackUserFrame(struct frame_header *hdr, const struct user_list *list,
+                   struct frame_parts *p) {
+  struct user_frame f = {list->count, 0};
+  p->head.user = f;
+  p->head_len = sizeof(f);
+  p->body = list->sessions;
+  p->body_len = list->count * sizeof(struct session);
+  hdr->type = FRAME_USER;
+  hdr->len = p->head_len + p->body_len;
+}
+
+/**
+ * @brief write a memory sample as a FRAME_MEM frame
+ *
+ * @param fd where to write the frame
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param usage the sample
+ */
+void WriteMemFrame(int fd, struct frame_header *hdr,
+                   const struct mem_usage *usage) {
+  struct frame_parts p;
+  PackMemFrame(hdr, usage, &p);
+  WriteFrame(fd, hdr, &p.head, p.head_len, p.body, p.body_len);
+}
+
+/**
+ * @brief write a cpu sample as a FRAME_CPU frame
+ *
+ * @param fd where to write the frame
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param usage the sample
+ */
+void WriteCpuFrame(int fd, struct frame_header *hdr,
+                   const struct cpu_usage *usage) {
+  struct frame_parts p;
+  PackCpuFrame(hdr, usage, &p);
+  WriteFrame(fd, hdr, &p.head, p.head_len, p.body, p.body_len);
+}
+
+/**
+ * @brief write a user sample as a FRAME_USER frame
+ *
+ * @param fd where to write the frame
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param list the sample
+ */
+void WriteUserFrame(int fd, struct frame_header *hdr,
+                    const struct user_list *list) {
+  struct frame_parts p;
+  PackUserFrame(hdr, list, &p);
+  WriteFrame(fd, hdr, &p.head, p.head_len, p.body, p.body_len);
+}
+
+/**
+ * @brief write the profile of a collector as a FRAME_STATS frame
+ *
+ * @param fd where to write the frame
+ * @param hdr header with seq, missed and timestamp set, len and type are
+ * filled in
+ * @param part which collector, PROFILE_*
+ */
+void WriteStatsFrame(int fd, struct frame_header *hdr, int part) {
+  struct stats_frame f;
+  memset(&f, 0, sizeof(f));
+  f.part = part;
+  f.profile = *GetProfile(part);
+  hdr->type = FRAME_STATS;
+  hdr->len = sizeof(f);
+  WriteFrame(fd, hdr, &f, sizeof(f), NULL, 0);
+}
+
+/**
+ * @brief initialize a frame reader for the given fd
+ *
+ * @param r reader to initialize
+ * @param fd where frames are read from
+ */
+void InitFrameReader(struct frame_reader *r, int fd) {
+  r->fd = fd;
+  r->size = 4096;
+  r->len = 0;
+  r->used = 0;
+  r->buf = malloc(r->size);
+  if (r->buf == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+}
+
+/**
+ * @brief return the next whole frame already in the buffer, without reading
+ *
+ * The returned payload stays valid until the next call on the reader.
+ *
+ * @param r the reader
+ * @param hdr where to store the header
+ * @param payload where to store a pointer to the payload
+ * @return 1 if a frame was returned, 0 if more bytes are needed
+ */
+int NextFrame(struct frame_reader *r, struct frame_header *hdr,
+              const char **payload) {
+  // drop the frame returned by the previous call
+  memmove(r->buf, r->buf + r->used, r->len - r->used);
+  r->len -= r->used;
+  r->used = 0;
+  if (r->len < sizeof(*hdr)) {
+    return 0;
+  }
+  memcpy(hdr, r->buf, sizeof(*hdr));
+  size_t need = sizeof(*hdr) + hdr->len;
+  if (r->len < need) {
+    if (need > r->size) {
+      r->size = need;
+      r->buf = realloc(r->buf, r->size);
+      if (r->buf == NULL) {
+        perror("realloc");
+        exit(1);
+      }
+    }
+    return 0;
+  }
+  *payload = r->buf + sizeof(*hdr);
+  r->used = need;
+  return 1;
+}
+
+/**
+ * @brief read as many bytes as available with one read()
+ *
+ * @param r the reader
+ * @return number of bytes read, 0 at end of file
+ */
+size_t FillFrameReader(struct frame_reader *r) {
+  while (1) {
+    ssize_t n = read(r->fd, r->buf + r->len, r->size - r->len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("read");
+      exit(1);
+    }
+    r->len += n;
+    return n;
+  }
+}
+
+/**
+ * @brief read the next whole frame, blocking until it arrived
+ *
+ * A frame usually arrives with a single read(). The returned payload stays
+ * valid until the next call on the reader.
+ *
+ * @param r the reader
+ * @param hdr where to store the header
+ * @param payload where to store a pointer to the payload
+ * @return 1 if a frame was read, 0 at end of file
+ */
+int ReadFrame(struct frame_reader *r, struct frame_header *hdr,
+              const char **payload) {
+  while (NextFrame(r, hdr, payload) == 0) {
+    if (FillFrameReader(r) == 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * @brief decode the payload of a FRAME_MEM frame
+ *
+ * @param payload the payload
+ * @param len size of the payload
+ * @param usage where to store the sample
+ * @return 0 on success, -1 if the payload is malformed
+ */
+int DecodeMemFrame(const char *payload, size_t len, struct mem_usage *usage) {
+  struct mem_frame f;
+  if (len != sizeof(f)) {
+    return -1;
+  }
+  memcpy(&f, payload, sizeof(f));
+  usage->phys_used = f.phys_used;
+  usage->total_phys = f.total_phys;
+  usage->virtual_used = f.virtual_used;
+  usage->total_virtual = f.total_virtual;
+  usage->info = f.info;
+  return 0;
+}
+
+/**
+ * @brief decode the payload of a FRAME_CPU frame
+ *
+ * Cores beyond what usage was allocated for are dropped.
+ *
+ * @param payload the payload
+ * @param len size of the payload
+ * @param usage where to store the sample
+ * @return 0 on success, -1 if the payload is malformed
+ */
+int DecodeCpuFrame(const char *payload, size_t len, struct cpu_usage *usage) {
+  struct cpu_frame f;
+  if (len < sizeof(f)) {
+    return -1;
+  }
+  memcpy(&f, payload, sizeof(f));
+  if (len != sizeof(f) + f.core_count * sizeof(double)) {
+    return -1;
+  }
+  usage->usage = f.usage;
+  usage->user = f.user;
+  usage->system = f.system;
+  usage->iowait = f.iowait;
+  usage->steal = f.steal;
+  usage->core_count =
+      (int)f.core_count < usage->core_num ? (int)f.core_count : usage->core_num;
+  memcpy(usage->cores, payload + sizeof(f),
+         usage->core_count * sizeof(double));
+  return 0;
+}
+
+/**
+ * @brief decode the payload of a FRAME_USER frame
+ *
+ * @param payload the payload
+ * @param len size of the payload
+ * @param list where to store the sample, grown if needed
+ * @return 0 on success, -1 if the payload is malformed
+ */
+int DecodeUserFrame(const char *payload, size_t len, struct user_list *list) {
+  struct user_frame f;
+  if (len < sizeof(f)) {
+    return -1;
+  }
+  memcpy(&f, payload, sizeof(f));
+  if (len != sizeof(f) + f.count * sizeof(struct session)) {
+    return -1;
+  }
+  if ((int)f.count > list->size) {
+    list->size = f.count;
+    list->sessions = realloc(list->sessions, f.count * sizeof(struct session));
+    if (list->sessions == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  memcpy(list->sessions, payload + sizeof(f), f.count * sizeof(struct session));
+  list->count = f.count;
+  // never trust the strings to be terminated
+  for (int i = 0; i < list->count; i++) {
+    list->sessions[i].name[UT_NAMESIZE] = '\0';
+    list->sessions[i].line[UT_LINESIZE] = '\0';
+    list->sessions[i].host[UT_HOSTSIZE] = '\0';
+  }
+  return 0;
+}
+
+/**
+ * @brief decode the payload of a FRAME_STATS frame and add it to the profile
+ * of the collector that sent it
+ *
+ * @param payload the payload
+ * @param len size of the payload
+ * @return 0 on success, -1 if the payload is malformed
+ */
+int DecodeStatsFrame(const char *payload, size_t len) {
+  struct stats_frame f;
+  if (len != sizeof(f)) {
+    return -1;
+  }
+  memcpy(&f, payload, sizeof(f));
+  if (f.part >= PROFILE_MONITOR) {
+    return -1;
+  }
+  MergeProfile(f.part, &f.profile);
+  return 0;
+}
@@ -0,0 +1,151 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu_stats.h"
+#include "memory_stats.h"
+#include "profile.h"
+#include "sched.h"
+#include "user_stats.h"
+
+// type tag of each frame
+#define FRAME_MEM 1
+#define FRAME_USER 2
+#define FRAME_CPU 3
+#define FRAME_STATS 4 // profile of a collector, sent after its last sample
+#define FRAME_HELLO 5 // first frame of an agent, naming the node it runs on
+
+/**
+ * @brief header in front of every frame sent by a collector
+ *
+ * A frame is the header followed by len bytes of payload. All fields have a
+ * fixed width; both ends run on the same machine, so host byte order is used.
+ */
+struct frame_header {
+  uint32_t len;       // number of payload bytes after the header
+  uint16_t type;      // one of the FRAME_ types above
+  uint16_t flags;     // reserved, always 0
+  uint32_t seq;       // iteration the sample belongs to, starting at 0
+  uint32_t missed;    // deadlines the collector missed so far
+  uint64_t timestamp; // CLOCK_REALTIME in nanoseconds of the tick sampled
+  uint64_t interval;  // nanoseconds since the sample before, for rates
+};
+
+/**
+ * @brief payload of a FRAME_MEM frame, sizes in bytes except struct meminfo
+ */
+struct mem_frame {
+  int64_t phys_used;
+  int64_t total_phys;
+  int64_t virtual_used;
+  int64_t total_virtual;
+  struct meminfo info; // fifteen 64 bit counters
+};
+
+/**
+ * @brief payload of a FRAME_CPU frame, followed by core_count doubles
+ */
+struct cpu_frame {
+  uint32_t core_count;
+  uint32_t reserved;
+  double usage;
+  double user;
+  double system;
+  double iowait;
+  double steal;
+};
+
+/**
+ * @brief payload of a FRAME_USER frame, followed by count struct session
+ */
+struct user_frame {
+  uint32_t count;
+  uint32_t reserved;
+};
+
+/**
+ * @brief payload of a FRAME_STATS frame
+ */
+struct stats_frame {
+  uint32_t part; // PROFILE_MEM, PROFILE_USER or PROFILE_CPU
+  uint32_t reserved;
+  struct profile profile;
+};
+
+// first bytes of a FRAME_HELLO payload, read the other way round on an
+// agent of the other byte order
+#define HELLO_MAGIC 0x736d7431
+
+/**
+ * @brief payload of a FRAME_HELLO frame
+ *
+ * Agents on other machines send the same frames as the child programs, so
+ * they must share the byte order of the aggregator; the magic number lets it
+ * turn away those that do not.
+ */
+struct hello_frame {
+  uint32_t magic; // HELLO_MAGIC
+  uint32_t reserved;
+  char node[64];  // name of the node, terminated
+};
+
+/**
+ * @brief payload of a frame in the two parts written after the header
+ *
+ * head is copied, body points into the sample it was packed from.
+ */
+struct frame_parts {
+  union {
+    struct mem_frame mem;
+    struct cpu_frame cpu;
+    struct user_frame user;
+  } head;
+  size_t head_len;
+  const void *body; // may be NULL
+  size_t body_len;
+};
+
+/**
+ * @brief buffered reader of the frames coming from one collector
+ *
+ * The buffer only grows when a frame larger than any before arrives.
+ */
+struct frame_reader {
+  int fd;
+  char *buf;   // received bytes
+  size_t size; // size of buf
+  size_t len;  // number of bytes in buf
+  size_t used; // bytes of buf already returned as frames
+};
+
+void InitFrameHeader(struct frame_header *hdr, uint32_t seq,
+                     const struct ticker *t, long long tick);
+void WriteFrame(int fd, const struct frame_header *hdr, const void *head,
+                size_t head_len, const void *body, size_t body_len);
+void PackMemFrame(struct frame_header *hdr, const struct mem_usage *usage,
+                  struct frame_parts *p);
+void PackCpuFrame(struct frame_header *hdr, const struct cpu_usage *usage,
+                  struct frame_parts *p);
+void PackUserFrame(struct frame_header *hdr, const struct user_list *list,
+                   struct frame_parts *p);
+void WriteMemFrame(int fd, struct frame_header *hdr,
+                   const struct mem_usage *usage);
+void WriteCpuFrame(int fd, struct frame_header *hdr,
+                   const struct cpu_usage *usage);
+void WriteUserFrame(int fd, struct frame_header *hdr,
+                    const struct user_list *list);
+void WriteStatsFrame(int fd, struct frame_header *hdr, int part);
+void InitFrameReader(struct frame_reader *r, int fd);
+int NextFrame(struct frame_reader *r, struct frame_header *hdr,
+              const char **payload);
+size_t FillFrameReader(struct frame_reader *r);
+int ReadFrame(struct frame_reader *r, struct frame_header *hdr,
+              const char **payload);
+int DecodeMemFrame(const char *payload, size_t len, struct mem_usage *usage);
+int DecodeCpuFrame(const char *payload, size_t len, struct cpu_usage *usage);
+int DecodeUserFrame(const char *payload, size_t len, struct user_list *list);
+int DecodeStatsFrame(const char *payload, size_t len);
+
+#endif
@@ -0,0 +1,339 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hf_stats.h"
+#include "memory_stats.h"
+#include "sched.h"
+
+/**
+ * @brief add a point to the ring, never waiting
+ *
+ * Only called by the sampler thread.
+ *
+ * @param r the ring
+ * @param p the point
+ * @return 0 on success, -1 if the ring was full and the point was dropped
+ */
+int RingPush(struct hf_ring *r, const struct hf_point *p) {
+  unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  if (head - tail > r->mask) {
+    atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+    return -1;
+  }
+  r->points[head & r->mask] = *p;
+  // the point is written before the render thread can see the new head
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+  return 0;
+}
+
+/**
+ * @brief take the oldest point from the ring
+ *
+ * Only called by the render thread.
+ *
+ * @param r the ring
+ * @param p where to store the point
+ * @return 1 if a point was taken, 0 if the ring is empty
+ */
+int RingPop(struct hf_ring *r, struct hf_point *p) {
+  unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+  if (tail == head) {
+    return 0;
+  }
+  *p = r->points[tail & r->mask];
+  // the slot is read before the sampler can see it free
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+/**
+ * @brief take one point of CPU and memory
+ *
+ * /proc/stat counts in clock ticks of usually 10ms, so at high rates a
+ * period holds a single tick or none, and its utilization could only be 0%
+ * or 100%. A point only carries a utilization once HF_MIN_TICKS were counted
+ * over all cores since the last one that did; on large machines that is
+ * every point, on small ones a burst still shows as a run of busy points.
+ *
+ * @param s the sampler
+ * @param p where to store the point
+ */
+static void TakePoint(struct hf_sampler *s, struct hf_point *p) {
+  struct mem_usage mem;
+  double share[CPU_FIELDS];
+  ReadCpuSample(&s->aft);
+  MeasureMemory(&mem);
+  p->time_ns = MonotonicNow();
+  p->mem_used = mem.phys_used;
+  p->mem_total = mem.total_phys;
+  unsigned long long ticks = 0;
+  for (int i = 0; i < CPU_GUEST; i++) {
+    ticks += s->aft.total[i] - s->pre.total[i];
+  }
+  if (ticks < HF_MIN_TICKS) {
+    p->cpu = -1;
+    p->iowait = 0;
+    return;
+  }
+  p->cpu = CpuShare(s->pre.total, s->aft.total, share);
+  p->iowait = share[CPU_IOWAIT];
+  struct cpu_sample tmp = s->pre;
+  s->pre = s->aft;
+  s->aft = tmp;
+}
+
+/**
+ * @brief thread sampling CPU and memory into the ring on absolute deadlines
+ *
+ * @param arg the sampler
+ * @return NULL
+ */
+static void *SamplerThread(void *arg) {
+  struct hf_sampler *s = arg;
+  struct ticker ticker;
+  struct hf_point p;
+  InitTicker(&ticker, s->period, 0, 0);
+  ReadCpuSample(&s->pre); // counters the first point is compared with
+  while (!atomic_load_explicit(&s->stop, memory_order_relaxed)) {
+    WaitTick(&ticker);
+    TakePoint(s, &p);
+    RingPush(&s->ring, &p);
+  }
+  s->missed = ticker.missed;
+  return NULL;
+}
+
+/**
+ * @brief allocate the ring and start the sampler thread
+ *
+ * The ring holds two display intervals of points, so the render thread may
+ * be late by a whole interval before any point is dropped.
+ *
+ * @param s sampler to start
+ * @param rate samples per second, at most HF_MAX_RATE
+ * @param interval_us microseconds between two displays
+ */
+void StartSampler(struct hf_sampler *s, int rate, long long interval_us) {
+  memset(s, 0, sizeof(*s));
+  s->period = 1000000 / rate;
+  long long want = interval_us / s->period * 2;
+  unsigned int size = 64;
+  while (size < want && size < 1u << 24) {
+    size *= 2;
+  }
+  s->ring.points = calloc(size, sizeof(struct hf_point));
+  s->drained = calloc(size, sizeof(struct hf_point));
+  s->scratch = calloc(size, sizeof(double));
+  if (s->ring.points == NULL || s->drained == NULL || s->scratch == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  s->ring.mask = size - 1;
+  atomic_init(&s->ring.head, 0);
+  atomic_init(&s->ring.tail, 0);
+  atomic_init(&s->ring.dropped, 0);
+  atomic_init(&s->stop, 0);
+  InitCpuSample(&s->pre, GetCoreSlots());
+  InitCpuSample(&s->aft, GetCoreSlots());
+
+  // the handlers of the program run on the main thread
+  sigset_t block, old;
+  sigemptyset(&block);
+  sigaddset(&block, SIGINT);
+  sigaddset(&block, SIGTSTP);
+  pthread_sigmask(SIG_BLOCK, &block, &old);
+  int err = pthread_create(&s->thread, NULL, SamplerThread, s);
+  if (err != 0) {
+    fprintf(stderr, "pthread_create: %s\n", strerror(err));
+    exit(1);
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * @brief stop the sampler thread and release the sampler
+ *
+ * @param s the sampler
+ */
+void StopSampler(struct hf_sampler *s) {
+  atomic_store(&s->stop, 1);
+  pthread_join(s->thread, NULL);
+  free(s->ring.points);
+  free(s->drained);
+  free(s->scratch);
+  free(s->pre.cores);
+  free(s->pre.online);
+  free(s->aft.cores);
+  free(s->aft.online);
+}
+
+/**
+ * @brief swap two values
+ *
+ * @param a the first value
+ * @param b the second value
+ */
+static void Swap(double *a, double *b) {
+  double t = *a;
+  *a = *b;
+  *b = t;
+}
+
+/**
+ * @brief find the k-th smallest value, reordering the array
+ *
+ * Quickselect with the median of three as pivot, linear on average.
+ *
+ * @param a the values
+ * @param n number of values
+ * @param k index of the wanted value in sorted order
+ * @return the value
+ */
+static double Select(double *a, int n, int k) {
+  int lo = 0;
+  int hi = n - 1;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    // order a[lo], a[mid], a[hi] so a[mid] is the median of the three
+    if (a[mid] < a[lo]) {
+      Swap(&a[mid], &a[lo]);
+    }
+    if (a[hi] < a[lo]) {
+      Swap(&a[hi], &a[lo]);
+    }
+    if (a[hi] < a[mid]) {
+      Swap(&a[hi], &a[mid]);
+    }
+    double pivot = a[mid];
+    int i = lo;
+    int j = hi;
+    while (i <= j) {
+      while (a[i] < pivot) {
+        i++;
+      }
+      while (a[j] > pivot) {
+        j--;
+      }
+      if (i <= j) {
+        Swap(&a[i], &a[j]);
+        i++;
+        j--;
+      }
+    }
+    if (k <= j) {
+      hi = j;
+    } else if (k >= i) {
+      lo = i;
+    } else {
+      return a[k];
+    }
+  }
+  return a[k];
+}
+
+/**
+ * @brief the 99th percentile by the nearest rank, reordering the array
+ *
+ * @param a the values
+ * @param n number of values, at least one
+ * @return the value
+ */
+static double P99(double *a, int n) {
+  int rank = (int)((99LL * n + 99) / 100); // ceil(0.99 * n)
+  return Select(a, n, rank - 1);
+}
+
+/**
+ * @brief reduce the points taken since the last call to their distribution
+ *
+ * The ring is drained into a buffer allocated at start, so this never
+ * allocates and never holds up the sampler.
+ *
+ * @param s the sampler
+ * @param sum where to store the distribution
+ */
+void ReduceInterval(struct hf_sampler *s, struct hf_summary *sum) {
+  int n = 0;
+  while (n <= (int)s->ring.mask && RingPop(&s->ring, &s->drained[n])) {
+    n++;
+  }
+  memset(sum, 0, sizeof(*sum));
+  sum->count = n;
+  if (n == 0) {
+    return;
+  }
+
+  double cpu_total = 0;
+  double iowait_total = 0;
+  int m = 0;
+  for (int i = 0; i < n; i++) {
+    const struct hf_point *p = &s->drained[i];
+    if (p->cpu < 0) {
+      continue;
+    }
+    if (m == 0 || p->cpu < sum->cpu_min) {
+      sum->cpu_min = p->cpu;
+    }
+    if (m == 0 || p->cpu > sum->cpu_max) {
+      sum->cpu_max = p->cpu;
+    }
+    cpu_total += p->cpu;
+    iowait_total += p->iowait;
+    s->scratch[m++] = p->cpu;
+  }
+  sum->cpu_count = m;
+  if (m > 0) {
+    sum->cpu_mean = cpu_total / m;
+    sum->iowait_mean = iowait_total / m;
+    sum->cpu_p99 = P99(s->scratch, m);
+  }
+
+  double mem_total = 0;
+  sum->mem_min = sum->mem_max = s->drained[0].mem_used;
+  for (int i = 0; i < n; i++) {
+    double used = s->drained[i].mem_used;
+    sum->mem_min = used < sum->mem_min ? used : sum->mem_min;
+    sum->mem_max = used > sum->mem_max ? used : sum->mem_max;
+    mem_total += used;
+    s->scratch[i] = used;
+  }
+  sum->mem_mean = mem_total / n;
+  sum->mem_p99 = P99(s->scratch, n);
+  sum->mem_total = s->drained[n - 1].mem_total;
+}
+
+/**
+ * @brief Displaying the distribution of one display interval
+ *
+ *    With graph_state, the graph of the 99th percentile of CPU is drawn,
+ *    so a burst shorter than the interval still shows up.
+ *
+ * @param out where to print
+ * @param s the sampler
+ * @param sum distribution of the interval
+ * @param graph_state to indicate whether or not to show graphics
+ */
+void PrintSummary(FILE *out, struct hf_sampler *s, const struct hf_summary *sum,
+                  int graph_state) {
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### High frequency ### %d samples every %lld us (%lld "
+               "dropped)\n",
+          sum->count, s->period,
+          (long long)atomic_load_explicit(&s->ring.dropped,
+                                          memory_order_relaxed));
+  fprintf(out, "CPU usage: min %.2f%% mean %.2f%% max %.2f%% p99 %.2f%% "
+               "(iowait %.2f%%)\n",
+          sum->cpu_min, sum->cpu_mean, sum->cpu_max, sum->cpu_p99,
+          sum->iowait_mean);
+  if (graph_state == 1) {
+    CpuGraph(out, sum->cpu_p99);
+  }
+  fprintf(out, "Memory: min %.2f GB mean %.2f GB max %.2f GB p99 %.2f GB "
+               "/ %.2f GB\n",
+          sum->mem_min / 1e9, sum->mem_mean / 1e9, sum->mem_max / 1e9,
+          sum->mem_p99 / 1e9, sum->mem_total / 1e9);
+}
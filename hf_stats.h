@@ -0,0 +1,81 @@
+#ifndef HF_STATS_H
+#define HF_STATS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "cpu_stats.h"
+
+// the highest sampling rate in Hz
+#define HF_MAX_RATE 1000
+// clock ticks of all cores a cpu utilization covers at least, so it is
+// never coarser than 10%
+#define HF_MIN_TICKS 10
+
+/**
+ * @brief one sample taken by the sampler thread
+ */
+struct hf_point {
+  long long time_ns; // CLOCK_MONOTONIC of the sample
+  double cpu;        // utilization since the last point with one, negative
+                     // if fewer than HF_MIN_TICKS were counted since then
+  double iowait;     // share of that time waiting for io
+  long mem_used;     // used physical memory in bytes
+  long mem_total;    // total physical memory in bytes
+};
+
+/**
+ * @brief lock-free single producer, single consumer ring of points
+ *
+ * head is only written by the sampler thread and tail only by the render
+ * thread, each on its own cache line. When the ring is full, the sampler
+ * drops the point and counts it instead of waiting.
+ */
+struct hf_ring {
+  struct hf_point *points;              // size slots, allocated once
+  unsigned int mask;                    // size - 1, size a power of two
+  _Alignas(64) atomic_uint head;        // next slot to write
+  _Alignas(64) atomic_uint tail;        // next slot to read
+  _Alignas(64) atomic_llong dropped;    // points lost to a full ring
+};
+
+/**
+ * @brief one display interval reduced to its distribution
+ */
+struct hf_summary {
+  int count;     // points in the interval
+  int cpu_count; // points with a cpu utilization
+  double cpu_min, cpu_mean, cpu_max, cpu_p99;
+  double iowait_mean;
+  double mem_min, mem_mean, mem_max, mem_p99; // bytes
+  long mem_total;                             // bytes, of the last point
+};
+
+/**
+ * @brief the sampler thread and what it writes to
+ *
+ * Everything is allocated by StartSampler, so the memory used stays the same
+ * however long the sampler runs.
+ */
+struct hf_sampler {
+  struct hf_ring ring;
+  long long period;          // microseconds between samples
+  long long missed;          // deadlines missed, read after StopSampler
+  atomic_int stop;           // set to stop the sampler thread
+  pthread_t thread;
+  struct cpu_sample pre;     // counters of the last point with a tick
+  struct cpu_sample aft;     // counters being read
+  double *scratch;           // the ring size, for computing percentiles
+  struct hf_point *drained;  // the ring size, points of one interval
+};
+
+void StartSampler(struct hf_sampler *s, int rate, long long interval_us);
+void StopSampler(struct hf_sampler *s);
+int RingPush(struct hf_ring *r, const struct hf_point *p);
+int RingPop(struct hf_ring *r, struct hf_point *p);
+void ReduceInterval(struct hf_sampler *s, struct hf_summary *sum);
+void PrintSummary(FILE *out, struct hf_sampler *s, const struct hf_summary *sum,
+                  int graph_state);
+
+#endif
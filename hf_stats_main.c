@@ -0,0 +1,80 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hf_stats.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for sampling cpu and memory at a high rate
+ *
+ * A sampler thread reads /proc/stat and /proc/meminfo --rate=HZ times per
+ * second (1000 in default, at most 1000) into a lock-free ring. Once every
+ * 1 sec, 10 times in default, the points since the last display are reduced
+ * to their minimum, mean, maximum and 99th percentile, so bursts shorter
+ * than --tdelay are not averaged away. --graphics draws the 99th percentile
+ * of CPU. With --root=DIR, the files below DIR are read instead.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  int rate = HF_MAX_RATE;
+  int graphic_state = 0;
+  struct ticker ticker;
+  struct hf_sampler sampler;
+  struct hf_summary summary;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (ParseEpoch(argv[i], &start, &real)) {
+      continue;
+    } else if (ParseRoot(argv[i])) {
+      continue;
+    } else if (sscanf(argv[i], "--rate=%d", &rate) == 1 && rate > 0 &&
+               rate <= HF_MAX_RATE) {
+      continue;
+    } else if (strcmp(argv[i], "--graphics") == 0) {
+      graphic_state = 1;
+    }
+  }
+  if (rate <= 0 || rate > HF_MAX_RATE) {
+    rate = HF_MAX_RATE;
+  }
+
+  StartSampler(&sampler, rate, period);
+  InitTicker(&ticker, period, start, real);
+  for (int i = 0; i < sample_size; i++) {
+    WaitTick(&ticker);
+    ReduceInterval(&sampler, &summary);
+    PrintSummary(stdout, &sampler, &summary, graphic_state);
+    fflush(stdout);
+  }
+  StopSampler(&sampler);
+  if (ticker.missed + sampler.missed > 0) {
+    fprintf(stderr, "hf_stats: missed %lld deadlines\n",
+            ticker.missed + sampler.missed);
+  }
+}
@@ -0,0 +1,192 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "history.h"
+
+/**
+ * @brief copy bytes into the ring, wrapping around its end
+ *
+ * @param h the history
+ * @param pos position to write at, in bytes ever written
+ * @param src what to copy
+ * @param len number of bytes
+ */
+static void RingWrite(struct history *h, uint64_t pos, const void *src,
+                      size_t len) {
+  uint64_t capacity = h->hdr->capacity;
+  size_t off = pos % capacity;
+  size_t first = len < capacity - off ? len : capacity - off;
+  memcpy(h->ring + off, src, first);
+  memcpy(h->ring, (const char *)src + first, len - first);
+}
+
+/**
+ * @brief copy bytes out of the ring, wrapping around its end
+ *
+ * @param h the history
+ * @param pos position to read at, in bytes ever written
+ * @param dst where to copy to
+ * @param len number of bytes
+ */
+static void RingRead(const struct history *h, uint64_t pos, void *dst,
+                     size_t len) {
+  uint64_t capacity = h->hdr->capacity;
+  size_t off = pos % capacity;
+  size_t first = len < capacity - off ? len : capacity - off;
+  memcpy(dst, h->ring + off, first);
+  memcpy((char *)dst + first, h->ring, len - first);
+}
+
+/**
+ * @brief open a history file and map it into memory
+ *
+ * A writable history that does not exist yet is created with a ring of the
+ * given capacity. An existing file keeps the capacity it was created with,
+ * so a new run appends to the history of the previous ones.
+ *
+ * @param h where to store the mapping
+ * @param path the history file
+ * @param capacity size of the ring in bytes, for a new file
+ * @param writable if 1, then samples will be appended
+ * @return 0 on success, -1 if the file is not a history file
+ */
+int OpenHistory(struct history *h, const char *path, uint64_t capacity,
+                int writable) {
+  struct history_header hdr;
+  struct stat st;
+  h->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (h->fd < 0 || fstat(h->fd, &st) < 0) {
+    perror(path);
+    exit(1);
+  }
+  if (st.st_size == 0 && writable) {
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HISTORY_MAGIC, sizeof(hdr.magic));
+    hdr.version = HISTORY_VERSION;
+    hdr.capacity = capacity;
+    if (ftruncate(h->fd, HISTORY_HEADER_SIZE + capacity) < 0 ||
+        pwrite(h->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+      perror(path);
+      exit(1);
+    }
+  } else if (pread(h->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+             memcmp(hdr.magic, HISTORY_MAGIC, sizeof(hdr.magic)) != 0 ||
+             hdr.version != HISTORY_VERSION || hdr.capacity == 0 ||
+             (uint64_t)st.st_size < HISTORY_HEADER_SIZE + hdr.capacity) {
+    fprintf(stderr, "%s is not a history file\n", path);
+    close(h->fd);
+    return -1;
+  }
+  h->map_size = HISTORY_HEADER_SIZE + hdr.capacity;
+  h->hdr = mmap(NULL, h->map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                MAP_SHARED, h->fd, 0);
+  if (h->hdr == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  h->ring = (char *)h->hdr + HISTORY_HEADER_SIZE;
+  return 0;
+}
+
+/**
+ * @brief append one frame to the ring, dropping the oldest frames if needed
+ *
+ * Only the mapping is written, so appending costs no system call; the kernel
+ * writes the dirty pages back to the file. The tail is moved before old
+ * frames are overwritten and the head after the new frame is complete, so a
+ * reader never takes a partly written frame for a whole one.
+ *
+ * @param h the history, opened writable
+ * @param hdr header of the frame
+ * @param p payload of the frame
+ */
+void AppendHistory(struct history *h, const struct frame_header *hdr,
+                   const struct frame_parts *p) {
+  uint64_t capacity = h->hdr->capacity;
+  uint64_t need = sizeof(*hdr) + hdr->len;
+  if (need > capacity) {
+    return; // would never fit
+  }
+  uint64_t head = h->hdr->head;
+  uint64_t tail = h->hdr->tail;
+  while (head + need - tail > capacity) {
+    struct frame_header old;
+    RingRead(h, tail, &old, sizeof(old));
+    tail += sizeof(old) + old.len;
+    if (tail > head) {
+      tail = head; // the ring was damaged, start over
+    }
+  }
+  __atomic_store_n(&h->hdr->tail, tail, __ATOMIC_RELEASE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  RingWrite(h, head, hdr, sizeof(*hdr));
+  RingWrite(h, head + sizeof(*hdr), &p->head, p->head_len);
+  RingWrite(h, head + sizeof(*hdr) + p->head_len, p->body, p->body_len);
+  __atomic_store_n(&h->hdr->head, head + need, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief copy the next frame of the ring, oldest first
+ *
+ * The history may be appended to while it is read; frames overwritten before
+ * they were read are skipped.
+ *
+ * @param h the history
+ * @param pos position of the next frame, 0 to start with the oldest one
+ * @param hdr where to store the header
+ * @param payload buffer the payload is copied into, grown if needed
+ * @param size size of payload
+ * @return 1 if a frame was copied, 0 if there are no more frames
+ */
+int NextHistory(const struct history *h, uint64_t *pos,
+                struct frame_header *hdr, char **payload, size_t *size) {
+  uint64_t capacity = h->hdr->capacity;
+  while (1) {
+    uint64_t tail = __atomic_load_n(&h->hdr->tail, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&h->hdr->head, __ATOMIC_ACQUIRE);
+    if (*pos < tail) {
+      *pos = tail;
+    }
+    if (*pos + sizeof(*hdr) > head) {
+      return 0;
+    }
+    RingRead(h, *pos, hdr, sizeof(*hdr));
+    if (hdr->len > capacity || *pos + sizeof(*hdr) + hdr->len > head) {
+      // overwritten while we looked, or damaged
+      if (__atomic_load_n(&h->hdr->tail, __ATOMIC_ACQUIRE) > *pos) {
+        continue;
+      }
+      return 0;
+    }
+    if (hdr->len > *size) {
+      *size = hdr->len;
+      *payload = realloc(*payload, *size);
+      if (*payload == NULL) {
+        perror("realloc");
+        exit(1);
+      }
+    }
+    RingRead(h, *pos + sizeof(*hdr), *payload, hdr->len);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&h->hdr->tail, __ATOMIC_ACQUIRE) > *pos) {
+      continue; // overwritten while it was copied
+    }
+    *pos += sizeof(*hdr) + hdr->len;
+    return 1;
+  }
+}
+
+/**
+ * @brief unmap and close a history file
+ *
+ * @param h the history
+ */
+void CloseHistory(struct history *h) {
+  munmap(h->hdr, h->map_size);
+  close(h->fd);
+}
@@ -0,0 +1,49 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame.h"
+
+#define HISTORY_MAGIC "SMTHIST1"
+#define HISTORY_VERSION 2 // 1 had frames without the interval
+// the ring starts on the page after the header
+#define HISTORY_HEADER_SIZE 4096
+
+/**
+ * @brief header at the start of a history file
+ *
+ * The rest of the file is a ring of frames, laid out exactly as they are sent
+ * through the pipes. head and tail count bytes ever written, so a frame at
+ * position pos starts at byte pos % capacity of the ring and may wrap around
+ * its end.
+ */
+struct history_header {
+  char magic[8];     // HISTORY_MAGIC
+  uint32_t version;  // HISTORY_VERSION
+  uint32_t reserved;
+  uint64_t capacity; // size of the ring in bytes
+  uint64_t head;     // end of the newest frame, the write cursor
+  uint64_t tail;     // start of the oldest frame still in the ring
+};
+
+/**
+ * @brief a history file mapped into memory
+ */
+struct history {
+  int fd;
+  struct history_header *hdr; // start of the mapping
+  char *ring;                 // frames, right after the header
+  size_t map_size;            // size of the mapping
+};
+
+int OpenHistory(struct history *h, const char *path, uint64_t capacity,
+                int writable);
+void AppendHistory(struct history *h, const struct frame_header *hdr,
+                   const struct frame_parts *p);
+int NextHistory(const struct history *h, uint64_t *pos,
+                struct frame_header *hdr, char **payload, size_t *size);
+void CloseHistory(struct history *h);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame.h"
+#include "history.h"
+
+/**
+ * @brief print the time of a frame in local time, to the millisecond
+ *
+ * @param timestamp CLOCK_REALTIME in nanoseconds
+ */
+void PrintTime(uint64_t timestamp) {
+  time_t secs = timestamp / 1000000000;
+  struct tm tm;
+  char text[32];
+  localtime_r(&secs, &tm);
+  strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+  printf("%s.%03d", text, (int)(timestamp / 1000000 % 1000));
+}
+
+/**
+ * @brief print one recorded sample on a line
+ *
+ * @param hdr header of the frame
+ * @param payload payload of the frame
+ * @param mem where memory samples are decoded into
+ * @param cpu where cpu samples are decoded into
+ * @param users where user samples are decoded into
+ */
+void PrintRecord(const struct frame_header *hdr, const char *payload,
+                 struct mem_usage *mem, struct cpu_usage *cpu,
+                 struct user_list *users) {
+  if (hdr->type == FRAME_MEM && DecodeMemFrame(payload, hdr->len, mem) == 0) {
+    PrintTime(hdr->timestamp);
+    printf(" memory %.2f GB / %.2f GB  -- %.2f GB / %.2f GB\n",
+           mem->phys_used * 1e-9, mem->total_phys * 1e-9,
+           mem->virtual_used * 1e-9, mem->total_virtual * 1e-9);
+  } else if (hdr->type == FRAME_CPU &&
+             DecodeCpuFrame(payload, hdr->len, cpu) == 0) {
+    PrintTime(hdr->timestamp);
+    printf(" cpu %.2f%% user: %.2f%% system: %.2f%% iowait: %.2f%% steal: "
+           "%.2f%%\n",
+           cpu->usage, cpu->user, cpu->system, cpu->iowait, cpu->steal);
+  } else if (hdr->type == FRAME_USER &&
+             DecodeUserFrame(payload, hdr->len, users) == 0) {
+    PrintTime(hdr->timestamp);
+    printf(" users %d", users->count);
+    for (int i = 0; i < users->count; i++) {
+      printf(" %s@%s", users->sessions[i].name, users->sessions[i].line);
+    }
+    printf("\n");
+  }
+}
+
+/**
+ * @brief main function for reading a history file
+ *
+ * Prints the recorded samples, oldest first. --from and --to limit them to a
+ * time range, given in seconds since the epoch or, if negative, in seconds
+ * before the newest sample. --type=memory, --type=user or --type=cpu only
+ * prints the samples of one collector.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+
+int main(int argc, char *argv[]) {
+  const char *path = NULL;
+  double from = 0;
+  double to = 0;
+  int has_from = 0;
+  int has_to = 0;
+  int type = 0; // all types
+  struct history h;
+  struct frame_header hdr;
+  char *payload = NULL;
+  size_t size = 0;
+  uint64_t pos = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--from=%lf", &from) == 1) {
+      has_from = 1;
+    } else if (sscanf(argv[i], "--to=%lf", &to) == 1) {
+      has_to = 1;
+    } else if (strcmp(argv[i], "--type=memory") == 0) {
+      type = FRAME_MEM;
+    } else if (strcmp(argv[i], "--type=user") == 0) {
+      type = FRAME_USER;
+    } else if (strcmp(argv[i], "--type=cpu") == 0) {
+      type = FRAME_CPU;
+    } else if (argv[i][0] != '-' && path == NULL) {
+      path = argv[i];
+    } else {
+      printf("Invalid command line arguments\n");
+      exit(1);
+    }
+  }
+  if (path == NULL) {
+    printf("usage: %s FILE [--from=SECS] [--to=SECS] [--type=memory|user|cpu]\n",
+           argv[0]);
+    exit(1);
+  }
+  if (OpenHistory(&h, path, 0, 0) < 0) {
+    exit(1);
+  }
+
+  // negative times count back from the newest sample
+  if ((has_from && from < 0) || (has_to && to < 0)) {
+    uint64_t newest = 0;
+    while (NextHistory(&h, &pos, &hdr, &payload, &size)) {
+      newest = hdr.timestamp > newest ? hdr.timestamp : newest;
+    }
+    pos = 0;
+    from = has_from && from < 0 ? newest * 1e-9 + from : from;
+    to = has_to && to < 0 ? newest * 1e-9 + to : to;
+  }
+  uint64_t from_ns = has_from ? (uint64_t)(from * 1e9) : 0;
+  uint64_t to_ns = has_to ? (uint64_t)(to * 1e9) : UINT64_MAX;
+
+  struct mem_usage mem;
+  struct cpu_usage cpu;
+  struct user_list users;
+  memset(&mem, 0, sizeof(mem));
+  InitCpuUsage(&cpu, GetCoreSlots());
+  memset(&users, 0, sizeof(users)); // grown by DecodeUserFrame
+  while (NextHistory(&h, &pos, &hdr, &payload, &size)) {
+    if (hdr.timestamp < from_ns || hdr.timestamp > to_ns ||
+        (type != 0 && hdr.type != type)) {
+      continue;
+    }
+    PrintRecord(&hdr, payload, &mem, &cpu, &users);
+  }
+  CloseHistory(&h);
+  return 0;
+}
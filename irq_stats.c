@@ -0,0 +1,231 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "irq_stats.h"
+#include "procfs.h"
+
+/**
+ * @brief read the whole of /proc/softirqs into the buffer of the table
+ *
+ * The buffer is grown until the file fits, which only happens on the first
+ * reads.
+ *
+ * @param t the table
+ * @return number of bytes read
+ */
+static size_t ReadSoftirqFile(struct softirq_table *t) {
+  while (1) {
+    ssize_t len = pread(t->fd, t->buf, t->size, 0);
+    if (len < 0) {
+      perror("pread");
+      exit(1);
+    }
+    if ((size_t)len < t->size) {
+      return len;
+    }
+    t->size *= 2;
+    t->buf = realloc(t->buf, t->size);
+    if (t->buf == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+}
+
+/**
+ * @brief open /proc/softirqs and count its columns and rows
+ *
+ * @param t table to initialize
+ */
+void InitSoftirqs(struct softirq_table *t) {
+  memset(t, 0, sizeof(*t));
+  t->fd = OpenProc("/proc/softirqs", O_RDONLY);
+  if (t->fd < 0) {
+    perror("/proc/softirqs");
+    exit(1);
+  }
+  t->size = 4096;
+  t->buf = malloc(t->size);
+  if (t->buf == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  size_t len = ReadSoftirqFile(t);
+  const char *end = t->buf + len;
+  const char *eol = memchr(t->buf, '\n', len);
+  if (eol == NULL) {
+    eol = end;
+  }
+  // the header names one column per cpu
+  for (const char *p = t->buf; p + 3 <= eol; p++) {
+    if (memcmp(p, "CPU", 3) == 0) {
+      t->cpu_count++;
+    }
+  }
+  for (const char *p = eol; p < end; p++) {
+    t->type_count += *p == '\n' && p + 1 < end;
+  }
+  if (t->type_count > SOFTIRQ_TYPES) {
+    t->type_count = SOFTIRQ_TYPES;
+  }
+  size_t cells = t->type_count * t->cpu_count;
+  t->cur = calloc(cells > 0 ? cells : 1, sizeof(unsigned long long));
+  t->pre = calloc(cells > 0 ? cells : 1, sizeof(unsigned long long));
+  if (t->cur == NULL || t->pre == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  ParseSoftirqs(t->buf, len, t);
+  memcpy(t->pre, t->cur, cells * sizeof(unsigned long long));
+}
+
+/**
+ * @brief parse /proc/softirqs in one pass
+ *
+ * Every row is "NAME: n n n", one number per cpu column. The names are
+ * stored too, so a kernel with other rows is shown as it is.
+ *
+ * @param buf content of /proc/softirqs
+ * @param len number of bytes in buf
+ * @param t where to store the counters, sized by InitSoftirqs
+ * @return number of rows parsed
+ */
+int ParseSoftirqs(const char *buf, size_t len, struct softirq_table *t) {
+  const char *end = buf + len;
+  const char *p = memchr(buf, '\n', len); // skip the header
+  int row = 0;
+  while (p != NULL && ++p < end && row < t->type_count) {
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    const char *colon = memchr(p, ':', end - p);
+    if (colon == NULL) {
+      break;
+    }
+    size_t name_len = colon - p;
+    if (name_len >= sizeof(t->names[row])) {
+      name_len = sizeof(t->names[row]) - 1;
+    }
+    memcpy(t->names[row], p, name_len);
+    t->names[row][name_len] = '\0';
+    p = colon + 1;
+    unsigned long long *counters = t->cur + row * t->cpu_count;
+    for (int c = 0; c < t->cpu_count; c++) {
+      unsigned long long n = 0;
+      while (p < end && *p == ' ') {
+        p++;
+      }
+      while (p < end && *p >= '0' && *p <= '9') {
+        n = n * 10 + (*p - '0');
+        p++;
+      }
+      counters[c] = n;
+    }
+    row++;
+    p = memchr(p, '\n', end - p);
+  }
+  return row;
+}
+
+/**
+ * @brief read one sample of /proc/softirqs
+ *
+ * @param t the table
+ * @param now_ns CLOCK_MONOTONIC of the sample
+ */
+void ReadSoftirqs(struct softirq_table *t, long long now_ns) {
+  unsigned long long *tmp = t->pre;
+  t->pre = t->cur;
+  t->cur = tmp;
+  ParseSoftirqs(t->buf, ReadSoftirqFile(t), t);
+  t->elapsed_ns = t->last_ns != 0 ? now_ns - t->last_ns : 0;
+  t->last_ns = now_ns;
+}
+
+/**
+ * @brief the rate of a counter, 0 if it went backwards
+ *
+ * @param pre the counter at the start of the period
+ * @param aft the counter at the end of the period
+ * @param secs length of the period
+ * @return the rate per second
+ */
+static double Rate(unsigned long long pre, unsigned long long aft,
+                   double secs) {
+  return secs > 0 && aft > pre ? (aft - pre) / secs : 0;
+}
+
+/**
+ * @brief print the softirqs per second of some cpus, summed
+ *
+ * @param out where to print
+ * @param t the softirqs
+ * @param label first column of the row
+ * @param first first cpu
+ * @param last one past the last cpu
+ * @param secs length of the period
+ */
+static void PrintSoftirqRow(FILE *out, const struct softirq_table *t,
+                            const char *label, int first, int last,
+                            double secs) {
+  fprintf(out, "%-6s", label);
+  for (int r = 0; r < t->type_count; r++) {
+    double rate = 0;
+    for (int c = first; c < last; c++) {
+      size_t cell = r * t->cpu_count + c;
+      rate += Rate(t->pre[cell], t->cur[cell], secs);
+    }
+    fprintf(out, " %9.0f", rate);
+  }
+  fputc('\n', out);
+}
+
+/**
+ * @brief Displaying the interrupt, softirq and context switch rates
+ *
+ *    The first lines come from the counters of /proc/stat read with the
+ *    cpu lines, with the share of cpu time spent in interrupts. The table
+ *    shows the softirqs of each type per second summed over all cpus, and
+ *    with core_state one row for each cpu below.
+ *
+ * @param out where to print
+ * @param pre /proc/stat at the start of the period, with counters
+ * @param aft /proc/stat at the end of the period, with counters
+ * @param t the softirqs, read at the end of the period
+ * @param core_state if 1, then show the softirqs of each cpu
+ */
+void PrintIrq(FILE *out, const struct cpu_sample *pre,
+              const struct cpu_sample *aft, const struct softirq_table *t,
+              int core_state) {
+  double secs = t->elapsed_ns * 1e-9;
+  const struct stat_counters *a = &pre->counters;
+  const struct stat_counters *b = &aft->counters;
+  double share[CPU_FIELDS];
+  CpuShare(pre->total, aft->total, share);
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Interrupts ### (per second)\n");
+  fprintf(out,
+          "context switches %.0f  interrupts %.0f  softirqs %.0f  forks %.0f\n",
+          Rate(a->ctxt, b->ctxt, secs), Rate(a->intr, b->intr, secs),
+          Rate(a->softirq, b->softirq, secs),
+          Rate(a->processes, b->processes, secs));
+  fprintf(out, "tasks running %llu  blocked %llu  -- cpu in irq %.2f%%  "
+               "softirq %.2f%%\n",
+          b->procs_running, b->procs_blocked, share[CPU_IRQ],
+          share[CPU_SOFTIRQ]);
+
+  fprintf(out, "%-6s", "cpu");
+  for (int r = 0; r < t->type_count; r++) {
+    fprintf(out, " %9.9s", t->names[r]);
+  }
+  fputc('\n', out);
+  PrintSoftirqRow(out, t, "all", 0, t->cpu_count, secs);
+  for (int c = 0; core_state && c < t->cpu_count; c++) {
+    char label[16];
+    snprintf(label, sizeof(label), "%d", c);
+    PrintSoftirqRow(out, t, label, c, c + 1, secs);
+  }
+}
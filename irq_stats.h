@@ -0,0 +1,37 @@
+#ifndef IRQ_STATS_H
+#define IRQ_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cpu_stats.h"
+
+// most rows of /proc/softirqs kept, the kernel has ten
+#define SOFTIRQ_TYPES 16
+
+/**
+ * @brief the counters of /proc/softirqs, one row per type and column per cpu
+ *
+ * The columns are counted once; cpus coming online later are not picked up.
+ */
+struct softirq_table {
+  int fd;                             // /proc/softirqs, kept open
+  char *buf;                          // where the file is read into
+  size_t size;                        // size of buf
+  int cpu_count;                      // columns of the file
+  int type_count;                     // rows of the file
+  char names[SOFTIRQ_TYPES][16];      // e.g. "NET_RX"
+  unsigned long long *cur;            // type_count * cpu_count, last sample
+  unsigned long long *pre;            // the sample before
+  long long last_ns;                  // CLOCK_MONOTONIC of the last sample
+  long long elapsed_ns;               // time between the last two samples
+};
+
+void InitSoftirqs(struct softirq_table *t);
+int ParseSoftirqs(const char *buf, size_t len, struct softirq_table *t);
+void ReadSoftirqs(struct softirq_table *t, long long now_ns);
+void PrintIrq(FILE *out, const struct cpu_sample *pre,
+              const struct cpu_sample *aft, const struct softirq_table *t,
+              int core_state);
+
+#endif
@@ -0,0 +1,99 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu_stats.h"
+#include "irq_stats.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for getting interrupt and context switch info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines like the other collectors. Every sample shows the cpu
+ * utilization and the context switch, interrupt and softirq rates, which
+ * all come from one read of /proc/stat, and the softirqs of each type from
+ * /proc/softirqs. With --cores, the softirqs of every cpu are shown too,
+ * and with --graphics the cpu utilization is drawn.
+ * With --root=DIR, the files below DIR are read instead.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  struct ticker ticker;
+  int core_state = 0;
+  int graph_state = 0;
+  struct cpu_sample pre;
+  struct cpu_sample aft;
+  struct cpu_usage usage;
+  struct softirq_table softirqs;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (ParseEpoch(argv[i], &start, &real)) {
+      continue;
+    } else if (ParseRoot(argv[i])) {
+      continue;
+    } else if (strcmp(argv[i], "--graphics") == 0) {
+      graph_state = 1;
+    } else if (strcmp(argv[i], "--cores") == 0) {
+      core_state = 1;
+    }
+  }
+
+  InitCpuSample(&pre, GetCoreSlots());
+  InitCpuSample(&aft, GetCoreSlots());
+  InitCpuUsage(&usage, GetCoreSlots());
+  pre.want_counters = 1;
+  aft.want_counters = 1;
+  InitSoftirqs(&softirqs);
+
+  // read the counters the first period is compared with
+  InitTicker(&ticker, period, start, real);
+  ReadCpuSample(&pre);
+  ReadSoftirqs(&softirqs, MonotonicNow());
+
+  for (int i = 0; i < sample_size; i++) {
+    WaitTick(&ticker);
+    ReadCpuSample(&aft);
+    ReadSoftirqs(&softirqs, MonotonicNow());
+    CompareCpu(&pre, &aft, &usage);
+    ShowCore(stdout);
+    PrintCpu(stdout, &usage, 0);
+    if (graph_state) {
+      CpuGraph(stdout, usage.usage);
+    }
+    PrintIrq(stdout, &pre, &aft, &softirqs, core_state);
+    fflush(stdout);
+    struct cpu_sample tmp = pre;
+    pre = aft;
+    aft = tmp;
+  }
+  if (ticker.missed > 0) {
+    fprintf(stderr, "irq_stats: missed %lld deadlines\n", ticker.missed);
+  }
+}
@@ -1,74 +1,194 @@
-#include <signal.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/resource.h>
 #include <unistd.h>
-#include <utmp.h>
+
+#include "memory_stats.h"
+#include "procfs.h"
+#include "profile.h"
 
 /**
- * @brief Displaying memory used by the current program in unit of kilobytes
- *
- * If fail to get memory usage, show error message
+ * @brief print a bar of n copies of a symbol, a chunk at a time
  *
- * @return void
+ * @param out where to print
+ * @param c the symbol
+ * @param n length of the bar
  */
-
-void ShowMemoryUsage() {
-  struct rusage r_usage; // get current program memory usage
-  if (getrusage(RUSAGE_SELF, &r_usage) < 0) {
-    perror("MemoryUsage error"); // if fail, show error message
-  } else {
-    // else print out memory usage in unit of kilobytes
-    printf("Memory usage: %ld kilobytes\n", r_usage.ru_maxrss);
+static void PrintBar(FILE *out, char c, int n) {
+  char chunk[64];
+  memset(chunk, c, sizeof(chunk));
+  while (n > 0) {
+    int len = n < (int)sizeof(chunk) ? n : (int)sizeof(chunk);
+    fwrite(chunk, 1, len, out);
+    n -= len;
   }
 }
 
 /**
  * @brief Displaying memory variation represented by graph
  *
+ * @param out where to print
  * @param pre previous memory size
  * @param post current memory size
  *
  * @return void
  */
 
-void MemroyGraph(double pre, double post) {
+void MemroyGraph(FILE *out, double pre, double post) {
   // caculate difference between previous memory and current memory
   double diff = post - pre;
-  printf("|");   // start symbol for memory graph
-  if (diff >= 0) // if memory increase
+  fputc('|', out); // start symbol for memory graph
+  if (diff >= 0)   // if memory increase
   {
     // if the increase amount is less than 0.01GB or it is the first time
     // reading memory
     if (diff < 0.01 || pre < 0) {
-      printf("o"); // use "o" to indicate
+      fputc('o', out); // use "o" to indicate
     } else {
-      for (int i = 0; i < (int)diff * 10;
-           i++) // if memroy increase mroe than 0.01GB
-      {
-        printf("#"); // use "#" to represent variation propotionally
-      }
-      printf("*"); // symble indicate end of graph
+      // if memroy increase mroe than 0.01GB, use "#" to represent variation
+      // propotionally
+      PrintBar(out, '#', (int)diff * 10);
+      fputc('*', out); // symble indicate end of graph
     }
   } else // else if memroy decrease
   {
     // if the decrease amount is less than 0.01GB
     if (diff >= -0.01) {
-      printf("@"); // use "@" to indicate
+      fputc('@', out); // use "@" to indicate
     } else {
-      for (int i = 0; i < (int)-diff * 10; i++) {
-        printf(":"); // use ":" to represent variation propotionally
-      }
-      printf("@"); // symble indicate end of graph
+      // use ":" to represent variation propotionally
+      PrintBar(out, ':', (int)-diff * 10);
+      fputc('@', out); // symble indicate end of graph
     }
     diff = -diff; // change difference to its absolute value
   }
-  printf(" %.2f (%.2f)\n", diff, post);
+  fprintf(out, " %.2f (%.2f)\n", diff, post);
+}
+
+/**
+ * @brief one wanted key of /proc/meminfo and where its value is stored
+ */
+struct meminfo_key {
+  const char *name;
+  size_t len;
+  size_t offset;
+};
+
+#define MEMINFO_KEY(name, field)                                               \
+  { name, sizeof(name) - 1, offsetof(struct meminfo, field) }
+
+// wanted keys, lengths precomputed so each line costs one compare per key
+static const struct meminfo_key meminfo_keys[] = {
+    MEMINFO_KEY("MemTotal", mem_total),
+    MEMINFO_KEY("MemFree", mem_free),
+    MEMINFO_KEY("MemAvailable", mem_available),
+    MEMINFO_KEY("Buffers", buffers),
+    MEMINFO_KEY("Cached", cached),
+    MEMINFO_KEY("SwapTotal", swap_total),
+    MEMINFO_KEY("SwapFree", swap_free),
+    MEMINFO_KEY("Shmem", shmem),
+    MEMINFO_KEY("Slab", slab),
+    MEMINFO_KEY("SReclaimable", sreclaimable),
+    MEMINFO_KEY("HugePages_Total", hugepages_total),
+    MEMINFO_KEY("HugePages_Free", hugepages_free),
+    MEMINFO_KEY("HugePages_Rsvd", hugepages_rsvd),
+    MEMINFO_KEY("HugePages_Surp", hugepages_surp),
+    MEMINFO_KEY("Hugepagesize", hugepagesize),
+};
+
+#define MEMINFO_KEY_NUM (sizeof(meminfo_keys) / sizeof(meminfo_keys[0]))
+
+static int meminfo_fd = -1;     // /proc/meminfo, kept open between samples
+static char meminfo_buf[8192]; // whole file is read into this buffer
+static size_t meminfo_len = 0;  // bytes of meminfo_buf the last read filled
+
+/**
+ * @brief parse /proc/meminfo content in one linear scan
+ *
+ * Each line is split at its colon and the key is looked up in meminfo_keys,
+ * so lines we do not need are skipped after a length compare.
+ *
+ * @param buf content of /proc/meminfo
+ * @param len number of bytes in buf
+ * @param info where to store the values, keys not found are left as zero
+ */
+void ParseMeminfo(const char *buf, size_t len, struct meminfo *info) {
+  const char *p = buf;
+  const char *end = buf + len;
+  memset(info, 0, sizeof(*info));
+  while (p < end) {
+    const char *colon = memchr(p, ':', end - p);
+    if (colon == NULL) {
+      break;
+    }
+    size_t key_len = colon - p;
+    const char *value = colon + 1;
+    for (size_t k = 0; k < MEMINFO_KEY_NUM; k++) {
+      if (meminfo_keys[k].len == key_len &&
+          memcmp(meminfo_keys[k].name, p, key_len) == 0) {
+        unsigned long long n = 0;
+        while (value < end && *value == ' ') {
+          value++;
+        }
+        while (value < end && *value >= '0' && *value <= '9') {
+          n = n * 10 + (*value - '0');
+          value++;
+        }
+        *(unsigned long long *)((char *)info + meminfo_keys[k].offset) = n;
+        break;
+      }
+    }
+    p = memchr(value, '\n', end - value);
+    if (p == NULL) {
+      break;
+    }
+    p++;
+  }
+}
+
+/**
+ * @brief read /proc/meminfo into the given struct
+ *
+ * The file is opened once and re-read with pread into a fixed buffer, so no
+ * allocation or reopen happens per sample.
+ *
+ * @param info where to store the values
+ */
+void ReadMeminfo(struct meminfo *info) {
+  if (meminfo_fd < 0) {
+    meminfo_fd = OpenProc("/proc/meminfo", O_RDONLY);
+    if (meminfo_fd < 0) {
+      perror("open");
+      exit(1);
+    }
+  }
+  long long start = StageStart();
+  ssize_t len = pread(meminfo_fd, meminfo_buf, sizeof(meminfo_buf), 0);
+  if (len < 0) {
+    perror("pread");
+    exit(1);
+  }
+  StageEnd(PROFILE_MEM, STAGE_READ, start);
+  start = StageStart();
+  meminfo_len = len;
+  ParseMeminfo(meminfo_buf, len, info);
+  StageEnd(PROFILE_MEM, STAGE_PARSE, start);
 }
 
 /**
- * @brief Displaying memory information, in unit of GB, including
+ * @brief the bytes of /proc/meminfo the last ReadMeminfo() parsed
+ *
+ * @param len where to store the number of bytes
+ * @return the bytes, valid until the next read
+ */
+const char *LastMeminfo(size_t *len) {
+  *len = meminfo_len;
+  return meminfo_buf;
+}
+
+/**
+ * @brief Measuring memory information, in unit of bytes, including
  *    total physical memory,
  *    used physical memory,
  *    total virtual memory,
@@ -80,97 +200,76 @@ void MemroyGraph(double pre, double post) {
  * SReclaimable) total virtual memory = totalram + total swap used virtual
  * memory = used physical memory + totalswap - freeswap
  *
+ * @param usage where to store the sample
+ */
+void MeasureMemory(struct mem_usage *usage) {
+  ReadMeminfo(&usage->info);
+  ComputeMemory(usage);
+}
+
+/**
+ * @brief calculate the sizes of a memory sample from its raw values
+ *
+ * @param usage sample with usage->info filled in, where to store the sizes
+ */
+void ComputeMemory(struct mem_usage *usage) {
+  const struct meminfo *info = &usage->info;
+
+  // convert scaned values from kilobytes to unit of byte
+  usage->total_phys = info->mem_total * 1024;
+  usage->phys_used = (info->mem_total - info->mem_free) * 1024 -
+                     (info->buffers + info->cached + info->sreclaimable) * 1024;
+  usage->total_virtual = (info->mem_total + info->swap_total) * 1024;
+  usage->virtual_used =
+      usage->phys_used + (info->swap_total - info->swap_free) * 1024;
+}
+
+/**
+ * @brief Displaying one memory sample in unit of GB
+ *
+ *    If extended_state is set, a second line shows available memory, shared
+ *    memory, slab and huge pages.
+ *
+ * @param out where to print
+ * @param usage sample to display
  * @param pre value of previous used memory size
  * @param graph_state to indicate whether or not to show graphics
- * @return the used physical memory
- *
+ * @param extended_state to indicate whether or not to show extra fields
  */
-double ShowMemory(double pre, int graph_state) {
-  FILE *meminfo = fopen("/proc/meminfo", "r"); // open memory information file
-  char line[200];
-  long totalram, freeram, bufferram, cachedram, totalswap, freeswap, sre;
-  long phys_used, total_phys, virtual_used, total_virtual;
-
-  // scan file to get memory information needed
-  // and convert scaned value to unit of byte
-  while (fgets(line, sizeof(line), meminfo)) {
-    if (sscanf(line, "MemTotal: %ld kB", &totalram) == 1) {
-      totalram *= 1024;
-    } else if (sscanf(line, "MemFree: %ld kB", &freeram) == 1) {
-      freeram *= 1024;
-    } else if (sscanf(line, "Buffers: %ld kB", &bufferram) == 1) {
-      bufferram *= 1024;
-    } else if (sscanf(line, "Cached: %ld kB", &cachedram) == 1) {
-      cachedram *= 1024;
-    } else if (sscanf(line, "SwapTotal: %ld kB", &totalswap) == 1) {
-      totalswap *= 1024;
-    } else if (sscanf(line, "SwapFree: %ld kB", &freeswap) == 1) {
-      freeswap *= 1024;
-    } else if (sscanf(line, "SReclaimable: %ld kB", &sre) == 1) {
-      sre *= 1024;
-      fclose(meminfo);
-    }
-  }
-  total_phys = totalram;
-  phys_used = (totalram - freeram) - (bufferram + cachedram + sre);
-  total_virtual = totalram + totalswap;
-  virtual_used = phys_used + totalswap - freeswap;
-  printf("%.2f GB / %.2f GB  -- %.2f GB / %.2f GB", phys_used * 1e-9,
-         total_phys * 1e-9, virtual_used * 1e-9, total_virtual * 1e-9);
+void PrintMemory(FILE *out, const struct mem_usage *usage, double pre,
+                 int graph_state, int extended_state) {
+  const struct meminfo *info = &usage->info;
+  fprintf(out, "%.2f GB / %.2f GB  -- %.2f GB / %.2f GB",
+          usage->phys_used * 1e-9, usage->total_phys * 1e-9,
+          usage->virtual_used * 1e-9, usage->total_virtual * 1e-9);
   if (graph_state == 0) {
-    printf("\n");
+    fputc('\n', out);
   } else {
-    MemroyGraph(pre * 1e-9, phys_used * 1e-9);
+    MemroyGraph(out, pre * 1e-9, usage->phys_used * 1e-9);
+  }
+  if (extended_state == 1) {
+    fprintf(out,
+            "Avail: %.2f GB  Shmem: %.2f GB  Slab: %.2f GB  HugePages: %llu / "
+            "%llu (%llu kB)\n",
+            info->mem_available * 1024 * 1e-9, info->shmem * 1024 * 1e-9,
+            info->slab * 1024 * 1e-9,
+            info->hugepages_total - info->hugepages_free,
+            info->hugepages_total, info->hugepagesize);
   }
-  return (double)phys_used;
 }
 
 /**
- * @brief main function for getting memory info
+ * @brief Measuring and displaying memory information, in unit of GB
  *
- * Sample once every 1 sec and sample total of 10 times in default
- * Able to take command line argument to print each itertion in graphic,
- * sequential or refreshing form.
+ * @param pre value of previous used memory size
+ * @param graph_state to indicate whether or not to show graphics
+ * @param extended_state to indicate whether or not to show extra fields
+ * @return the used physical memory
  *
- * @param argc
- * @param argv
- * @return int
  */
-int main(int argc, char *argv[]) {
-  const char *special_string =
-      "##SPECIAL_STRING##"; // indicate one iteration has done
-  setbuf(stdout, NULL);     // disable buff
-  int sample_size = 10;
-  int period = 1;
-  int graphic_state = 0;
-  double pre = 0;
-
-  // set the ctrl-c signal and ctrl-z to be ignored
-  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
-      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
-    perror("signal");
-    exit(1);
-  }
-
-  // loop through all command line arguments
-  // set corresponding flag
-  if (argc > 1) {
-    for (int i = 1; i < argc; i++) {
-      if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
-          (sample_size > 0)) {
-        continue;
-      } else if (sscanf(argv[i], "--tdelay=%d", &period) == 1 && (period > 0)) {
-        continue;
-      } else if (strcmp(argv[i], "--graphics") == 0) {
-        graphic_state = 1;
-      }
-    }
-  }
-
-  // print out information in the required format
-  for (int i = 0; i < sample_size; i++) {
-    pre = ShowMemory(pre, graphic_state);
-    printf("%s\n", special_string);
-    sleep(period);
-  }
+double ShowMemory(double pre, int graph_state, int extended_state) {
+  struct mem_usage usage;
+  MeasureMemory(&usage);
+  PrintMemory(stdout, &usage, pre, graph_state, extended_state);
+  return (double)usage.phys_used;
 }
@@ -0,0 +1,52 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief fields read from /proc/meminfo
+ *
+ * All sizes are in kilobytes as printed by the kernel, except the HugePages_
+ * counters which are numbers of pages.
+ */
+struct meminfo {
+  unsigned long long mem_total;
+  unsigned long long mem_free;
+  unsigned long long mem_available;
+  unsigned long long buffers;
+  unsigned long long cached;
+  unsigned long long swap_total;
+  unsigned long long swap_free;
+  unsigned long long shmem;
+  unsigned long long slab;
+  unsigned long long sreclaimable;
+  unsigned long long hugepages_total;
+  unsigned long long hugepages_free;
+  unsigned long long hugepages_rsvd;
+  unsigned long long hugepages_surp;
+  unsigned long long hugepagesize;
+};
+
+/**
+ * @brief one memory sample as shown on screen, sizes in bytes
+ */
+struct mem_usage {
+  long phys_used;
+  long total_phys;
+  long virtual_used;
+  long total_virtual;
+  struct meminfo info; // raw values the sizes were calculated from
+};
+
+void MemroyGraph(FILE *out, double pre, double post);
+void ParseMeminfo(const char *buf, size_t len, struct meminfo *info);
+void ReadMeminfo(struct meminfo *info);
+const char *LastMeminfo(size_t *len);
+void MeasureMemory(struct mem_usage *usage);
+void ComputeMemory(struct mem_usage *usage);
+void PrintMemory(FILE *out, const struct mem_usage *usage, double pre,
+                 int graph_state, int extended_state);
+double ShowMemory(double pre, int graph_state, int extended_state);
+
+#endif
@@ -0,0 +1,121 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "frame.h"
+#include "memory_stats.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for getting memory info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines so the work done per sample does not add up.
+ * --tdelay also takes periods such as 500ms or 250us.
+ * Able to take command line argument to print each itertion in graphic,
+ * sequential or refreshing form.
+ * With --binary, every sample is written as a frame for sys_monitoring_tool
+ * instead.
+ * With --self-stats, the time spent in each stage is shown at the end, or
+ * sent to sys_monitoring_tool after the last frame.
+ * With --root=DIR, the files below DIR are read instead of the system's.
+ * With --adaptive=MIN,MAX, the time between samples grows from MIN up to
+ * MAX while the used memory barely changes, and is MIN again after a fast
+ * change.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  long long max_period = 0; // longest period with --adaptive
+  struct ticker ticker;
+  struct frame_header hdr;
+  int graphic_state = 0;
+  int extended_state = 0;
+  int binary_state = 0;
+  double pre = 0;
+  struct mem_usage usage;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+          (sample_size > 0)) {
+        continue;
+      } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+                 ParsePeriod(argv[i] + 9, &period)) {
+        continue;
+      } else if (ParseEpoch(argv[i], &start, &real)) {
+        continue;
+      } else if (ParseAdaptive(argv[i], &period, &max_period)) {
+        continue;
+      } else if (ParseRoot(argv[i])) {
+        continue;
+      } else if (strcmp(argv[i], "--graphics") == 0) {
+        graphic_state = 1;
+      } else if (strcmp(argv[i], "--extended") == 0) {
+        extended_state = 1;
+      } else if (strcmp(argv[i], "--binary") == 0) {
+        binary_state = 1;
+      } else if (strcmp(argv[i], "--self-stats") == 0) {
+        EnableProfile();
+      }
+    }
+  }
+
+  // print out information in the required format
+  StartProfile(PROFILE_MEM);
+  InitTicker(&ticker, period, start, real);
+  if (max_period > 0) {
+    SetAdaptive(&ticker, max_period);
+  }
+  for (int i = 0; i < sample_size; i++) {
+    long long tick = WaitTick(&ticker);
+    MeasureMemory(&usage);
+    if (i > 0 && usage.total_phys > 0) {
+      // the change in percent of the physical memory
+      AdaptTicker(&ticker, (usage.phys_used - pre) * 100.0 / usage.total_phys);
+    }
+    long long stage = StageStart();
+    if (binary_state == 1) {
+      // sys_monitoring_tool renders the sample itself
+      InitFrameHeader(&hdr, i, &ticker, tick);
+      WriteMemFrame(STDOUT_FILENO, &hdr, &usage);
+      StageEnd(PROFILE_MEM, STAGE_SERIALIZE, stage);
+    } else {
+      PrintMemory(stdout, &usage, pre, graphic_state, extended_state);
+      fflush(stdout); // one write per sample
+      StageEnd(PROFILE_MEM, STAGE_RENDER, stage);
+    }
+    pre = (double)usage.phys_used;
+  }
+  StopProfile(PROFILE_MEM);
+  if (profile_state == 1 && binary_state == 1) {
+    // sent after the last sample, for sys_monitoring_tool --self-stats
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.seq = sample_size;
+    hdr.timestamp = RealtimeNow();
+    WriteStatsFrame(STDOUT_FILENO, &hdr, PROFILE_MEM);
+  } else if (profile_state == 1) {
+    PrintProfile(stdout);
+  }
+  if (ticker.missed > 0) {
+    fprintf(stderr, "memory_stats: missed %lld deadlines\n", ticker.missed);
+  }
+}
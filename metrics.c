@@ -0,0 +1,226 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+
+// names of the metrics in rules and output
+const char *const metric_names[METRIC_NUM] = {
+    "cpu.usage", "cpu.user",      "cpu.system",
+    "cpu.iowait", "cpu.steal",    "mem.used",
+    "mem.virtual", "mem.available", "users"};
+
+// smallest value counted in a bucket of its own
+#define SKETCH_MIN 1e-9
+
+/**
+ * @brief initialize the statistics of every metric
+ *
+ * @param set statistics to initialize
+ */
+void InitMetrics(struct metric_set *set) { memset(set, 0, sizeof(*set)); }
+
+/**
+ * @brief count a value in a sketch
+ *
+ * @param k the sketch
+ * @param v the value, not negative
+ */
+static void SketchAdd(struct sketch *k, double v) {
+  static double log_gamma = 0;
+  if (log_gamma == 0) {
+    log_gamma = log((1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY));
+  }
+  if (v < SKETCH_MIN) {
+    k->zero++;
+    return;
+  }
+  int index = (int)ceil(log(v) / log_gamma);
+  if (!k->used) {
+    k->offset = index - SKETCH_BINS / 2; // room to grow both ways
+    k->used = 1;
+  }
+  int top = SKETCH_BINS - 1; // highest bucket in use
+  while (index < k->offset && top > 0 && k->bins[top] == 0) {
+    top--;
+  }
+  if (index < k->offset && k->offset + top - index < SKETCH_BINS) {
+    // move the buckets up to make room below
+    int shift = k->offset - index;
+    memmove(&k->bins[shift], &k->bins[0], (top + 1) * sizeof(k->bins[0]));
+    memset(&k->bins[0], 0, shift * sizeof(k->bins[0]));
+    k->offset = index;
+  } else if (index >= k->offset + SKETCH_BINS) {
+    // move the buckets down, merging the lowest into one
+    int shift = index - (k->offset + SKETCH_BINS - 1);
+    unsigned long long merged = 0;
+    for (int i = 0; i <= shift && i < SKETCH_BINS; i++) {
+      merged += k->bins[i];
+    }
+    if (shift < SKETCH_BINS) {
+      memmove(&k->bins[1], &k->bins[shift + 1],
+              (SKETCH_BINS - shift - 1) * sizeof(k->bins[0]));
+      memset(&k->bins[SKETCH_BINS - shift], 0, shift * sizeof(k->bins[0]));
+    } else {
+      memset(k->bins, 0, sizeof(k->bins));
+    }
+    k->bins[0] = merged;
+    k->offset += shift;
+  }
+  // below every bucket kept, counted in the lowest
+  int i = index < k->offset ? 0 : index - k->offset;
+  k->bins[i]++;
+}
+
+/**
+ * @brief add a sample of a metric to its statistics
+ *
+ * Everything is updated in place, so the statistics cost the same memory
+ * after a month of samples as after one.
+ *
+ * @param m the metric
+ * @param v the value
+ * @param time_ns CLOCK_REALTIME of the sample
+ */
+void AddValue(struct metric *m, double v, long long time_ns) {
+  if (m->count == 0) {
+    m->ewma = v;
+    m->min = v;
+    m->max = v;
+    m->rate = 0;
+  } else {
+    m->ewma += EWMA_ALPHA * (v - m->ewma);
+    m->min = v < m->min ? v : m->min;
+    m->max = v > m->max ? v : m->max;
+    double secs = (time_ns - m->last_ns) * 1e-9;
+    m->rate = secs > 0 ? (v - m->last) / secs : 0;
+  }
+  m->count++;
+  double delta = v - m->mean;
+  m->mean += delta / m->count;
+  m->m2 += delta * (v - m->mean);
+  m->last = v;
+  m->last_ns = time_ns;
+  SketchAdd(&m->sketch, v);
+}
+
+/**
+ * @brief add the latest sample of a collector to the statistics of its
+ * metrics
+ *
+ * @param set the statistics
+ * @param s latest samples
+ * @param source which collector the sample came from
+ */
+void UpdateMetrics(struct metric_set *set, const struct samples *s,
+                   int source) {
+  long long t = s->timestamp[source];
+  if (source == SOURCE_CPU) {
+    AddValue(&set->m[METRIC_CPU_USAGE], s->cpu.usage, t);
+    AddValue(&set->m[METRIC_CPU_USER], s->cpu.user, t);
+    AddValue(&set->m[METRIC_CPU_SYSTEM], s->cpu.system, t);
+    AddValue(&set->m[METRIC_CPU_IOWAIT], s->cpu.iowait, t);
+    AddValue(&set->m[METRIC_CPU_STEAL], s->cpu.steal, t);
+  } else if (source == SOURCE_MEM) {
+    AddValue(&set->m[METRIC_MEM_USED], s->mem.phys_used, t);
+    AddValue(&set->m[METRIC_MEM_VIRTUAL], s->mem.virtual_used, t);
+    AddValue(&set->m[METRIC_MEM_AVAILABLE], s->mem.info.mem_available * 1024.0,
+             t);
+  } else {
+    AddValue(&set->m[METRIC_USERS], s->users.count, t);
+  }
+}
+
+/**
+ * @brief the collector a metric comes from
+ *
+ * @param metric e.g. METRIC_CPU_USAGE
+ * @return e.g. SOURCE_CPU
+ */
+int MetricSource(int metric) {
+  if (metric <= METRIC_CPU_STEAL) {
+    return SOURCE_CPU;
+  }
+  return metric == METRIC_USERS ? SOURCE_USER : SOURCE_MEM;
+}
+
+/**
+ * @brief look up a metric by name
+ *
+ * @param name the name, e.g. "cpu.usage", not terminated
+ * @param len length of name
+ * @return the metric, -1 if there is none of that name
+ */
+int FindMetric(const char *name, size_t len) {
+  for (int i = 0; i < METRIC_NUM; i++) {
+    if (strlen(metric_names[i]) == len &&
+        memcmp(metric_names[i], name, len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief estimate a quantile of every value of a metric
+ *
+ * @param m the metric, with at least one value
+ * @param q the quantile, e.g. 0.99
+ * @return the estimate, within SKETCH_ACCURACY of a value of that rank
+ */
+double Quantile(const struct metric *m, double q) {
+  const struct sketch *k = &m->sketch;
+  // the nearest rank, counted from 0
+  unsigned long long rank = (unsigned long long)ceil(q * m->count) - 1;
+  if (rank < k->zero) {
+    return 0;
+  }
+  unsigned long long seen = k->zero;
+  double gamma = (1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY);
+  for (int i = 0; i < SKETCH_BINS; i++) {
+    seen += k->bins[i];
+    if (seen > rank) {
+      // the midpoint of (gamma^(index-1), gamma^index]
+      double v = 2 * pow(gamma, k->offset + i) / (gamma + 1);
+      return v < m->min ? m->min : v > m->max ? m->max : v;
+    }
+  }
+  return m->max;
+}
+
+/**
+ * @brief the standard deviation of every value of a metric
+ *
+ * @param m the metric
+ * @return the deviation, 0 before the second value
+ */
+double Stddev(const struct metric *m) {
+  return m->count > 1 ? sqrt(m->m2 / (m->count - 1)) : 0;
+}
+
+/**
+ * @brief Displaying the statistics of the metrics of a collector
+ *
+ *    One row per metric: the latest value, the moving average, the mean and
+ *    standard deviation, and the median, 95th and 99th percentile of every
+ *    sample since the start. Sizes are in GB, utilization in percent.
+ *
+ * @param out where to print
+ * @param set the statistics
+ * @param source which collector to show
+ */
+void PrintMetrics(FILE *out, const struct metric_set *set, int source) {
+  for (int i = 0; i < METRIC_NUM; i++) {
+    const struct metric *m = &set->m[i];
+    if (MetricSource(i) != source || m->count == 0) {
+      continue;
+    }
+    double scale = source == SOURCE_MEM ? 1e-9 : 1;
+    fprintf(out,
+            "%-13s now %.2f  ewma %.2f  mean %.2f +- %.2f  p50 %.2f  "
+            "p95 %.2f  p99 %.2f\n",
+            metric_names[i], m->last * scale, m->ewma * scale,
+            m->mean * scale, Stddev(m) * scale, Quantile(m, 0.5) * scale,
+            Quantile(m, 0.95) * scale, Quantile(m, 0.99) * scale);
+  }
+}
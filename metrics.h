@@ -0,0 +1,77 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+
+#include "render.h"
+
+// buckets of a quantile sketch, the memory of a metric does not grow beyond
+#define SKETCH_BINS 1024
+// relative error of a quantile read from a sketch
+#define SKETCH_ACCURACY 0.01
+// weight of the latest sample in the moving average
+#define EWMA_ALPHA 0.2
+
+// the metrics statistics are kept for
+#define METRIC_CPU_USAGE 0
+#define METRIC_CPU_USER 1
+#define METRIC_CPU_SYSTEM 2
+#define METRIC_CPU_IOWAIT 3
+#define METRIC_CPU_STEAL 4
+#define METRIC_MEM_USED 5
+#define METRIC_MEM_VIRTUAL 6
+#define METRIC_MEM_AVAILABLE 7
+#define METRIC_USERS 8
+#define METRIC_NUM 9
+
+/**
+ * @brief quantile sketch with a bounded relative error (DDSketch)
+ *
+ * A value v is counted in bucket ceil(log(v) / log(gamma)), so every value
+ * of a bucket is within SKETCH_ACCURACY of its midpoint. Only SKETCH_BINS
+ * consecutive buckets are kept; when the values span more, the lowest are
+ * merged, which only makes the lowest quantiles less accurate.
+ */
+struct sketch {
+  int offset;              // index of the bucket in bins[0]
+  int used;                // 1 once offset is set
+  unsigned long long zero; // values too small for any bucket
+  unsigned long long bins[SKETCH_BINS];
+};
+
+/**
+ * @brief statistics of one metric over every sample seen, in fixed memory
+ */
+struct metric {
+  long long count;
+  double last;        // latest value
+  double ewma;        // exponentially weighted moving average
+  double mean;        // running mean and sum of squared deviations, Welford
+  double m2;
+  double min;
+  double max;
+  double rate;        // change per second between the last two samples
+  long long last_ns;  // CLOCK_REALTIME of the latest sample
+  struct sketch sketch;
+};
+
+/**
+ * @brief statistics of every metric of sys_monitoring_tool
+ */
+struct metric_set {
+  struct metric m[METRIC_NUM];
+};
+
+extern const char *const metric_names[METRIC_NUM];
+
+void InitMetrics(struct metric_set *set);
+void AddValue(struct metric *m, double v, long long time_ns);
+void UpdateMetrics(struct metric_set *set, const struct samples *s,
+                   int source);
+int MetricSource(int metric);
+int FindMetric(const char *name, size_t len);
+double Quantile(const struct metric *m, double q);
+double Stddev(const struct metric *m);
+void PrintMetrics(FILE *out, const struct metric_set *set, int source);
+
+#endif
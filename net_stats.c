@@ -0,0 +1,350 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "net_stats.h"
+#include "procfs.h"
+
+// position of each kept counter among the sixteen after the interface name
+static const int net_columns[NET_COUNTERS] = {0, 1, 2, 3, 8, 9, 10, 11};
+
+/**
+ * @brief hash an interface name with FNV-1a
+ *
+ * @param name the name
+ * @param len length of name
+ * @return the hash
+ */
+static unsigned int HashName(const char *name, size_t len) {
+  unsigned int h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return h;
+}
+
+/**
+ * @brief find the slot of an interface in the hash table
+ *
+ * @param t the table
+ * @param name name of the interface
+ * @param len length of name
+ * @param hash hash of name
+ * @return index of the slot holding it, or of the free slot to insert it in
+ */
+static int FindIf(const struct net_table *t, const char *name, size_t len,
+                  unsigned int hash) {
+  int i = hash & (t->slots - 1);
+  while (t->ifs[i].name[0] != '\0' &&
+         (t->ifs[i].hash != hash || strncmp(t->ifs[i].name, name, len) != 0 ||
+          t->ifs[i].name[len] != '\0')) {
+    i = (i + 1) & (t->slots - 1);
+  }
+  return i;
+}
+
+/**
+ * @brief allocate the hash table with the given number of slots and move the
+ * old interfaces into it
+ *
+ * @param t the table
+ * @param slots new number of slots, a power of two
+ */
+static void ResizeNetTable(struct net_table *t, int slots) {
+  struct net_if *old = t->ifs;
+  int old_slots = t->slots;
+  t->ifs = calloc(slots, sizeof(struct net_if));
+  t->order = realloc(t->order, slots * sizeof(int));
+  if (t->ifs == NULL || t->order == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  t->slots = slots;
+  for (int i = 0; i < old_slots; i++) {
+    if (old[i].name[0] != '\0') {
+      int k = FindIf(t, old[i].name, strlen(old[i].name), old[i].hash);
+      t->ifs[k] = old[i];
+      if (old[i].seen == t->generation && old[i].pos < t->order_count) {
+        t->order[old[i].pos] = k;
+      }
+    }
+  }
+  free(old);
+}
+
+/**
+ * @brief remove the interface in the given slot
+ *
+ * Interfaces after it in the same probe sequence are shifted back, so no
+ * tombstones are needed; the order of the file follows them.
+ *
+ * @param t the table
+ * @param i the slot
+ */
+static void RemoveIf(struct net_table *t, int i) {
+  t->ifs[i].name[0] = '\0';
+  t->count--;
+  int j = i;
+  while (1) {
+    j = (j + 1) & (t->slots - 1);
+    if (t->ifs[j].name[0] == '\0') {
+      return;
+    }
+    int home = t->ifs[j].hash & (t->slots - 1);
+    // move j into the hole unless its home lies cyclically in (i, j]
+    if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j)) {
+      continue;
+    }
+    t->ifs[i] = t->ifs[j];
+    t->ifs[j].name[0] = '\0';
+    if (t->ifs[i].seen == t->generation) {
+      t->order[t->ifs[i].pos] = i;
+    }
+    i = j;
+  }
+}
+
+/**
+ * @brief initialize the table of network interfaces
+ *
+ * @param t table to initialize
+ */
+void InitNetTable(struct net_table *t) {
+  memset(t, 0, sizeof(*t));
+  t->fd = OpenProc("/proc/net/dev", O_RDONLY);
+  if (t->fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  t->size = 16384; // about 130 bytes per interface
+  t->buf = malloc(t->size);
+  if (t->buf == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  ResizeNetTable(t, 64);
+}
+
+/**
+ * @brief parse an unsigned decimal number, skipping the spaces before it
+ *
+ * @param p where to start, moved past the number
+ * @param end end of the buffer
+ * @return the number, 0 if there is none
+ */
+static unsigned long long ParseNumber(const char **p, const char *end) {
+  const char *c = *p;
+  unsigned long long n = 0;
+  while (c < end && *c == ' ') {
+    c++;
+  }
+  while (c < end && *c >= '0' && *c <= '9') {
+    n = n * 10 + (*c - '0');
+    c++;
+  }
+  *p = c;
+  return n;
+}
+
+/**
+ * @brief parse the content of /proc/net/dev in a single pass
+ *
+ * The counters of every interface move to pre and the new ones are stored in
+ * cur. Interfaces that are no longer in the file are dropped.
+ *
+ * @param t the table
+ * @param buf content of /proc/net/dev
+ * @param len number of bytes in buf
+ */
+void ParseNetDev(struct net_table *t, const char *buf, size_t len) {
+  const char *p = buf;
+  const char *end = buf + len;
+  t->generation++;
+  t->order_count = 0;
+  for (int skip = 0; skip < 2; skip++) {
+    // two header lines
+    while (p < end && *p != '\n') {
+      p++;
+    }
+    p = p < end ? p + 1 : end;
+  }
+  while (p < end) {
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    const char *name = p;
+    while (p < end && *p != ':' && *p != '\n') {
+      p++;
+    }
+    size_t name_len = p - name;
+    if (p == end || *p != ':' || name_len == 0 ||
+        name_len >= sizeof(t->ifs[0].name)) {
+      while (p < end && *p != '\n') {
+        p++;
+      }
+      p = p < end ? p + 1 : end;
+      continue;
+    }
+    p++; // the ':'
+
+    if ((t->count + 1) * 2 > t->slots) {
+      ResizeNetTable(t, t->slots * 2); // keep the table at most half full
+    }
+    unsigned int hash = HashName(name, name_len);
+    int i = FindIf(t, name, name_len, hash);
+    struct net_if *n = &t->ifs[i];
+    int fresh = n->name[0] == '\0';
+    if (fresh) {
+      memset(n, 0, sizeof(*n));
+      memcpy(n->name, name, name_len);
+      n->hash = hash;
+      n->pre_rate = -1;
+      t->count++;
+    } else if (n->seen == t->generation) {
+      // the same name twice, keep the first
+      while (p < end && *p != '\n') {
+        p++;
+      }
+      p = p < end ? p + 1 : end;
+      continue;
+    } else {
+      memcpy(n->pre, n->cur, sizeof(n->cur));
+    }
+    int field = 0;
+    for (int k = 0; k < NET_COUNTERS; k++) {
+      while (field < net_columns[k]) {
+        ParseNumber(&p, end); // a counter that is not kept
+        field++;
+      }
+      n->cur[k] = ParseNumber(&p, end);
+      field++;
+    }
+    if (fresh) {
+      memcpy(n->pre, n->cur, sizeof(n->cur)); // nothing to compare with yet
+    }
+    n->seen = t->generation;
+    n->pos = t->order_count;
+    t->order[t->order_count++] = i;
+    while (p < end && *p != '\n') {
+      p++;
+    }
+    p = p < end ? p + 1 : end;
+  }
+
+  // drop the interfaces that were not in the file
+  for (int i = 0; t->count > t->order_count && i < t->slots;) {
+    if (t->ifs[i].name[0] != '\0' && t->ifs[i].seen != t->generation) {
+      RemoveIf(t, i); // look at the slot again, another one moved in
+    } else {
+      i++;
+    }
+  }
+}
+
+/**
+ * @brief read one sample of /proc/net/dev
+ *
+ * The file is kept open and read with one pread into a buffer that is only
+ * grown if the file does not fit.
+ *
+ * @param t the table
+ * @param now_ns CLOCK_MONOTONIC of the sample in nanoseconds
+ */
+void ReadNetTable(struct net_table *t, long long now_ns) {
+  ssize_t len;
+  while ((len = pread(t->fd, t->buf, t->size, 0)) == (ssize_t)t->size) {
+    // more interfaces than the buffer holds, grow it and read again
+    t->size *= 2;
+    t->buf = realloc(t->buf, t->size);
+    if (t->buf == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  if (len < 0) {
+    perror("pread");
+    exit(1);
+  }
+  ParseNetDev(t, t->buf, len);
+  t->elapsed_ns = t->last_ns != 0 ? now_ns - t->last_ns : 0;
+  t->last_ns = now_ns;
+}
+
+/**
+ * @brief Displaying throughput variation represented by graph
+ *
+ *    Drawn like the memory graph: "#" for every 0.1 MB/s more than the
+ *    previous sample, ":" for every 0.1 MB/s less.
+ *
+ * @param out where to print
+ * @param pre previous throughput in MB/s, negative if there is none
+ * @param post current throughput in MB/s
+ */
+void NetGraph(FILE *out, double pre, double post) {
+  double diff = pre < 0 ? 0 : post - pre;
+  fputc('|', out);
+  if (diff >= 0) {
+    if (diff < 0.01) {
+      fputc('o', out);
+    } else {
+      for (int i = 0; i < (int)(diff * 10); i++) {
+        fputc('#', out);
+      }
+      fputc('*', out);
+    }
+  } else {
+    if (diff >= -0.01) {
+      fputc('@', out);
+    } else {
+      for (int i = 0; i < (int)(-diff * 10); i++) {
+        fputc(':', out);
+      }
+      fputc('@', out);
+    }
+    diff = -diff;
+  }
+  fprintf(out, " %.2f (%.2f)\n", diff, post);
+}
+
+/**
+ * @brief Displaying the traffic of every interface since the previous sample
+ *
+ *    One row per interface, laid out like the memory rows: received MB/s and
+ *    packets/s -- sent MB/s and packets/s, then the drops and errors
+ *    received/sent. With graph_state, the change of the total throughput is
+ *    drawn after each row.
+ *
+ * @param out where to print
+ * @param t the table, sampled at least twice
+ * @param graph_state to indicate whether or not to show graphics
+ */
+void PrintNet(FILE *out, struct net_table *t, int graph_state) {
+  double secs = t->elapsed_ns * 1e-9;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Network ### (rx MB/s pkt/s -- tx MB/s pkt/s, drop/err "
+               "rx/tx)\n");
+  for (int k = 0; k < t->order_count; k++) {
+    struct net_if *n = &t->ifs[t->order[k]];
+    unsigned long long diff[NET_COUNTERS];
+    for (int c = 0; c < NET_COUNTERS; c++) {
+      diff[c] = n->cur[c] - n->pre[c];
+    }
+    double rx = secs > 0 ? diff[NET_RX_BYTES] / secs * 1e-6 : 0;
+    double tx = secs > 0 ? diff[NET_TX_BYTES] / secs * 1e-6 : 0;
+    fprintf(out,
+            "%-15s %8.2f MB/s %8.0f pkt/s  -- %8.2f MB/s %8.0f pkt/s  "
+            "drop %llu/%llu err %llu/%llu",
+            n->name, rx, secs > 0 ? diff[NET_RX_PACKETS] / secs : 0, tx,
+            secs > 0 ? diff[NET_TX_PACKETS] / secs : 0, diff[NET_RX_DROP],
+            diff[NET_TX_DROP], diff[NET_RX_ERRS], diff[NET_TX_ERRS]);
+    if (graph_state == 0) {
+      fputc('\n', out);
+    } else {
+      fputc(' ', out);
+      NetGraph(out, n->pre_rate, rx + tx);
+    }
+    n->pre_rate = rx + tx;
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef NET_STATS_H
+#define NET_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// the counters of /proc/net/dev that are kept
+#define NET_RX_BYTES 0
+#define NET_RX_PACKETS 1
+#define NET_RX_ERRS 2
+#define NET_RX_DROP 3
+#define NET_TX_BYTES 4
+#define NET_TX_PACKETS 5
+#define NET_TX_ERRS 6
+#define NET_TX_DROP 7
+#define NET_COUNTERS 8
+
+/**
+ * @brief one network interface as remembered between samples
+ */
+struct net_if {
+  char name[16];                        // empty if the slot is free
+  unsigned int hash;                    // hash of name
+  unsigned int seen;                    // sample it was last seen in
+  int pos;                              // index in the order of the file
+  unsigned long long cur[NET_COUNTERS]; // counters of the last sample
+  unsigned long long pre[NET_COUNTERS]; // counters of the one before
+  double pre_rate; // MB/s shown the sample before, negative if none
+};
+
+/**
+ * @brief all network interfaces of /proc/net/dev
+ *
+ * ifs is an open addressing hash table keyed by interface name, so finding
+ * an interface costs the same with ten or ten thousand of them. It only grows
+ * when more interfaces exist than ever before, so sampling does not allocate
+ * in steady state. order lists the slots in the order of the file.
+ */
+struct net_table {
+  int fd;                  // open /proc/net/dev
+  char *buf;               // buffer the file is read into
+  size_t size;             // size of buf
+  struct net_if *ifs;      // hash table of interfaces
+  int slots;               // number of slots in ifs, a power of two
+  int count;               // number of used slots
+  int *order;              // slots of the interfaces in file order
+  int order_count;         // number of entries in order
+  unsigned int generation; // number of samples taken
+  long long last_ns;       // CLOCK_MONOTONIC of the last sample
+  long long elapsed_ns;    // time between the last two samples
+};
+
+void InitNetTable(struct net_table *t);
+void ParseNetDev(struct net_table *t, const char *buf, size_t len);
+void ReadNetTable(struct net_table *t, long long now_ns);
+void NetGraph(FILE *out, double pre, double post);
+void PrintNet(FILE *out, struct net_table *t, int graph_state);
+
+#endif
@@ -0,0 +1,304 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memory_stats.h"
+#include "numa_stats.h"
+#include "procfs.h"
+
+/**
+ * @brief one wanted key of a node's meminfo and where its value is stored
+ */
+struct node_key {
+  const char *name;
+  size_t len;
+  size_t offset;
+};
+
+#define NODE_KEY(name, field)                                                  \
+  { name, sizeof(name) - 1, offsetof(struct node_meminfo, field) }
+
+// wanted keys, lengths precomputed so each line costs one compare per key
+static const struct node_key node_keys[] = {
+    NODE_KEY("MemTotal", mem_total),     NODE_KEY("MemFree", mem_free),
+    NODE_KEY("FilePages", file_pages),   NODE_KEY("AnonPages", anon_pages),
+    NODE_KEY("Shmem", shmem),            NODE_KEY("SReclaimable", sreclaimable),
+};
+
+#define NODE_KEY_NUM (sizeof(node_keys) / sizeof(node_keys[0]))
+
+// names of the numastat counters, in the order of the file
+static const char *const numastat_names[NUMA_COUNTERS] = {
+    "numa_hit",       "numa_miss",  "numa_foreign",
+    "interleave_hit", "local_node", "other_node"};
+
+/**
+ * @brief parse an unsigned decimal number, skipping the spaces before it
+ *
+ * @param p where to start, moved past the number
+ * @param end end of the buffer
+ * @return the number, 0 if there is none
+ */
+static unsigned long long ParseNumber(const char **p, const char *end) {
+  const char *c = *p;
+  unsigned long long n = 0;
+  while (c < end && *c == ' ') {
+    c++;
+  }
+  while (c < end && *c >= '0' && *c <= '9') {
+    n = n * 10 + (*c - '0');
+    c++;
+  }
+  *p = c;
+  return n;
+}
+
+/**
+ * @brief open the files of one node
+ *
+ * @param n the node, id set
+ */
+static void OpenNode(struct numa_node *n) {
+  char path[96];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo",
+           n->id);
+  n->meminfo_fd = OpenProc(path, O_RDONLY);
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/numastat",
+           n->id);
+  n->numastat_fd = OpenProc(path, O_RDONLY);
+  if (n->meminfo_fd < 0 || n->numastat_fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  n->pre_used = -1;
+}
+
+/**
+ * @brief initialize the table with every online node
+ *
+ * The online nodes are read from a list such as "0-1,4" once; nodes coming
+ * online later are not picked up.
+ *
+ * @param t table to initialize
+ */
+void InitNumaTable(struct numa_table *t) {
+  memset(t, 0, sizeof(*t));
+  int fd = OpenProc("/sys/devices/system/node/online", O_RDONLY);
+  if (fd < 0) {
+    perror("/sys/devices/system/node/online");
+    exit(1);
+  }
+  ssize_t len = read(fd, t->buf, sizeof(t->buf) - 1);
+  close(fd);
+  if (len < 0) {
+    perror("read");
+    exit(1);
+  }
+  t->buf[len] = '\0';
+
+  int cap = 8;
+  t->nodes = calloc(cap, sizeof(struct numa_node));
+  const char *p = t->buf;
+  const char *end = t->buf + len;
+  while (t->nodes != NULL && p < end && *p >= '0' && *p <= '9') {
+    int first = ParseNumber(&p, end);
+    int last = first;
+    if (p < end && *p == '-') {
+      p++;
+      last = ParseNumber(&p, end);
+    }
+    for (int id = first; id <= last && t->nodes != NULL; id++) {
+      if (t->count == cap) {
+        cap *= 2;
+        t->nodes = realloc(t->nodes, cap * sizeof(struct numa_node));
+        if (t->nodes == NULL) {
+          break;
+        }
+      }
+      struct numa_node *n = &t->nodes[t->count++];
+      memset(n, 0, sizeof(*n));
+      n->id = id;
+      OpenNode(n);
+    }
+    if (p < end && *p == ',') {
+      p++;
+    }
+  }
+  if (t->nodes == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+}
+
+/**
+ * @brief parse the meminfo of a node in one linear scan
+ *
+ * Every line starts with "Node N ", which is skipped before the key is
+ * looked up in node_keys.
+ *
+ * @param buf content of nodeN/meminfo
+ * @param len number of bytes in buf
+ * @param mem where to store the values, keys not found are left as zero
+ */
+void ParseNodeMeminfo(const char *buf, size_t len, struct node_meminfo *mem) {
+  const char *p = buf;
+  const char *end = buf + len;
+  memset(mem, 0, sizeof(*mem));
+  while (p < end) {
+    // skip "Node", the node number and the spaces around it
+    p += 4;
+    ParseNumber(&p, end);
+    while (p < end && *p == ' ') {
+      p++;
+    }
+    const char *colon = p < end ? memchr(p, ':', end - p) : NULL;
+    if (colon == NULL) {
+      break;
+    }
+    size_t key_len = colon - p;
+    const char *value = colon + 1;
+    for (size_t k = 0; k < NODE_KEY_NUM; k++) {
+      if (node_keys[k].len == key_len &&
+          memcmp(node_keys[k].name, p, key_len) == 0) {
+        *(unsigned long long *)((char *)mem + node_keys[k].offset) =
+            ParseNumber(&value, end);
+        break;
+      }
+    }
+    p = memchr(value, '\n', end - value);
+    if (p == NULL) {
+      break;
+    }
+    p++;
+  }
+}
+
+/**
+ * @brief parse the numastat of a node
+ *
+ * The counters are in a fixed order; each line is still matched by name so
+ * a kernel adding counters does not shift them.
+ *
+ * @param buf content of nodeN/numastat
+ * @param len number of bytes in buf
+ * @param counters where to store the NUMA_COUNTERS counters
+ */
+void ParseNumastat(const char *buf, size_t len, unsigned long long *counters) {
+  const char *p = buf;
+  const char *end = buf + len;
+  int k = 0;
+  memset(counters, 0, NUMA_COUNTERS * sizeof(*counters));
+  while (p < end) {
+    const char *space = memchr(p, ' ', end - p);
+    if (space == NULL) {
+      break;
+    }
+    size_t key_len = space - p;
+    // the next counter is normally the one on this line
+    for (int tries = 0; tries < NUMA_COUNTERS; tries++) {
+      if (strncmp(numastat_names[k], p, key_len) == 0 &&
+          numastat_names[k][key_len] == '\0') {
+        const char *value = space;
+        counters[k] = ParseNumber(&value, end);
+        break;
+      }
+      k = (k + 1) % NUMA_COUNTERS;
+    }
+    p = memchr(space, '\n', end - space);
+    if (p == NULL) {
+      break;
+    }
+    p++;
+  }
+}
+
+/**
+ * @brief read one file of a node into the buffer of the table
+ *
+ * @param t the table
+ * @param fd the open file
+ * @return number of bytes read
+ */
+static size_t ReadNodeFile(struct numa_table *t, int fd) {
+  ssize_t len = pread(fd, t->buf, sizeof(t->buf), 0);
+  if (len < 0) {
+    perror("pread");
+    exit(1);
+  }
+  return len;
+}
+
+/**
+ * @brief read one sample of every node
+ *
+ * @param t the table
+ * @param now_ns CLOCK_MONOTONIC of the sample in nanoseconds
+ */
+void ReadNumaTable(struct numa_table *t, long long now_ns) {
+  for (int i = 0; i < t->count; i++) {
+    struct numa_node *n = &t->nodes[i];
+    ParseNodeMeminfo(t->buf, ReadNodeFile(t, n->meminfo_fd), &n->mem);
+    memcpy(n->pre, n->cur, sizeof(n->cur));
+    ParseNumastat(t->buf, ReadNodeFile(t, n->numastat_fd), n->cur);
+    if (t->last_ns == 0) {
+      memcpy(n->pre, n->cur, sizeof(n->cur)); // nothing to compare with yet
+    }
+  }
+  t->elapsed_ns = t->last_ns != 0 ? now_ns - t->last_ns : 0;
+  t->last_ns = now_ns;
+}
+
+/**
+ * @brief Displaying the memory of every node in unit of GB
+ *
+ *    Used memory is calculated like the global figure: total - free - file
+ *    pages - reclaimable slab. The second half shows the allocations per
+ *    second that missed the node they were meant for, that other nodes
+ *    wanted on this node (foreign), and that processes running on another
+ *    node got here, with the share of allocations that were local.
+ *    With graph_state, the change of used memory is drawn like the memory
+ *    graph.
+ *
+ * @param out where to print
+ * @param t the table, sampled at least twice
+ * @param graph_state to indicate whether or not to show graphics
+ */
+void PrintNuma(FILE *out, struct numa_table *t, int graph_state) {
+  double secs = t->elapsed_ns * 1e-9;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### NUMA ### (used / total, free, file, anon -- miss/s "
+               "foreign/s remote/s local)\n");
+  for (int i = 0; i < t->count; i++) {
+    struct numa_node *n = &t->nodes[i];
+    const struct node_meminfo *m = &n->mem;
+    unsigned long long diff[NUMA_COUNTERS];
+    for (int k = 0; k < NUMA_COUNTERS; k++) {
+      diff[k] = n->cur[k] - n->pre[k];
+    }
+    unsigned long long reclaimable = m->mem_free + m->file_pages +
+                                     m->sreclaimable;
+    double used = m->mem_total > reclaimable
+                      ? (m->mem_total - reclaimable) * 1024 * 1e-9
+                      : 0;
+    unsigned long long allocs = diff[NUMA_LOCAL_NODE] + diff[NUMA_OTHER_NODE];
+    fprintf(out,
+            "node%-3d %.2f GB / %.2f GB  free %.2f  file %.2f  anon %.2f  -- "
+            "%.0f %.0f %.0f  %.1f%%",
+            n->id, used, m->mem_total * 1024 * 1e-9,
+            m->mem_free * 1024 * 1e-9, m->file_pages * 1024 * 1e-9,
+            m->anon_pages * 1024 * 1e-9,
+            secs > 0 ? diff[NUMA_MISS] / secs : 0,
+            secs > 0 ? diff[NUMA_FOREIGN] / secs : 0,
+            secs > 0 ? diff[NUMA_OTHER_NODE] / secs : 0,
+            allocs > 0 ? diff[NUMA_LOCAL_NODE] * 100.0 / allocs : 100.0);
+    if (graph_state == 0) {
+      fputc('\n', out);
+    } else {
+      fputc(' ', out);
+      MemroyGraph(out, n->pre_used < 0 ? used : n->pre_used, used);
+    }
+    n->pre_used = used;
+  }
+}
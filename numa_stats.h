@@ -0,0 +1,61 @@
+#ifndef NUMA_STATS_H
+#define NUMA_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// the counters of numastat, in the order of the file
+#define NUMA_HIT 0
+#define NUMA_MISS 1
+#define NUMA_FOREIGN 2
+#define NUMA_INTERLEAVE_HIT 3
+#define NUMA_LOCAL_NODE 4
+#define NUMA_OTHER_NODE 5
+#define NUMA_COUNTERS 6
+
+/**
+ * @brief fields read from the meminfo of a node, in kilobytes
+ */
+struct node_meminfo {
+  unsigned long long mem_total;
+  unsigned long long mem_free;
+  unsigned long long file_pages;
+  unsigned long long anon_pages;
+  unsigned long long shmem;
+  unsigned long long sreclaimable;
+};
+
+/**
+ * @brief one NUMA node as remembered between samples
+ */
+struct numa_node {
+  int id;                                // N of nodeN
+  int meminfo_fd;                        // open nodeN/meminfo
+  int numastat_fd;                       // open nodeN/numastat
+  struct node_meminfo mem;               // memory of the last sample
+  unsigned long long cur[NUMA_COUNTERS]; // counters of the last sample
+  unsigned long long pre[NUMA_COUNTERS]; // counters of the one before
+  double pre_used; // used GB shown the sample before, negative if none
+};
+
+/**
+ * @brief all online NUMA nodes
+ *
+ * The files of every node are opened once and re-read with pread, so a
+ * sample costs two reads per node.
+ */
+struct numa_table {
+  struct numa_node *nodes; // online nodes in ascending order
+  int count;               // number of nodes
+  long long last_ns;       // CLOCK_MONOTONIC of the last sample
+  long long elapsed_ns;    // time between the last two samples
+  char buf[8192];          // where a file is read into
+};
+
+void InitNumaTable(struct numa_table *t);
+void ParseNodeMeminfo(const char *buf, size_t len, struct node_meminfo *mem);
+void ParseNumastat(const char *buf, size_t len, unsigned long long *counters);
+void ReadNumaTable(struct numa_table *t, long long now_ns);
+void PrintNuma(FILE *out, struct numa_table *t, int graph_state);
+
+#endif
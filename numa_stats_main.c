@@ -0,0 +1,74 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "numa_stats.h"
+#include "procfs.h"
+#include "sched.h"
+
+/**
+ * @brief main function for getting NUMA node info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines like the other collectors. Every sample shows the
+ * memory of each online node and its cross-node allocations since the
+ * previous one, with --graphics also how its used memory changed. With
+ * --root=DIR, DIR/sys/devices/system/node is read instead.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  struct ticker ticker;
+  int graphic_state = 0;
+  struct numa_table table;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (ParseEpoch(argv[i], &start, &real)) {
+      continue;
+    } else if (ParseRoot(argv[i])) {
+      continue;
+    } else if (strcmp(argv[i], "--graphics") == 0) {
+      graphic_state = 1;
+    }
+  }
+
+  InitNumaTable(&table);
+
+  // read the counters the first period is compared with
+  InitTicker(&ticker, period, start, real);
+  ReadNumaTable(&table, MonotonicNow());
+
+  for (int i = 0; i < sample_size; i++) {
+    WaitTick(&ticker);
+    ReadNumaTable(&table, MonotonicNow());
+    PrintNuma(stdout, &table, graphic_state);
+    fflush(stdout);
+  }
+  if (ticker.missed > 0) {
+    fprintf(stderr, "numa_stats: missed %lld deadlines\n", ticker.missed);
+  }
+}
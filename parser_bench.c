@@ -0,0 +1,169 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu_stats.h"
+#include "disk_stats.h"
+#include "memory_stats.h"
+#include "net_stats.h"
+#include "proc_stats.h"
+#include "procfs.h"
+#include "sched.h"
+#include "user_stats.h"
+
+// what one benchmark measures, called once per sample
+typedef void (*bench_fn)(void);
+
+static struct cpu_sample cpu_sample;
+static struct meminfo mem_info;
+static struct user_list users = {0, 0, NULL};
+static struct proc_table procs;
+static struct disk_table disks;
+static struct net_table nets;
+static char *file_buf = NULL; // contents of the file a parse-only run parses
+static size_t file_len = 0;
+
+/**
+ * @brief read a whole file below the root into file_buf
+ *
+ * @param path absolute path on the system, e.g. /proc/stat
+ */
+static void LoadFile(const char *path) {
+  int fd = OpenProc(path, O_RDONLY);
+  if (fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  size_t size = 4096;
+  file_len = 0;
+  free(file_buf);
+  file_buf = malloc(size);
+  while (file_buf != NULL) {
+    ssize_t n = read(fd, file_buf + file_len, size - file_len);
+    if (n < 0) {
+      perror("read");
+      exit(1);
+    } else if (n == 0) {
+      break;
+    }
+    file_len += n;
+    if (file_len == size) {
+      size *= 2;
+      file_buf = realloc(file_buf, size);
+    }
+  }
+  if (file_buf == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  close(fd);
+}
+
+static void CpuRead() { ReadCpuSample(&cpu_sample); }
+
+static void CpuParse() { ParseCpuStat(file_buf, file_len, &cpu_sample); }
+
+static void MemoryRead() { ReadMeminfo(&mem_info); }
+
+static void MemoryParse() { ParseMeminfo(file_buf, file_len, &mem_info); }
+
+static void UsersRead() {
+  if (ReadUsers(&users) < 0) {
+    perror("utmp");
+    exit(1);
+  }
+}
+
+static void UsersRescan() {
+  ResetUsers();
+  UsersRead();
+}
+
+static void ProcRead() { ReadProcTable(&procs, MonotonicNow()); }
+
+static void DiskRead() { ReadDiskTable(&disks, MonotonicNow()); }
+
+static void DiskParse() { ParseDiskStats(&disks, file_buf, file_len); }
+
+static void NetRead() { ReadNetTable(&nets, MonotonicNow()); }
+
+static void NetParse() { ParseNetDev(&nets, file_buf, file_len); }
+
+/**
+ * @brief run one benchmark for the given time and print its result
+ *
+ * The benchmark is run once before the clock starts, so files are opened and
+ * buffers are sized like in steady state sampling.
+ *
+ * @param name name of the collector and path measured
+ * @param fn what to measure
+ * @param duration_ns how long to run it
+ */
+static void RunBench(const char *name, bench_fn fn, long long duration_ns) {
+  fn();
+  long long count = 0;
+  long long start = MonotonicNow();
+  long long now = start;
+  while (now - start < duration_ns) {
+    fn();
+    count++;
+    now = MonotonicNow();
+  }
+  double ns = (double)(now - start) / count;
+  printf("%-16s %10lld %12.0f %14.0f\n", name, count, ns, 1e9 / ns);
+}
+
+/**
+ * @brief main function for measuring the read and parse path of collectors
+ *
+ * Every collector is sampled as fast as possible for 500ms each, unless
+ * --duration=MS is given, and the number of samples per second and the time
+ * per sample are shown. "read" includes the system calls, "parse" only parses
+ * a copy of the file read once and "rescan" reads utmp as if it had changed.
+ * With --root=DIR, the files below DIR are measured instead of the system's.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+  long long duration_ms = 500;
+
+  for (int i = 1; i < argc; i++) {
+    if (ParseRoot(argv[i])) {
+      continue;
+    } else if (sscanf(argv[i], "--duration=%lld", &duration_ms) == 1 &&
+               duration_ms > 0) {
+      continue;
+    } else {
+      printf("Invalid command line arguments\n");
+      exit(1);
+    }
+  }
+  long long duration_ns = duration_ms * 1000000;
+
+  printf("%-16s %10s %12s %14s\n", "benchmark", "samples", "ns/sample",
+         "samples/sec");
+  InitCpuSample(&cpu_sample, GetCoreSlots());
+  RunBench("cpu read", CpuRead, duration_ns);
+  LoadFile("/proc/stat");
+  RunBench("cpu parse", CpuParse, duration_ns);
+  RunBench("memory read", MemoryRead, duration_ns);
+  LoadFile("/proc/meminfo");
+  RunBench("memory parse", MemoryParse, duration_ns);
+  RunBench("users read", UsersRead, duration_ns);
+  RunBench("users rescan", UsersRescan, duration_ns);
+  InitProcTable(&procs, 10);
+  RunBench("proc read", ProcRead, duration_ns);
+  InitDiskTable(&disks);
+  RunBench("disk read", DiskRead, duration_ns);
+  LoadFile("/proc/diskstats");
+  RunBench("disk parse", DiskParse, duration_ns);
+  InitNetTable(&nets);
+  RunBench("net read", NetRead, duration_ns);
+  LoadFile("/proc/net/dev");
+  RunBench("net parse", NetParse, duration_ns);
+  exit(0);
+}
@@ -0,0 +1,425 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "proc_stats.h"
+#include "procfs.h"
+
+// size of the buffer /proc is listed into with getdents64
+#define DIRENT_BUF_SIZE 65536
+// fds kept free for everything but the cached /proc/[pid] fds
+#define FD_RESERVE 64
+
+/**
+ * @brief directory entry as returned by getdents64
+ */
+struct linux_dirent64 {
+  unsigned long long d_ino;
+  long long d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+/**
+ * @brief find the slot of a pid in the hash table
+ *
+ * @param t the table
+ * @param pid the pid to look for
+ * @return index of the slot holding pid, or of the free slot to insert it in
+ */
+static int FindSlot(const struct proc_table *t, int pid) {
+  unsigned int i = ((unsigned int)pid * 2654435761u) & (t->size - 1);
+  while (t->entries[i].pid != 0 && t->entries[i].pid != pid) {
+    i = (i + 1) & (t->size - 1);
+  }
+  return i;
+}
+
+/**
+ * @brief allocate the hash table with the given number of slots and move the
+ * old entries into it
+ *
+ * @param t the table
+ * @param size new number of slots, a power of two
+ */
+static void ResizeTable(struct proc_table *t, int size) {
+  struct proc_entry *old = t->entries;
+  int old_size = t->size;
+  t->entries = calloc(size, sizeof(struct proc_entry));
+  if (t->entries == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  t->size = size;
+  for (int i = 0; i < old_size; i++) {
+    if (old[i].pid != 0) {
+      t->entries[FindSlot(t, old[i].pid)] = old[i];
+    }
+  }
+  free(old);
+}
+
+/**
+ * @brief remove the entry in the given slot, closing its cached fd
+ *
+ * Entries after it in the same probe sequence are shifted back, so no
+ * tombstones are needed.
+ *
+ * @param t the table
+ * @param i the slot
+ */
+static void RemoveSlot(struct proc_table *t, int i) {
+  if (t->entries[i].dirfd >= 0) {
+    close(t->entries[i].dirfd);
+    t->fd_budget++;
+  }
+  t->entries[i].pid = 0;
+  t->count--;
+  int j = i;
+  while (1) {
+    j = (j + 1) & (t->size - 1);
+    if (t->entries[j].pid == 0) {
+      return;
+    }
+    int home =
+        ((unsigned int)t->entries[j].pid * 2654435761u) & (t->size - 1);
+    // move j into the hole unless its home lies cyclically in (i, j]
+    if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j)) {
+      continue;
+    }
+    t->entries[i] = t->entries[j];
+    t->entries[j].pid = 0;
+    i = j;
+  }
+}
+
+/**
+ * @brief read a small file of a process directory into buf
+ *
+ * @param dirfd the /proc/[pid] fd, or /proc itself
+ * @param path path relative to dirfd
+ * @param buf where to store the content, nul terminated
+ * @param size size of buf
+ * @return number of bytes read, -1 on failure
+ */
+static ssize_t ReadProcFile(int dirfd, const char *path, char *buf,
+                            size_t size) {
+  int fd = openat(dirfd, path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  ssize_t len = read(fd, buf, size - 1);
+  close(fd);
+  if (len >= 0) {
+    buf[len] = '\0';
+  }
+  return len;
+}
+
+/**
+ * @brief read stat and statm of one process into its entry
+ *
+ * The /proc/[pid] fd is cached while the fd budget allows; a cached fd of a
+ * process that ended and whose pid was reused fails to read and is reopened.
+ *
+ * @param t the table
+ * @param e the entry, pid set
+ * @param name the pid as a string
+ * @param starttime where to store the start time of the process
+ * @return 0 on success, -1 if the process is gone
+ */
+static int ReadProcess(struct proc_table *t, struct proc_entry *e,
+                       const char *name, unsigned long long *starttime) {
+  char stat[1024];
+  char statm[256];
+  char path[64];
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (e->dirfd < 0 && t->fd_budget > 0) {
+      e->dirfd = openat(t->proc_fd, name, O_RDONLY | O_DIRECTORY);
+      if (e->dirfd >= 0) {
+        t->fd_budget--;
+      }
+    }
+    ssize_t len;
+    if (e->dirfd >= 0) {
+      len = ReadProcFile(e->dirfd, "stat", stat, sizeof(stat));
+      if (len > 0) {
+        len = ReadProcFile(e->dirfd, "statm", statm, sizeof(statm));
+      }
+    } else {
+      snprintf(path, sizeof(path), "%s/stat", name);
+      len = ReadProcFile(t->proc_fd, path, stat, sizeof(stat));
+      snprintf(path, sizeof(path), "%s/statm", name);
+      if (len > 0) {
+        len = ReadProcFile(t->proc_fd, path, statm, sizeof(statm));
+      }
+    }
+    if (len > 0) {
+      break;
+    }
+    if (e->dirfd < 0 || attempt == 1) {
+      return -1;
+    }
+    // stale fd of an earlier process with the same pid
+    close(e->dirfd);
+    e->dirfd = -1;
+    t->fd_budget++;
+  }
+
+  // the command name may contain spaces and parentheses, it ends at the last )
+  char *open_paren = strchr(stat, '(');
+  char *close_paren = strrchr(stat, ')');
+  if (open_paren == NULL || close_paren == NULL || close_paren < open_paren) {
+    return -1;
+  }
+  size_t comm_len = close_paren - open_paren - 1;
+  if (comm_len >= sizeof(e->comm)) {
+    comm_len = sizeof(e->comm) - 1;
+  }
+  memcpy(e->comm, open_paren + 1, comm_len);
+  e->comm[comm_len] = '\0';
+
+  // fields after the command name, starting with field 3 (state)
+  unsigned long long utime = 0, stime = 0;
+  *starttime = 0;
+  char *p = close_paren + 1;
+  for (int field = 3; field <= 22 && *p != '\0'; field++) {
+    while (*p == ' ') {
+      p++;
+    }
+    if (field == 14) {
+      utime = strtoull(p, NULL, 10);
+    } else if (field == 15) {
+      stime = strtoull(p, NULL, 10);
+    } else if (field == 22) {
+      *starttime = strtoull(p, NULL, 10);
+    }
+    while (*p != ' ' && *p != '\0') {
+      p++;
+    }
+  }
+  e->cpu = utime + stime;
+
+  // statm: size resident shared ...
+  char *resident = strchr(statm, ' ');
+  e->rss = resident != NULL ? strtol(resident + 1, NULL, 10) : 0;
+  return 0;
+}
+
+/**
+ * @brief push a row into the bounded min-heap of the top rows
+ *
+ * @param t the table
+ * @param row the row
+ */
+static void PushTop(struct proc_table *t, const struct proc_row *row) {
+  struct proc_row *heap = t->top;
+  int i;
+  if (t->top_count < t->top_n) {
+    i = t->top_count++;
+    // sift up
+    while (i > 0 && heap[(i - 1) / 2].cpu > row->cpu) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i] = *row;
+    return;
+  }
+  if (t->top_n == 0 || row->cpu <= heap[0].cpu) {
+    return;
+  }
+  // replace the smallest row and sift down
+  i = 0;
+  while (1) {
+    int child = 2 * i + 1;
+    if (child >= t->top_count) {
+      break;
+    }
+    if (child + 1 < t->top_count && heap[child + 1].cpu < heap[child].cpu) {
+      child++;
+    }
+    if (heap[child].cpu >= row->cpu) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = *row;
+}
+
+/**
+ * @brief sort the heap of top rows by descending cpu, in place
+ *
+ * @param t the table
+ */
+static void SortTop(struct proc_table *t) {
+  struct proc_row *heap = t->top;
+  for (int n = t->top_count - 1; n > 0; n--) {
+    // move the smallest row to the end, then restore the heap before it
+    struct proc_row last = heap[n];
+    heap[n] = heap[0];
+    int i = 0;
+    while (1) {
+      int child = 2 * i + 1;
+      if (child >= n) {
+        break;
+      }
+      if (child + 1 < n && heap[child + 1].cpu < heap[child].cpu) {
+        child++;
+      }
+      if (heap[child].cpu >= last.cpu) {
+        break;
+      }
+      heap[i] = heap[child];
+      i = child;
+    }
+    heap[i] = last;
+  }
+}
+
+/**
+ * @brief initialize an empty process table
+ *
+ * The soft limit of open files is raised to the hard limit, so as many
+ * /proc/[pid] fds as possible can be cached.
+ *
+ * @param t table to initialize
+ * @param top_n number of processes to keep in the top rows
+ */
+void InitProcTable(struct proc_table *t, int top_n) {
+  memset(t, 0, sizeof(*t));
+  t->proc_fd = OpenProc("/proc", O_RDONLY | O_DIRECTORY);
+  if (t->proc_fd < 0) {
+    perror("open");
+    exit(1);
+  }
+  t->dirent_buf = malloc(DIRENT_BUF_SIZE);
+  t->top = calloc(top_n > 0 ? top_n : 1, sizeof(struct proc_row));
+  if (t->dirent_buf == NULL || t->top == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  t->top_n = top_n;
+  ResizeTable(t, 1024);
+
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    getrlimit(RLIMIT_NOFILE, &limit);
+    t->fd_budget = limit.rlim_cur > FD_RESERVE ? limit.rlim_cur - FD_RESERVE : 0;
+    if (limit.rlim_cur == RLIM_INFINITY || t->fd_budget > 1 << 20) {
+      t->fd_budget = 1 << 20;
+    }
+  }
+  t->page_kb = sysconf(_SC_PAGESIZE) / 1024;
+  t->clk_tck = sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * @brief take one sample of all processes and update the top rows
+ *
+ * /proc is listed with getdents64 into a fixed buffer. Each process is looked
+ * up in the table, so processes seen before keep their fd and counters, and
+ * processes that ended are dropped at the end of the walk. The first sample
+ * only records the counters the next one is compared with.
+ *
+ * @param t the table
+ * @param now_ns CLOCK_MONOTONIC of the sample in nanoseconds
+ */
+void ReadProcTable(struct proc_table *t, long long now_ns) {
+  double elapsed = t->last_ns != 0 ? (now_ns - t->last_ns) * 1e-9 : 0;
+  int first = t->generation == 0;
+  t->generation++;
+  t->top_count = 0;
+  lseek(t->proc_fd, 0, SEEK_SET);
+  while (1) {
+    long n = syscall(SYS_getdents64, t->proc_fd, t->dirent_buf,
+                     DIRENT_BUF_SIZE);
+    if (n < 0) {
+      perror("getdents64");
+      exit(1);
+    }
+    if (n == 0) {
+      break;
+    }
+    for (long off = 0; off < n;) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(t->dirent_buf + off);
+      off += d->d_reclen;
+      if (d->d_name[0] < '1' || d->d_name[0] > '9') {
+        continue; // not a process
+      }
+      int pid = atoi(d->d_name);
+      if ((t->count + 1) * 2 > t->size) {
+        ResizeTable(t, t->size * 2);
+      }
+      struct proc_entry *e = &t->entries[FindSlot(t, pid)];
+      int fresh = e->pid == 0;
+      if (fresh) {
+        memset(e, 0, sizeof(*e));
+        e->pid = pid;
+        e->dirfd = -1;
+        t->count++;
+      }
+      unsigned long long starttime;
+      if (ReadProcess(t, e, d->d_name, &starttime) < 0) {
+        continue; // ended while we looked, dropped below
+      }
+      if (!fresh && starttime != e->starttime) {
+        fresh = 1; // the pid was reused by another process
+      }
+      e->starttime = starttime;
+      e->seen = t->generation;
+      if (fresh) {
+        // a process that started since the last sample used all its time
+        // in this period
+        e->pre_cpu = first ? e->cpu : 0;
+        e->pre_rss = first ? e->rss : 0;
+      }
+      if (!first && elapsed > 0) {
+        struct proc_row row;
+        row.pid = pid;
+        row.cpu = (double)(e->cpu - e->pre_cpu) / t->clk_tck / elapsed * 100;
+        row.rss_kb = e->rss * t->page_kb;
+        row.rss_diff_kb = (e->rss - e->pre_rss) * t->page_kb;
+        memcpy(row.comm, e->comm, sizeof(row.comm));
+        PushTop(t, &row);
+      }
+      e->pre_cpu = e->cpu;
+      e->pre_rss = e->rss;
+    }
+  }
+
+  // drop the processes that ended
+  for (int i = 0; i < t->size;) {
+    if (t->entries[i].pid != 0 && t->entries[i].seen != t->generation) {
+      RemoveSlot(t, i); // may move another entry into slot i
+    } else {
+      i++;
+    }
+  }
+  SortTop(t);
+  t->last_ns = now_ns;
+}
+
+/**
+ * @brief Displaying the top processes by cpu utilization
+ *
+ * @param t the table, sampled at least twice
+ */
+void PrintProcTop(const struct proc_table *t) {
+  printf("----------------------------\n");
+  printf("### Top %d processes ### (%d total)\n", t->top_count, t->count);
+  printf("%8s %7s %10s %10s  %s\n", "PID", "CPU%", "RSS(MB)", "+/-(MB)",
+         "COMMAND");
+  for (int i = 0; i < t->top_count; i++) {
+    const struct proc_row *row = &t->top[i];
+    printf("%8d %7.2f %10.2f %+10.2f  %s\n", row->pid, row->cpu,
+           row->rss_kb / 1024.0, row->rss_diff_kb / 1024.0, row->comm);
+  }
+}
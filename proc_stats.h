@@ -0,0 +1,60 @@
+#ifndef PROC_STATS_H
+#define PROC_STATS_H
+
+/**
+ * @brief one process as remembered between samples
+ *
+ * A pid is only the same process while its start time stays the same, so
+ * entries are keyed by pid and start time together.
+ */
+struct proc_entry {
+  int pid;                      // 0 if the slot is free
+  int dirfd;                    // cached /proc/[pid] fd, -1 if not cached
+  unsigned long long starttime; // start time of the process in clock ticks
+  unsigned long long cpu;       // utime + stime in clock ticks
+  unsigned long long pre_cpu;   // cpu at the previous sample
+  long rss;                     // resident pages
+  long pre_rss;                 // rss at the previous sample
+  unsigned int seen;            // sample the process was last seen in
+  char comm[17];                // command name
+};
+
+/**
+ * @brief one row of the top N processes
+ */
+struct proc_row {
+  int pid;
+  double cpu;       // utilization in percentage of one core
+  long rss_kb;      // resident memory in kilobytes
+  long rss_diff_kb; // change of resident memory since the previous sample
+  char comm[17];
+};
+
+/**
+ * @brief incremental table of all processes
+ *
+ * entries is an open addressing hash table keyed by pid, which only grows
+ * when more processes exist than ever before, so sampling does not allocate
+ * in steady state. The top N rows are kept in a bounded min-heap.
+ */
+struct proc_table {
+  int proc_fd;                // open /proc
+  char *dirent_buf;           // buffer for getdents64
+  struct proc_entry *entries; // hash table of processes
+  int size;                   // number of slots in entries, a power of two
+  int count;                  // number of used slots
+  int fd_budget;              // /proc/[pid] fds that may still be cached
+  unsigned int generation;    // number of samples taken
+  long long last_ns;          // CLOCK_MONOTONIC of the previous sample
+  long page_kb;               // size of a page in kilobytes
+  long clk_tck;               // clock ticks per second
+  int top_n;                  // number of rows to keep
+  int top_count;              // number of rows in top
+  struct proc_row *top;       // top rows, sorted by cpu once sampled
+};
+
+void InitProcTable(struct proc_table *t, int top_n);
+void ReadProcTable(struct proc_table *t, long long now_ns);
+void PrintProcTop(const struct proc_table *t);
+
+#endif
@@ -0,0 +1,65 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "procfs.h"
+
+// directory the collectors read /proc and utmp below, empty for the system
+static char proc_root[4096] = "";
+
+/**
+ * @brief parse the --root=DIR argument
+ *
+ * With a root, every collector reads e.g. DIR/proc/stat instead of
+ * /proc/stat, so captured files can be measured like a live system.
+ *
+ * @param arg command line argument
+ * @return 1 if arg was --root=DIR, 0 otherwise
+ */
+int ParseRoot(const char *arg) {
+  if (strncmp(arg, "--root=", 7) != 0 || strlen(arg + 7) >= sizeof(proc_root)) {
+    return 0;
+  }
+  strcpy(proc_root, arg + 7);
+  // a trailing slash would double the one every path starts with
+  size_t len = strlen(proc_root);
+  while (len > 0 && proc_root[len - 1] == '/') {
+    proc_root[--len] = '\0';
+  }
+  return 1;
+}
+
+/**
+ * @brief check whether the collectors read below another root
+ *
+ * @return 1 if --root was given, 0 otherwise
+ */
+int HasProcRoot() { return proc_root[0] != '\0'; }
+
+/**
+ * @brief get the path a system file is read from
+ *
+ * @param path absolute path on the system, e.g. /proc/stat
+ * @param buf where to build the path below the root
+ * @param size size of buf
+ * @return path itself without a root, buf otherwise
+ */
+const char *ProcPath(const char *path, char *buf, size_t size) {
+  if (!HasProcRoot()) {
+    return path;
+  }
+  snprintf(buf, size, "%s%s", proc_root, path);
+  return buf;
+}
+
+/**
+ * @brief open a system file, below the root if one was given
+ *
+ * @param path absolute path on the system, e.g. /proc/stat
+ * @param flags flags for open()
+ * @return the fd, -1 on failure
+ */
+int OpenProc(const char *path, int flags) {
+  char buf[8192];
+  return open(ProcPath(path, buf, sizeof(buf)), flags);
+}
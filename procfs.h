@@ -0,0 +1,11 @@
+#ifndef PROCFS_H
+#define PROCFS_H
+
+#include <stddef.h>
+
+int ParseRoot(const char *arg);
+int HasProcRoot();
+const char *ProcPath(const char *path, char *buf, size_t size);
+int OpenProc(const char *path, int flags);
+
+#endif
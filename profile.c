@@ -0,0 +1,204 @@
+#define _GNU_SOURCE // for RUSAGE_THREAD
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "profile.h"
+#include "sched.h"
+
+int profile_state = 0; // 1 if stages are timed
+
+static struct profile profiles[PROFILE_NUM];
+static struct rusage started[PROFILE_NUM];   // resource usage at the start
+static long long started_wall[PROFILE_NUM];  // CLOCK_MONOTONIC at the start
+
+static const char *part_names[PROFILE_NUM] = {"memory", "user", "cpu",
+                                              "monitor"};
+static const char *stage_names[STAGE_NUM] = {"read", "parse", "serialize",
+                                             "receive", "render"};
+
+/**
+ * @brief start timing the stages of every sample
+ */
+void EnableProfile() { profile_state = 1; }
+
+/**
+ * @brief get the start time of a stage
+ *
+ * @return CLOCK_MONOTONIC in nanoseconds, 0 if profiling is off
+ */
+long long StageStart() { return profile_state ? MonotonicNow() : 0; }
+
+/**
+ * @brief record how long a stage took in its histogram
+ *
+ * There is no lock: each stage histogram of a part is written by a single
+ * thread. With --threads the main thread records STAGE_RECEIVE of a collector
+ * while the collector thread records its STAGE_READ and STAGE_PARSE, so a new
+ * call must keep a stage of a part on one thread.
+ *
+ * @param part which part of the tool, PROFILE_*
+ * @param stage which stage, STAGE_*
+ * @param start what StageStart returned when the stage started
+ */
+void StageEnd(int part, int stage, long long start) {
+  if (!profile_state) {
+    return;
+  }
+  uint64_t ns = MonotonicNow() - start;
+  struct latency_hist *h = &profiles[part].stages[stage];
+  int bucket = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+  h->buckets[bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1]++;
+  h->count++;
+  h->sum_ns += ns;
+  if (ns > h->max_ns) {
+    h->max_ns = ns;
+  }
+}
+
+/**
+ * @brief note the resource usage of the calling thread at the start of a part
+ *
+ * @param part which part of the tool, PROFILE_*
+ */
+void StartProfile(int part) {
+  if (!profile_state) {
+    return;
+  }
+  getrusage(RUSAGE_THREAD, &started[part]);
+  started_wall[part] = MonotonicNow();
+}
+
+/**
+ * @brief convert a timeval to nanoseconds
+ *
+ * @param tv the timeval
+ * @return nanoseconds
+ */
+static uint64_t TimevalNs(const struct timeval *tv) {
+  return tv->tv_sec * 1000000000ULL + tv->tv_usec * 1000ULL;
+}
+
+/**
+ * @brief store the resource usage of the calling thread since StartProfile
+ *
+ * @param part which part of the tool, PROFILE_*
+ */
+void StopProfile(int part) {
+  if (!profile_state) {
+    return;
+  }
+  struct rusage now;
+  getrusage(RUSAGE_THREAD, &now);
+  struct profile *p = &profiles[part];
+  p->wall_ns = MonotonicNow() - started_wall[part];
+  p->utime_ns = TimevalNs(&now.ru_utime) - TimevalNs(&started[part].ru_utime);
+  p->stime_ns = TimevalNs(&now.ru_stime) - TimevalNs(&started[part].ru_stime);
+  p->nvcsw = now.ru_nvcsw - started[part].ru_nvcsw;
+  p->nivcsw = now.ru_nivcsw - started[part].ru_nivcsw;
+}
+
+/**
+ * @brief get what was measured about a part, e.g. to send or fill it in
+ *
+ * @param part which part of the tool, PROFILE_*
+ * @return the profile of the part
+ */
+struct profile *GetProfile(int part) { return &profiles[part]; }
+
+/**
+ * @brief add what another process measured about a part to its profile
+ *
+ * @param part which part of the tool, PROFILE_*
+ * @param other the profile measured by the other process
+ */
+void MergeProfile(int part, const struct profile *other) {
+  struct profile *p = &profiles[part];
+  for (int s = 0; s < STAGE_NUM; s++) {
+    struct latency_hist *h = &p->stages[s];
+    const struct latency_hist *o = &other->stages[s];
+    h->count += o->count;
+    h->sum_ns += o->sum_ns;
+    h->max_ns = o->max_ns > h->max_ns ? o->max_ns : h->max_ns;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+      h->buckets[i] += o->buckets[i];
+    }
+  }
+  p->wall_ns = other->wall_ns > p->wall_ns ? other->wall_ns : p->wall_ns;
+  p->utime_ns += other->utime_ns;
+  p->stime_ns += other->stime_ns;
+  p->nvcsw += other->nvcsw;
+  p->nivcsw += other->nivcsw;
+}
+
+/**
+ * @brief get a latency below which the given share of a stage took
+ *
+ * The histogram only knows the bucket, so the bucket's upper bound is
+ * returned, but never more than the largest latency seen.
+ *
+ * @param h the histogram
+ * @param q the share, between 0 and 1
+ * @return the latency in nanoseconds
+ */
+static double Percentile(const struct latency_hist *h, double q) {
+  uint64_t seen = 0;
+  for (int i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= q * h->count) {
+      double bound = (double)(1ULL << i);
+      return bound < h->max_ns ? bound : h->max_ns;
+    }
+  }
+  return h->max_ns;
+}
+
+/**
+ * @brief Displaying the latency of every stage and the resources used by
+ * every part of the tool
+ *
+ * The overhead is the cpu time of all parts in percentage of one core over
+ * the time the monitor ran.
+ *
+ * @param out where to print
+ */
+void PrintProfile(FILE *out) {
+  uint64_t cpu_ns = 0;
+  uint64_t wall_ns = 0;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Self stats ### (latency in us)\n");
+  fprintf(out, "%-8s %-10s %8s %9s %9s %9s %9s\n", "part", "stage", "count",
+          "avg", "p50", "p99", "max");
+  for (int p = 0; p < PROFILE_NUM; p++) {
+    for (int s = 0; s < STAGE_NUM; s++) {
+      const struct latency_hist *h = &profiles[p].stages[s];
+      if (h->count == 0) {
+        continue;
+      }
+      fprintf(out, "%-8s %-10s %8llu %9.1f %9.1f %9.1f %9.1f\n",
+              part_names[p], stage_names[s], (unsigned long long)h->count,
+              h->sum_ns * 1e-3 / h->count, Percentile(h, 0.5) * 1e-3,
+              Percentile(h, 0.99) * 1e-3, h->max_ns * 1e-3);
+    }
+  }
+  for (int p = 0; p < PROFILE_NUM; p++) {
+    const struct profile *pr = &profiles[p];
+    if (pr->wall_ns == 0) {
+      continue;
+    }
+    fprintf(out,
+            "%-8s cpu: %.3f s user %.3f s system, context switches: %llu "
+            "voluntary %llu involuntary\n",
+            part_names[p], pr->utime_ns * 1e-9, pr->stime_ns * 1e-9,
+            (unsigned long long)pr->nvcsw, (unsigned long long)pr->nivcsw);
+    cpu_ns += pr->utime_ns + pr->stime_ns;
+    if (pr->wall_ns > wall_ns) {
+      wall_ns = pr->wall_ns;
+    }
+  }
+  if (wall_ns > 0) {
+    fprintf(out, "overhead: %.3f%% of one core over %.2f s\n",
+            cpu_ns * 100.0 / wall_ns, wall_ns * 1e-9);
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// parts of the tool that are profiled, the collectors in the order of
+// SOURCE_MEM, SOURCE_USER and SOURCE_CPU, then sys_monitoring_tool itself
+#define PROFILE_MEM 0
+#define PROFILE_USER 1
+#define PROFILE_CPU 2
+#define PROFILE_MONITOR 3
+#define PROFILE_NUM 4
+
+// stages of a sample
+#define STAGE_READ 0      // reading /proc or utmp
+#define STAGE_PARSE 1     // parsing and computing the sample
+#define STAGE_SERIALIZE 2 // encoding and sending the sample
+#define STAGE_RECEIVE 3   // receiving and decoding it in the monitor
+#define STAGE_RENDER 4    // drawing the terminal output
+#define STAGE_NUM 5
+
+// bucket i counts latencies below 2^i nanoseconds, the last one the rest
+#define HIST_BUCKETS 32
+
+/**
+ * @brief fixed-bucket latency histogram of one stage
+ */
+struct latency_hist {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[HIST_BUCKETS];
+};
+
+/**
+ * @brief everything measured about one part of the tool
+ *
+ * The resource usage is the difference between StartProfile and
+ * StopProfile, taken for the thread the part runs on.
+ */
+struct profile {
+  struct latency_hist stages[STAGE_NUM];
+  uint64_t wall_ns;  // time between StartProfile and StopProfile
+  uint64_t utime_ns; // cpu time in user mode
+  uint64_t stime_ns; // cpu time in kernel mode
+  uint64_t nvcsw;    // voluntary context switches
+  uint64_t nivcsw;   // involuntary context switches
+};
+
+extern int profile_state;
+
+void EnableProfile();
+long long StageStart();
+void StageEnd(int part, int stage, long long start);
+void StartProfile(int part);
+void StopProfile(int part);
+struct profile *GetProfile(int part);
+void MergeProfile(int part, const struct profile *other);
+void PrintProfile(FILE *out);
+
+#endif
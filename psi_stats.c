@@ -0,0 +1,291 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "procfs.h"
+#include "psi_stats.h"
+#include "sched.h"
+
+// names of the resources, as in /proc/pressure and on the command line
+const char *const psi_names[PSI_RESOURCES] = {"cpu", "memory", "io"};
+
+/**
+ * @brief open the pressure files, kept open between samples
+ *
+ * Kernels built without PSI have no /proc/pressure; that is an error, but a
+ * single missing file is not, since older kernels lack the "full" line and
+ * some the file of a resource.
+ *
+ * @param sample sample to initialize
+ */
+void InitPressure(struct psi_sample *sample) {
+  char path[64];
+  int opened = 0;
+  memset(sample, 0, sizeof(*sample));
+  for (int r = 0; r < PSI_RESOURCES; r++) {
+    snprintf(path, sizeof(path), "/proc/pressure/%s", psi_names[r]);
+    sample->fds[r] = OpenProc(path, O_RDONLY);
+    opened += sample->fds[r] >= 0;
+  }
+  if (opened == 0) {
+    perror("/proc/pressure");
+    exit(1);
+  }
+}
+
+/**
+ * @brief find the value after "key=" on a line
+ *
+ * @param p where to start searching
+ * @param end end of the line
+ * @param key the key including "=", e.g. "avg10="
+ * @return start of the value, "0" if the key is missing
+ */
+static const char *FindKey(const char *p, const char *end, const char *key) {
+  size_t len = strlen(key);
+  while (p + len < end && strncmp(p, key, len) != 0) {
+    p++;
+  }
+  return p + len < end ? p + len : "0";
+}
+
+/**
+ * @brief parse the content of a pressure file
+ *
+ * @param buf content of e.g. /proc/pressure/memory, ending in a newline or
+ * followed by '\0'
+ * @param len number of bytes in buf
+ * @param res where to store the pressure, lines that are missing are zeroed
+ * @return 0 on success, -1 if there is no "some" line
+ */
+int ParsePressure(const char *buf, size_t len, struct psi_resource *res) {
+  const char *p = buf;
+  const char *end = buf + len;
+  int found = 0;
+  memset(res, 0, sizeof(*res));
+  while (p < end) {
+    const char *eol = memchr(p, '\n', end - p);
+    if (eol == NULL) {
+      eol = end;
+    }
+    struct psi_line *line = NULL;
+    if (eol - p > 5 && strncmp(p, "some ", 5) == 0) {
+      line = &res->some;
+      found = 1;
+    } else if (eol - p > 5 && strncmp(p, "full ", 5) == 0) {
+      line = &res->full;
+    }
+    if (line != NULL) {
+      line->avg10 = strtod(FindKey(p, eol, "avg10="), NULL);
+      line->avg60 = strtod(FindKey(p, eol, "avg60="), NULL);
+      line->avg300 = strtod(FindKey(p, eol, "avg300="), NULL);
+      line->total = strtoull(FindKey(p, eol, "total="), NULL, 10);
+    }
+    p = eol + 1;
+  }
+  return found ? 0 : -1;
+}
+
+/**
+ * @brief read one sample of all pressure files with one pread each
+ *
+ * @param sample the sample, initialized with InitPressure
+ */
+void ReadPressure(struct psi_sample *sample) {
+  char buf[256];
+  for (int r = 0; r < PSI_RESOURCES; r++) {
+    if (sample->fds[r] < 0) {
+      continue;
+    }
+    ssize_t len = pread(sample->fds[r], buf, sizeof(buf) - 1, 0);
+    if (len < 0) {
+      perror("pread");
+      exit(1);
+    }
+    buf[len] = '\0'; // a number at the very end is not followed by a newline
+    ParsePressure(buf, len, &sample->res[r]);
+  }
+  sample->time_ns = MonotonicNow();
+}
+
+/**
+ * @brief parse a trigger such as "memory:some:150ms:2s"
+ *
+ * The fields are the resource, "some" or "full", the stall time and the
+ * window the stall time has to add up in; times are parsed like --tdelay.
+ *
+ * @param text the trigger
+ * @param trig where to store the trigger, not yet registered
+ * @return 1 if text is a valid trigger, 0 otherwise
+ */
+int ParseTrigger(const char *text, struct psi_trigger *trig) {
+  char copy[128];
+  if (strlen(text) >= sizeof(copy)) {
+    return 0;
+  }
+  strcpy(copy, text);
+  char *save;
+  char *resource = strtok_r(copy, ":", &save);
+  char *kind = strtok_r(NULL, ":", &save);
+  char *stall = strtok_r(NULL, ":", &save);
+  char *window = strtok_r(NULL, ":", &save);
+  if (window == NULL || strtok_r(NULL, ":", &save) != NULL) {
+    return 0;
+  }
+  memset(trig, 0, sizeof(*trig));
+  trig->fd = -1;
+  trig->resource = -1;
+  for (int r = 0; r < PSI_RESOURCES; r++) {
+    if (strcmp(resource, psi_names[r]) == 0) {
+      trig->resource = r;
+    }
+  }
+  if (strcmp(kind, "full") == 0) {
+    trig->full = 1;
+  } else if (strcmp(kind, "some") != 0) {
+    return 0;
+  }
+  return trig->resource >= 0 && ParsePeriod(stall, &trig->stall_us) &&
+         ParsePeriod(window, &trig->window_us) &&
+         trig->stall_us <= trig->window_us;
+}
+
+/**
+ * @brief read the stall total a trigger watches
+ *
+ * @param trig the registered trigger
+ * @return the "some" or "full" stall total in microseconds
+ */
+static unsigned long long StallTotal(const struct psi_trigger *trig) {
+  char buf[256];
+  struct psi_resource res;
+  ssize_t len = pread(trig->fd, buf, sizeof(buf) - 1, 0);
+  if (len < 0) {
+    perror("pread");
+    exit(1);
+  }
+  buf[len] = '\0';
+  ParsePressure(buf, len, &res);
+  return trig->full ? res.full.total : res.some.total;
+}
+
+/**
+ * @brief register a trigger with the kernel
+ *
+ * Each trigger needs its own fd of the pressure file. The kernel only
+ * accepts windows from 500ms to 10s, and without CAP_SYS_RESOURCE only
+ * windows that are a multiple of 2s.
+ *
+ * @param trig the trigger, parsed with ParseTrigger
+ * @return 0 on success, -1 with errno set otherwise
+ */
+int OpenTrigger(struct psi_trigger *trig) {
+  char path[64];
+  char text[64];
+  snprintf(path, sizeof(path), "/proc/pressure/%s", psi_names[trig->resource]);
+  trig->fd = OpenProc(path, O_RDWR | O_NONBLOCK);
+  if (trig->fd < 0) {
+    return -1;
+  }
+  int len = snprintf(text, sizeof(text), "%s %lld %lld",
+                     trig->full ? "full" : "some", trig->stall_us,
+                     trig->window_us);
+  // the terminating '\0' is part of what the kernel expects
+  if (write(trig->fd, text, len + 1) < 0) {
+    int saved = errno;
+    close(trig->fd);
+    trig->fd = -1;
+    errno = saved;
+    return -1;
+  }
+  trig->start_ns = MonotonicNow();
+  trig->start_total = StallTotal(trig);
+  return 0;
+}
+
+/**
+ * @brief block until one of the triggers fires
+ *
+ * No time is spent while nothing happens: the process sleeps in poll() until
+ * the kernel signals POLLPRI on a trigger fd.
+ *
+ * @param trigs the registered triggers
+ * @param count number of triggers, at most PSI_MAX_TRIGGERS
+ * @return index of the first trigger that fired
+ */
+int WaitPressure(struct psi_trigger *trigs, int count) {
+  struct pollfd fds[PSI_MAX_TRIGGERS];
+  for (int i = 0; i < count; i++) {
+    fds[i].fd = trigs[i].fd;
+    fds[i].events = POLLPRI;
+    fds[i].revents = 0;
+  }
+  while (1) {
+    int ready = poll(fds, count, -1);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    } else if (ready < 0) {
+      perror("poll");
+      exit(1);
+    }
+    int first = -1;
+    for (int i = 0; i < count; i++) {
+      if (fds[i].revents & POLLERR) {
+        fprintf(stderr, "psi_stats: trigger on %s is gone\n",
+                psi_names[trigs[i].resource]);
+        exit(1);
+      } else if (fds[i].revents & POLLPRI) {
+        // the first windows of a new trigger also count the stall before
+        // it was registered; only believe them if it stalled since then
+        struct psi_trigger *t = &trigs[i];
+        if (MonotonicNow() - t->start_ns < t->window_us * 2000 &&
+            StallTotal(t) - t->start_total < (unsigned long long)t->stall_us) {
+          continue;
+        }
+        trigs[i].events++;
+        if (first < 0) {
+          first = i;
+        }
+      }
+    }
+    if (first >= 0) {
+      return first;
+    }
+  }
+}
+
+/**
+ * @brief Displaying the pressure of every resource
+ *
+ *    The averages over 10s, 60s and 300s are the kernel's; "now" is the
+ *    share of time tasks were stalled since the previous sample, from the
+ *    stall totals.
+ *
+ * @param out where to print
+ * @param pre the previous sample
+ * @param cur the current sample
+ */
+void PrintPressure(FILE *out, const struct psi_sample *pre,
+                   const struct psi_sample *cur) {
+  double usecs = (cur->time_ns - pre->time_ns) * 1e-3;
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Pressure ### (stalled %%: now / avg10 / avg60 / avg300)\n");
+  for (int r = 0; r < PSI_RESOURCES; r++) {
+    if (cur->fds[r] < 0) {
+      continue;
+    }
+    const struct psi_resource *a = &pre->res[r];
+    const struct psi_resource *b = &cur->res[r];
+    double some = usecs > 0 ? (b->some.total - a->some.total) * 100 / usecs : 0;
+    double full = usecs > 0 ? (b->full.total - a->full.total) * 100 / usecs : 0;
+    fprintf(out,
+            "%-7s some %6.2f / %6.2f / %6.2f / %6.2f  -- full %6.2f / %6.2f / "
+            "%6.2f / %6.2f\n",
+            psi_names[r], some, b->some.avg10, b->some.avg60, b->some.avg300,
+            full, b->full.avg10, b->full.avg60, b->full.avg300);
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef PSI_STATS_H
+#define PSI_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// the files of /proc/pressure that are read
+#define PSI_CPU 0
+#define PSI_MEMORY 1
+#define PSI_IO 2
+#define PSI_RESOURCES 3
+
+// the most triggers that can be waited for at once
+#define PSI_MAX_TRIGGERS 8
+
+/**
+ * @brief one "some" or "full" line of a pressure file
+ *
+ * The averages are the share of time in percent that tasks were stalled;
+ * total is the stall time in microseconds since boot.
+ */
+struct psi_line {
+  double avg10;
+  double avg60;
+  double avg300;
+  unsigned long long total;
+};
+
+/**
+ * @brief the pressure of one resource
+ */
+struct psi_resource {
+  struct psi_line some; // at least one task stalled
+  struct psi_line full; // all non-idle tasks stalled at the same time
+};
+
+/**
+ * @brief one sample of all pressure files, kept open between samples
+ */
+struct psi_sample {
+  int fds[PSI_RESOURCES];                   // -1 if the kernel lacks the file
+  struct psi_resource res[PSI_RESOURCES];
+  long long time_ns;                        // CLOCK_MONOTONIC of the sample
+};
+
+/**
+ * @brief a PSI trigger the kernel signals when a stall threshold is crossed
+ */
+struct psi_trigger {
+  int fd;              // the pressure file the trigger is registered on
+  int resource;        // e.g. PSI_MEMORY
+  int full;            // 1 for a "full" trigger, 0 for "some"
+  long long stall_us;  // stall time that fires the trigger ...
+  long long window_us; // ... within this window
+  long long events;    // number of times it fired
+  long long start_ns;  // CLOCK_MONOTONIC when it was registered
+  unsigned long long start_total; // stall total when it was registered
+};
+
+extern const char *const psi_names[PSI_RESOURCES];
+
+void InitPressure(struct psi_sample *sample);
+int ParsePressure(const char *buf, size_t len, struct psi_resource *res);
+void ReadPressure(struct psi_sample *sample);
+int ParseTrigger(const char *text, struct psi_trigger *trig);
+int OpenTrigger(struct psi_trigger *trig);
+int WaitPressure(struct psi_trigger *trigs, int count);
+void PrintPressure(FILE *out, const struct psi_sample *pre,
+                   const struct psi_sample *cur);
+
+#endif
@@ -0,0 +1,172 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cpu_stats.h"
+#include "memory_stats.h"
+#include "procfs.h"
+#include "psi_stats.h"
+#include "sched.h"
+
+// counters of the burst, allocated once
+static struct cpu_sample cpu_pre;
+static struct cpu_sample cpu_aft;
+static struct cpu_usage cpu_usage;
+
+/**
+ * @brief sample CPU, memory and pressure at a high rate right after a
+ * trigger fired
+ *
+ * @param psi the pressure sample, updated on every burst sample
+ * @param trig the trigger that fired
+ * @param size number of samples
+ * @param period_us time between samples in microseconds
+ * @return number of deadlines missed
+ */
+static long long Burst(struct psi_sample *psi, const struct psi_trigger *trig,
+                       int size, long long period_us) {
+  struct ticker ticker;
+  struct mem_usage mem;
+  struct psi_sample pre;
+  int r = trig->resource;
+
+  ReadCpuSample(&cpu_pre);
+  ReadPressure(psi);
+  InitTicker(&ticker, period_us, 0, 0);
+  fprintf(stdout, "----------------------------\n");
+  fprintf(stdout,
+          "### Pressure event ### %s %s %lld ms in %lld ms (event %lld)\n",
+          psi_names[r], trig->full ? "full" : "some", trig->stall_us / 1000,
+          trig->window_us / 1000, trig->events);
+  for (int i = 0; i < size; i++) {
+    WaitTick(&ticker);
+    MeasureCpu(&cpu_pre, &cpu_aft, &cpu_usage);
+    MeasureMemory(&mem);
+    pre = *psi;
+    ReadPressure(psi);
+    double some = (psi->res[r].some.total - pre.res[r].some.total) / 1e3;
+    double full = (psi->res[r].full.total - pre.res[r].full.total) / 1e3;
+    fprintf(stdout,
+            "+%7.1f ms  cpu %6.2f%% iowait %6.2f%%  -- %.2f GB / %.2f GB  -- "
+            "%s stalled some %.2f ms full %.2f ms\n",
+            (psi->time_ns - ticker.start) * 1e-6, cpu_usage.usage,
+            cpu_usage.iowait, mem.phys_used / 1e9, mem.total_phys / 1e9,
+            psi_names[r], some, full);
+  }
+  fflush(stdout);
+  return ticker.missed;
+}
+
+/**
+ * @brief main function for getting pressure stall info
+ *
+ * Sample once every 1 sec and sample total of 10 times in default, on
+ * absolute deadlines like the other collectors, showing how long tasks were
+ * stalled on CPU, memory and io.
+ * With one or more --trigger=RESOURCE:some|full:STALL:WINDOW, nothing is
+ * sampled until the kernel reports that tasks stalled for STALL within
+ * WINDOW; then --burst=N samples (20 in default) of CPU, memory and the
+ * pressure are taken every --burst-delay=T (10ms in default). --samples is
+ * then the number of events to wait for.
+ * With --root=DIR, DIR/proc/pressure is read instead; triggers need the
+ * live system.
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int main(int argc, char *argv[]) {
+  int sample_size = 10;
+  long long period = 1000000; // in microseconds
+  long long start = 0;        // tick 0 given by sys_monitoring_tool
+  long long real = 0;
+  struct ticker ticker;
+  struct psi_trigger trigs[PSI_MAX_TRIGGERS];
+  int trig_count = 0;
+  int burst_size = 20;
+  long long burst_period = 10000; // in microseconds
+  long long missed = 0;
+  struct psi_sample pre;
+  struct psi_sample cur;
+
+  // set the ctrl-c signal and ctrl-z to be ignored
+  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
+      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
+    perror("signal");
+    exit(1);
+  }
+
+  // loop through all command line arguments
+  // set corresponding flag
+  for (int i = 1; i < argc; i++) {
+    if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+        (sample_size > 0)) {
+      continue;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      continue;
+    } else if (ParseEpoch(argv[i], &start, &real)) {
+      continue;
+    } else if (ParseRoot(argv[i])) {
+      continue;
+    } else if (sscanf(argv[i], "--burst=%d", &burst_size) == 1 &&
+               burst_size > 0) {
+      continue;
+    } else if (strncmp(argv[i], "--burst-delay=", 14) == 0 &&
+               ParsePeriod(argv[i] + 14, &burst_period)) {
+      continue;
+    } else if (strncmp(argv[i], "--trigger=", 10) == 0) {
+      if (trig_count == PSI_MAX_TRIGGERS ||
+          !ParseTrigger(argv[i] + 10, &trigs[trig_count])) {
+        fprintf(stderr, "psi_stats: invalid trigger %s\n", argv[i] + 10);
+        exit(1);
+      }
+      trig_count++;
+    }
+  }
+
+  InitPressure(&cur);
+  ReadPressure(&cur);
+
+  if (trig_count == 0) {
+    InitTicker(&ticker, period, start, real);
+    for (int i = 0; i < sample_size; i++) {
+      WaitTick(&ticker);
+      pre = cur;
+      ReadPressure(&cur);
+      PrintPressure(stdout, &pre, &cur);
+      fflush(stdout);
+    }
+    missed = ticker.missed;
+  } else {
+    if (HasProcRoot()) {
+      fprintf(stderr, "psi_stats: triggers need the live /proc/pressure\n");
+      exit(1);
+    }
+    for (int i = 0; i < trig_count; i++) {
+      if (OpenTrigger(&trigs[i]) < 0) {
+        int saved = errno;
+        perror("psi trigger");
+        if (saved == EINVAL) {
+          fprintf(stderr, "psi_stats: the window must be 500ms to 10s, and a "
+                          "multiple of 2s without CAP_SYS_RESOURCE\n");
+        }
+        exit(1);
+      }
+    }
+    int core_num = GetCoreSlots();
+    InitCpuSample(&cpu_pre, core_num);
+    InitCpuSample(&cpu_aft, core_num);
+    InitCpuUsage(&cpu_usage, core_num);
+    for (int i = 0; i < sample_size; i++) {
+      int k = WaitPressure(trigs, trig_count);
+      missed += Burst(&cur, &trigs[k], burst_size, burst_period);
+    }
+  }
+  if (missed > 0) {
+    fprintf(stderr, "psi_stats: missed %lld deadlines\n", missed);
+  }
+}
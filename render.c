@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "render.h"
+
+/**
+ * @brief initialize the samples shown by sys_monitoring_tool
+ *
+ * @param s samples to initialize
+ * @param graphic_state if 1, then show samples in graphic form
+ * @param core_state if 1, then show the utilization of each core
+ */
+void InitSamples(struct samples *s, int graphic_state, int core_state) {
+  memset(s, 0, sizeof(*s));
+  s->graphic_state = graphic_state;
+  s->core_state = core_state;
+  InitCpuUsage(&s->cpu, GetCoreSlots());
+}
+
+/**
+ * @brief display the latest sample of the given collector
+ *
+ * The output is the same as the child program of that collector prints when
+ * run on its own.
+ *
+ * @param out where to print
+ * @param s latest samples
+ * @param source which collector to display
+ */
+void ShowSample(FILE *out, struct samples *s, int source) {
+  if (source == SOURCE_MEM) {
+    PrintMemory(out, &s->mem, s->pre_mem, s->graphic_state, 0);
+    s->pre_mem = (double)s->mem.phys_used;
+  } else if (source == SOURCE_USER) {
+    PrintUsers(out, &s->users);
+  } else {
+    // the cores of the sample, which need not be those of this machine
+    int online = 0;
+    for (int i = 0; i < s->cpu.core_count; i++) {
+      online += s->cpu.cores[i] >= 0;
+    }
+    fprintf(out, "----------------------------\n");
+    fprintf(out, "Number of cores: %d\n", online);
+    PrintCpu(out, &s->cpu, s->core_state);
+    if (s->graphic_state == 1) {
+      CpuGraph(out, s->cpu.usage);
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdio.h>
+
+#include "cpu_stats.h"
+#include "memory_stats.h"
+#include "user_stats.h"
+
+// the collectors whose output is shown by sys_monitoring_tool
+#define SOURCE_MEM 0
+#define SOURCE_USER 1
+#define SOURCE_CPU 2
+#define SOURCE_NUM 3
+
+struct metric_set;
+
+/**
+ * @brief latest sample of each collector, as displayed by sys_monitoring_tool
+ *
+ * Filled by the in-process collector threads, by decoding the frames sent by
+ * the child programs, or by parsing the files of a replayed capture.
+ */
+struct samples {
+  int graphic_state;      // if 1, then show samples in graphic form
+  int core_state;         // if 1, then show the utilization of each core
+  struct mem_usage mem;   // latest memory sample
+  struct user_list users; // latest user sample
+  struct cpu_usage cpu;   // latest cpu sample
+  double pre_mem;         // last shown used memory, for MemroyGraph
+  long long timestamp[SOURCE_NUM]; // CLOCK_REALTIME of each latest sample
+  long long missed[SOURCE_NUM];    // deadlines each collector missed so far
+  long long interval[SOURCE_NUM];  // nanoseconds each latest sample covers
+  const struct metric_set *metrics; // statistics to show, NULL if none
+};
+
+void InitSamples(struct samples *s, int graphic_state, int core_state);
+void ShowSample(FILE *out, struct samples *s, int source);
+
+#endif
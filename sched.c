@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sched.h"
+
+/**
+ * @brief get the current CLOCK_MONOTONIC time
+ *
+ * @return nanoseconds
+ */
+long long MonotonicNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief get the current CLOCK_REALTIME time
+ *
+ * @return nanoseconds since the epoch
+ */
+long long RealtimeNow() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief parse a sampling period such as "2", "0.5", "2s", "500ms" or "250us"
+ *
+ * A number without unit is in seconds.
+ *
+ * @param text the period
+ * @param period_us where to store the period in microseconds
+ * @return 1 if text is a valid period of at least one microsecond, 0 otherwise
+ */
+int ParsePeriod(const char *text, long long *period_us) {
+  char *end;
+  double value = strtod(text, &end);
+  if (end == text) {
+    return 0;
+  }
+  double scale;
+  if (strcmp(end, "") == 0 || strcmp(end, "s") == 0) {
+    scale = 1e6;
+  } else if (strcmp(end, "ms") == 0) {
+    scale = 1e3;
+  } else if (strcmp(end, "us") == 0) {
+    scale = 1;
+  } else {
+    return 0;
+  }
+  if (!(value * scale >= 1) || value * scale > 1e15) {
+    return 0;
+  }
+  *period_us = (long long)(value * scale + 0.5);
+  return 1;
+}
+
+/**
+ * @brief parse the --epoch=MONO,REAL argument sys_monitoring_tool passes to
+ * its child programs, so all of them wake on the same ticks
+ *
+ * @param arg the command line argument
+ * @param start where to store CLOCK_MONOTONIC of tick 0
+ * @param real where to store CLOCK_REALTIME of tick 0
+ * @return 1 if arg is an epoch argument, 0 otherwise
+ */
+int ParseEpoch(const char *arg, long long *start, long long *real) {
+  return sscanf(arg, "--epoch=%lld,%lld", start, real) == 2;
+}
+
+/**
+ * @brief parse the --adaptive=MIN,MAX argument, e.g. --adaptive=250ms,10s
+ *
+ * @param arg the command line argument
+ * @param min_us where to store the shortest period in microseconds
+ * @param max_us where to store the longest period in microseconds
+ * @return 1 if arg is a valid adaptive argument, 0 otherwise
+ */
+int ParseAdaptive(const char *arg, long long *min_us, long long *max_us) {
+  char text[64];
+  if (strncmp(arg, "--adaptive=", 11) != 0 ||
+      strlen(arg + 11) >= sizeof(text)) {
+    return 0;
+  }
+  strcpy(text, arg + 11);
+  char *comma = strchr(text, ',');
+  if (comma == NULL) {
+    return 0;
+  }
+  *comma = '\0';
+  long long lo, hi;
+  if (!ParsePeriod(text, &lo) || !ParsePeriod(comma + 1, &hi) || hi < lo) {
+    return 0;
+  }
+  *min_us = lo;
+  *max_us = hi;
+  return 1;
+}
+
+/**
+ * @brief initialize a ticker, the first tick is one period after start
+ *
+ * @param t ticker to initialize
+ * @param period_us microseconds between ticks
+ * @param start CLOCK_MONOTONIC of tick 0 in nanoseconds, 0 for now
+ * @param real CLOCK_REALTIME of tick 0 in nanoseconds, 0 for now
+ */
+void InitTicker(struct ticker *t, long long period_us, long long start,
+                long long real) {
+  t->start = start != 0 ? start : MonotonicNow();
+  t->real = real != 0 ? real : RealtimeNow();
+  t->period = period_us * 1000;
+  t->tick = 1;
+  t->missed = 0;
+  t->last = 0;
+  t->interval = 0;
+  t->stride = 1;
+  t->max_stride = 1;
+  t->calm = 0;
+}
+
+/**
+ * @brief let a ticker stretch the time between samples up to a maximum
+ *
+ * The period the ticker was initialized with is the shortest. Samples stay
+ * on its ticks, and a stride of 2^k only samples on multiples of 2^k, so
+ * collectors that slowed down alike still sample on the same ticks.
+ *
+ * @param t the ticker
+ * @param max_us the longest time between samples in microseconds
+ */
+void SetAdaptive(struct ticker *t, long long max_us) {
+  t->max_stride = 1;
+  while (t->max_stride * 2 * t->period <= max_us * 1000) {
+    t->max_stride *= 2;
+  }
+}
+
+/**
+ * @brief sleep until the next tick is due
+ *
+ * If a whole stride or more already passed since the tick was due, the
+ * samples that can no longer be kept are skipped and counted as missed, so
+ * sampling stays on the grid instead of drifting.
+ *
+ * @param t the ticker
+ * @return the tick that was waited for
+ */
+long long WaitTick(struct ticker *t) {
+  long long now = MonotonicNow();
+  long long step = t->stride * t->period;
+  long long deadline = t->start + t->tick * t->period;
+  if (now >= deadline + step) {
+    long long behind = (now - deadline) / step;
+    t->missed += behind;
+    t->tick += behind * t->stride;
+    deadline += behind * step;
+  }
+  struct timespec ts = {deadline / 1000000000LL, deadline % 1000000000LL};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+  t->interval = (t->tick - t->last) * t->period;
+  t->last = t->tick;
+  t->tick += t->stride;
+  return t->last;
+}
+
+/**
+ * @brief adapt the time until the next sample to how fast the values move
+ *
+ * A change of ADAPT_FAST or more drops back to a sample every tick at once,
+ * so a spike is followed closely. After ADAPT_CALM_SAMPLES samples in a row
+ * that changed less than half of that, the stride doubles, up to the one
+ * set with SetAdaptive. Does nothing for a ticker that is not adaptive.
+ *
+ * @param t the ticker, right after a sample
+ * @param change how much the sample changed since the one before, in
+ * percentage points, either sign
+ */
+void AdaptTicker(struct ticker *t, double change) {
+  if (t->max_stride == 1) {
+    return;
+  }
+  change = change < 0 ? -change : change;
+  if (change >= ADAPT_FAST) {
+    t->stride = 1;
+    t->calm = 0;
+  } else if (change < ADAPT_FAST / 2 && ++t->calm >= ADAPT_CALM_SAMPLES) {
+    t->stride = t->stride * 2 <= t->max_stride ? t->stride * 2 : t->stride;
+    t->calm = 0;
+  } else if (change >= ADAPT_FAST / 2) {
+    t->calm = 0;
+  }
+  // the next sample is on the next multiple of the stride
+  t->tick = (t->last / t->stride + 1) * t->stride;
+}
+
+/**
+ * @brief get the wall clock time a tick was due, for timestamping samples
+ *
+ * All collectors with the same start stamp the same tick identically.
+ *
+ * @param t the ticker
+ * @param tick the tick
+ * @return CLOCK_REALTIME in nanoseconds
+ */
+long long TickTime(const struct ticker *t, long long tick) {
+  return t->real + tick * t->period;
+}
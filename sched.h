@@ -0,0 +1,42 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+/**
+ * @brief scheduler waking on absolute CLOCK_MONOTONIC deadlines
+ *
+ * Tick k is due at start + k * period, so the time spent sampling never adds
+ * up over a run. Collectors sharing the same start wake on the same ticks,
+ * even in different processes, since CLOCK_MONOTONIC is system wide.
+ */
+struct ticker {
+  long long start;  // CLOCK_MONOTONIC of tick 0 in nanoseconds
+  long long real;   // CLOCK_REALTIME of tick 0 in nanoseconds
+  long long period; // nanoseconds between ticks
+  long long tick;   // next tick to wait for
+  long long missed; // ticks skipped because sampling took too long
+  long long last;   // tick of the latest sample, 0 before the first
+  long long interval;   // nanoseconds between the last two samples
+  long long stride;     // ticks between samples, 1 unless adaptive
+  long long max_stride; // largest stride AdaptTicker may reach
+  int calm;             // samples in a row that barely changed
+};
+
+// change between two samples, in percentage points, that counts as fast
+#define ADAPT_FAST 2.0
+// samples in a row changing less than half of ADAPT_FAST before the stride
+// doubles
+#define ADAPT_CALM_SAMPLES 3
+
+long long MonotonicNow();
+long long RealtimeNow();
+int ParsePeriod(const char *text, long long *period_us);
+int ParseEpoch(const char *arg, long long *start, long long *real);
+int ParseAdaptive(const char *arg, long long *min_us, long long *max_us);
+void InitTicker(struct ticker *t, long long period_us, long long start,
+                long long real);
+void SetAdaptive(struct ticker *t, long long max_us);
+long long WaitTick(struct ticker *t);
+void AdaptTicker(struct ticker *t, double change);
+long long TickTime(const struct ticker *t, long long tick);
+
+#endif
@@ -0,0 +1,244 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "screen.h"
+
+/**
+ * @brief initialize a screen drawn at the current cursor position
+ *
+ * @param s screen to initialize
+ */
+void InitScreen(struct screen *s) {
+  struct winsize ws;
+  memset(s, 0, sizeof(*s));
+  s->cols = 80; // when stdout is not a terminal
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+    s->cols = ws.ws_col;
+  }
+  s->frame = open_memstream(&s->text, &s->text_len);
+  s->out_size = 4096;
+  s->out = malloc(s->out_size);
+  if (s->frame == NULL || s->out == NULL) {
+    perror("open_memstream");
+    exit(1);
+  }
+}
+
+/**
+ * @brief start a new frame
+ *
+ * @param s the screen
+ * @return the stream to print the frame into
+ */
+FILE *BeginFrame(struct screen *s) {
+  rewind(s->frame);
+  return s->frame;
+}
+
+/**
+ * @brief make sure row exists in the new frame and clear it
+ *
+ * @param s the screen
+ * @param row the row
+ */
+static void ClearRow(struct screen *s, int row) {
+  if (row >= s->cap_rows) {
+    s->cap_rows = s->cap_rows == 0 ? 64 : s->cap_rows * 2;
+    s->cells = realloc(s->cells, (size_t)s->cap_rows * s->cols);
+    s->shown = realloc(s->shown, (size_t)s->cap_rows * s->cols);
+    if (s->cells == NULL || s->shown == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  memset(s->cells + (size_t)row * s->cols, ' ', s->cols);
+}
+
+/**
+ * @brief lay the text of the frame out into rows of cells
+ *
+ * Lines longer than a row wrap into the next one, like on the terminal, and
+ * tabs are expanded to spaces.
+ *
+ * @param s the screen
+ * @param text the frame
+ * @param len bytes in text
+ */
+static void LayoutFrame(struct screen *s, const char *text, size_t len) {
+  int row = 0;
+  int col = 0;
+  ClearRow(s, 0);
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    int n = 1;
+    if (c == '\n') {
+      ClearRow(s, ++row);
+      col = 0;
+      continue;
+    } else if (c == '\t') {
+      c = ' ';
+      n = 8 - col % 8;
+    } else if ((unsigned char)c < ' ') {
+      continue; // no escape sequences inside a frame
+    }
+    while (n-- > 0) {
+      if (col == s->cols) {
+        ClearRow(s, ++row);
+        col = 0;
+      }
+      s->cells[(size_t)row * s->cols + col++] = c;
+    }
+  }
+  s->rows = col > 0 ? row + 1 : row;
+}
+
+/**
+ * @brief add bytes to the output of the frame
+ *
+ * @param s the screen
+ * @param data bytes to add
+ * @param len number of bytes
+ */
+static void Append(struct screen *s, const char *data, size_t len) {
+  if (s->out_len + len > s->out_size) {
+    while (s->out_len + len > s->out_size) {
+      s->out_size *= 2;
+    }
+    s->out = realloc(s->out, s->out_size);
+    if (s->out == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  memcpy(s->out + s->out_len, data, len);
+  s->out_len += len;
+}
+
+/**
+ * @brief add a cursor movement escape sequence to the output
+ *
+ * @param s the screen
+ * @param n how far to move
+ * @param dir A (up), B (down) or C (right)
+ */
+static void AppendMove(struct screen *s, int n, char dir) {
+  char seq[16];
+  Append(s, seq, snprintf(seq, sizeof(seq), "\033[%d%c", n, dir));
+}
+
+/**
+ * @brief move the cursor down to the start of a row
+ *
+ * Rows already on the terminal are skipped with one escape sequence; below
+ * them new lines are needed, so the terminal scrolls if it has to.
+ *
+ * @param s the screen
+ * @param cur row of the cursor, updated
+ * @param exist rows that exist on the terminal, updated
+ * @param row the row to move to
+ */
+static void MoveDown(struct screen *s, int *cur, int *exist, int row) {
+  int skip = (row < *exist ? row : *exist) - *cur;
+  if (skip > 1) {
+    AppendMove(s, skip, 'B');
+    *cur += skip;
+  }
+  while (*cur < row) {
+    Append(s, "\n", 1);
+    (*cur)++;
+  }
+  if (*cur > *exist) {
+    *exist = *cur;
+  }
+}
+
+/**
+ * @brief write everything in the buffer to stdout
+ *
+ * @param buf what to write
+ * @param len number of bytes
+ */
+static void WriteAll(const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDOUT_FILENO, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("write");
+      exit(1);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+/**
+ * @brief draw the frame, writing only the cells that changed
+ *
+ * The cursor is left at the start of the row below the frame, so anything
+ * printed afterwards follows it.
+ *
+ * @param s the screen
+ */
+void EndFrame(struct screen *s) {
+  fflush(s->frame);
+  LayoutFrame(s, s->text, ftell(s->frame));
+  if (s->rows == s->shown_rows &&
+      memcmp(s->cells, s->shown, (size_t)s->rows * s->cols) == 0) {
+    return; // nothing changed, nothing to write
+  }
+  s->out_len = 0;
+  if (s->shown_rows > 0) {
+    AppendMove(s, s->shown_rows, 'A'); // back to the top of the frame
+  }
+  Append(s, "\r", 1);
+  int cur = 0;
+  int exist = s->shown_rows; // the cursor row below the frame exists too
+  for (int r = 0; r < s->rows; r++) {
+    const char *cells = s->cells + (size_t)r * s->cols;
+    const char *shown = r < s->shown_rows ? s->shown + (size_t)r * s->cols
+                                          : NULL;
+    int first = 0;
+    int last = s->cols - 1;
+    if (shown != NULL) {
+      while (first < s->cols && cells[first] == shown[first]) {
+        first++;
+      }
+      if (first == s->cols) {
+        continue; // row did not change
+      }
+      while (cells[last] == shown[last]) {
+        last--;
+      }
+    } else {
+      while (last >= 0 && cells[last] == ' ') {
+        last--; // a new row, trailing blanks are already blank
+      }
+    }
+    MoveDown(s, &cur, &exist, r);
+    if (last >= first) {
+      if (first > 0) {
+        AppendMove(s, first, 'C');
+      }
+      Append(s, cells + first, last - first + 1);
+      Append(s, "\r", 1);
+    }
+  }
+  MoveDown(s, &cur, &exist, s->rows);
+  if (s->rows < s->shown_rows) {
+    Append(s, "\033[J", 3); // erase the rows the frame no longer has
+  }
+
+  fflush(stdout); // whatever was printed before the frame comes first
+  WriteAll(s->out, s->out_len);
+
+  char *tmp = s->shown;
+  s->shown = s->cells;
+  s->cells = tmp;
+  s->shown_rows = s->rows;
+}
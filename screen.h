@@ -0,0 +1,34 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief region of the terminal redrawn in place, one frame at a time
+ *
+ * A frame is printed into an in-memory stream, laid out into rows of cells
+ * and compared with the frame on the terminal. Only the cells that changed
+ * are written, together with the cursor moves to reach them, in a single
+ * write().
+ */
+struct screen {
+  int cols;        // cells per row, the width of the terminal
+  FILE *frame;     // stream the next frame is printed into
+  char *text;      // buffer of frame
+  size_t text_len; // size of text, as maintained by open_memstream
+  char *cells;     // rows of the new frame, cols cells each
+  char *shown;     // rows on the terminal
+  int cap_rows;    // rows cells and shown have room for
+  int rows;        // rows of the new frame
+  int shown_rows;  // rows on the terminal
+  char *out;       // escape sequences and cells to write
+  size_t out_len;  // bytes in out
+  size_t out_size; // size of out
+};
+
+void InitScreen(struct screen *s);
+FILE *BeginFrame(struct screen *s);
+void EndFrame(struct screen *s);
+
+#endif
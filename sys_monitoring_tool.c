@@ -1,4 +1,9 @@
+#define _GNU_SOURCE // for memrchr
+
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,8 +11,23 @@
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "alert.h"
+#include "capture.h"
+#include "cluster.h"
+#include "collector.h"
+#include "daemon.h"
+#include "export.h"
+#include "frame.h"
+#include "history.h"
+#include "metrics.h"
+#include "procfs.h"
+#include "profile.h"
+#include "screen.h"
+#include "sched.h"
+
 /**
  * @brief handler for control c signal
  *
@@ -31,6 +51,7 @@ void ctrlc_handler(int sig) {
     }
     printf("\x1b[1F"); // move up one line
     printf("\033[2K"); // erase the line
+    fflush(stdout);
   }
 }
 
@@ -49,6 +70,7 @@ void ctrlz_handler(int sig) {
     exit(1);
   }
   printf("\033[2D"); // erase "^Z"
+  fflush(stdout);
 }
 
 /**
@@ -64,45 +86,6 @@ void set_signals() {
   }
 }
 
-/**
- * @brief save current cursor position
- *
- */
-void saveCursorPosition(void) {
-  // printf("\x1B[s"); // Send ANSI escape sequence to save cursor position.
-  printf("\0337");
-}
-
-/**
- * @brief restore the most recently saved cursor position
- *
- */
-void restoreCursorPosition(void) {
-  // printf("\x1B[u"); // Send ANSI escape sequence to restore cursor
-  // position.
-  printf("\0338");
-}
-
-/**
- * @brief read output writte in the given result file
- *
- * @param read_file
- */
-void read_output(FILE *read_file) {
-  char result[512];
-  const char *special_string = "##SPECIAL_STRING##";
-  while (fgets(result, 512, read_file) != NULL) {
-    // read from pip line by line
-    if (strncmp(result, special_string, strlen(special_string)) == 0) {
-      // if read the special string indicating one iteration done
-      // break the loop
-      break;
-    } else {
-      printf("%s", result);
-    }
-  }
-}
-
 /**
  * @brief Displaying memory used by the current program in unit of kilobytes
  *
@@ -151,14 +134,56 @@ void ShowSystemInfo() {
   printf("----------------------------\n");
 }
 
+/**
+ * @brief where the output of each collector comes from
+ *
+ * Either the frames sent through the pipes of the child programs, with
+ * --threads the in-process collector, or with --replay a capture file.
+ */
+struct sources {
+  struct frame_reader readers[SOURCE_NUM]; // pipe of each child program
+  struct collector *collector;      // NULL unless running in-process
+  struct replay *replay;            // NULL unless a capture is replayed
+  struct history *history;          // NULL unless samples are recorded
+  struct metric_set *metrics;       // NULL unless --stats or --alert given
+  struct alerts *alerts;            // NULL unless --alert given
+  int format;                       // FORMAT_SCREEN unless samples are records
+  struct samples samples;           // latest sample of each collector
+  struct mem_usage *mem_rows;       // every memory sample, NULL if not shown
+  int sample_size;                  // samples expected from each collector
+  long long period;                 // microseconds between samples
+  int wanted[SOURCE_NUM];           // which collectors were started
+  int received[SOURCE_NUM];         // number of samples received
+  int done[SOURCE_NUM];             // collector sent all samples or ended
+  struct timespec last[SOURCE_NUM]; // when the latest sample arrived
+};
+
+// name of each collector in messages
+static const char *source_names[SOURCE_NUM] = {"memory", "user", "cpu"};
+
+// how often to check for late collectors while nothing arrives
+#define LATE_CHECK_MS 250
+
 /**
  * @brief create child process for running independent c program
  *
+ * The program is looked up in the directory sys_monitoring_tool itself was
+ * started from, so the tool can be run from any working directory.
+ *
  * @param fd reserved space for pipe fds
  * @param file indicate which c program to run
  * @param argv arguments passed to the child c program
  */
 void RunStats(int *fd, char *file, char *argv[]) {
+  char path[4096];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  char *slash = len > 0 ? memrchr(path, '/', len) : NULL;
+  if (slash != NULL && slash - path + 1 + strlen(file) < sizeof(path)) {
+    strcpy(slash + 1, file);
+  } else {
+    snprintf(path, sizeof(path), "./%s", file); // fall back to current dir
+  }
+
   // creating pipe
   if (pipe(fd) < 0) {
     perror("pipe()");
@@ -173,8 +198,8 @@ void RunStats(int *fd, char *file, char *argv[]) {
   }
 
   if (id == 0) {
-    // child process 1, reponsible for memory usage
-    // close all read fds and the write fds that wont be used
+    // child process, reponsible for one kind of statistics
+    // close the read fd that wont be used
 
     close(fd[0]);
 
@@ -183,113 +208,622 @@ void RunStats(int *fd, char *file, char *argv[]) {
       perror("dup2");
       exit(1);
     }
-    // Run "memory_stats" command
-    execvp(file, argv);
-    // otherwise execlp fail, display erro message
-    perror("execlp");
+    // Run the stats program
+    execv(path, argv);
+    // otherwise execv fail, display erro message
+    perror("execv");
     exit(1);
   }
 }
 
 /**
- * @brief run all three child programs and read outputs in main process
+ * @brief run one child program and start reading frames from its pipe
  *
- * @param sample_size
- * @param sequential_state if 1, then print output in sequential form
- * @param system_state if 1, then dont print user info
- * @param mem_argv arguments array passed to memory child program
- * @param user_argv arguments array passed to user child program
- * @param cpu_argv arguments array passed to cpu child program
+ * @param src where to store the reader of the pipe
+ * @param source which collector the child program is
+ * @param file indicate which c program to run
+ * @param argv arguments passed to the child c program
+ */
+void OpenStats(struct sources *src, int source, char *file, char *argv[]) {
+  int fd[2];
+  RunStats(fd, file, argv);
+  // we are in parent process, close the write fd
+  close(fd[1]);
+  InitFrameReader(&src->readers[source], fd[0]);
+}
+
+/**
+ * @brief prepare the bookkeeping of the collectors before they are started
+ *
+ * @param src sources to initialize
+ * @param wanted for each collector, 1 if it will be started
+ * @param sample_size samples expected from each collector
+ * @param period microseconds between samples
+ * @param graphic_state if 1, then show samples in graphic form
+ * @param core_state if 1, then show the utilization of each core
+ */
+void InitSources(struct sources *src, const int *wanted, int sample_size,
+                 long long period, int graphic_state, int core_state) {
+  memset(src, 0, sizeof(*src));
+  InitSamples(&src->samples, graphic_state, core_state);
+  src->sample_size = sample_size;
+  src->period = period;
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    src->wanted[i] = wanted[i];
+    src->done[i] = !wanted[i];
+    clock_gettime(CLOCK_MONOTONIC, &src->last[i]);
+  }
+}
+
+/**
+ * @brief append the latest sample of a collector to the history file
+ *
+ * @param src the sources, with a history
+ * @param source which collector the sample came from
+ */
+void RecordSample(struct sources *src, int source) {
+  struct frame_header hdr;
+  struct frame_parts p;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.seq = src->received[source];
+  hdr.missed = src->samples.missed[source];
+  hdr.timestamp = src->samples.timestamp[source];
+  hdr.interval = src->samples.interval[source];
+  if (source == SOURCE_MEM) {
+    PackMemFrame(&hdr, &src->samples.mem, &p);
+  } else if (source == SOURCE_USER) {
+    PackUserFrame(&hdr, &src->samples.users, &p);
+  } else {
+    PackCpuFrame(&hdr, &src->samples.cpu, &p);
+  }
+  AppendHistory(src->history, &hdr, &p);
+}
+
+/**
+ * @brief record that a sample of the given collector arrived
+ *
+ * The sample itself is already stored in src->samples, and is appended to
+ * the history file if there is one. With --format it is printed as a record
+ * right away. Its statistics are updated and the alert rules checked.
+ *
+ * @param src the sources
+ * @param source which collector the sample came from
+ */
+void CountSample(struct sources *src, int source) {
+  if (src->history != NULL) {
+    RecordSample(src, source);
+  }
+  if (src->format != FORMAT_SCREEN) {
+    PrintRecord(stdout, src->format, &src->samples, source,
+                src->received[source]);
+  }
+  if (src->metrics != NULL) {
+    UpdateMetrics(src->metrics, &src->samples, source);
+    if (src->alerts != NULL) {
+      CheckAlerts(src->alerts, src->metrics, source);
+    }
+  }
+  if (source == SOURCE_MEM && src->mem_rows != NULL &&
+      src->received[source] < src->sample_size) {
+    src->mem_rows[src->received[source]] = src->samples.mem;
+  }
+  src->received[source]++;
+  if (src->received[source] >= src->sample_size) {
+    src->done[source] = 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &src->last[source]);
+}
+
+/**
+ * @brief decode a frame of a child program into the latest samples
+ *
+ * @param src the sources
+ * @param source which collector sent the frame
+ * @param hdr header of the frame
+ * @param payload payload of the frame
+ * @return 0 on success, -1 if the frame is malformed
+ */
+int DecodeSource(struct sources *src, int source,
+                 const struct frame_header *hdr, const char *payload) {
+  src->samples.timestamp[source] = hdr->timestamp;
+  src->samples.missed[source] = hdr->missed;
+  src->samples.interval[source] = hdr->interval;
+  if (hdr->type == FRAME_MEM && source == SOURCE_MEM) {
+    return DecodeMemFrame(payload, hdr->len, &src->samples.mem);
+  } else if (hdr->type == FRAME_USER && source == SOURCE_USER) {
+    return DecodeUserFrame(payload, hdr->len, &src->samples.users);
+  } else if (hdr->type == FRAME_CPU && source == SOURCE_CPU) {
+    return DecodeCpuFrame(payload, hdr->len, &src->samples.cpu);
+  }
+  return -1;
+}
+
+/**
+ * @brief take the next frame already buffered for a child program, if any
+ *
+ * @param src the sources
+ * @param source which collector to check
+ * @return 1 if a sample was taken, 0 otherwise
+ */
+int TakeBuffered(struct sources *src, int source) {
+  struct frame_header hdr;
+  const char *payload;
+  do {
+    if (NextFrame(&src->readers[source], &hdr, &payload) == 0) {
+      return 0;
+    }
+    // the profile of the child program comes after its last sample
+  } while (hdr.type == FRAME_STATS && DecodeStatsFrame(payload, hdr.len) == 0);
+  if (DecodeSource(src, source, &hdr, payload) < 0) {
+    fprintf(stderr, "%s collector sent a bad frame\n", source_names[source]);
+    return 0;
+  }
+  CountSample(src, source);
+  return 1;
+}
+
+/**
+ * @brief wait until any collector delivers a sample or ends
+ *
+ * The pipes of all child programs are multiplexed with poll(), so a slow
+ * collector never delays the samples of the others.
+ * With --replay, the next sample is taken from the capture once it is due.
+ *
+ * @param src the sources
+ * @param timeout_ms how long to wait at most, in milliseconds
+ * @return 1 if something arrived, 0 on timeout
  */
-void ShowDefault(int sample_size, int sequential_state, int system_state,
-                 char *mem_argv[], char *user_argv[], char *cpu_argv[]) {
-  // initial fds
-  int mem_fd[2];
-  int user_fd[2];
-  int cpu_fd[2];
-  char *mem = "./memory_stats";
-  char *user = "./user_stats";
-  char *cpu = "./cpu_stats";
-
-  RunStats(mem_fd, mem, mem_argv);
-  RunStats(user_fd, user, user_argv);
-  RunStats(cpu_fd, cpu, cpu_argv);
-
-  // else we are in parent process
-  // close all write fds
-  close(cpu_fd[1]);
-  close(mem_fd[1]);
-  close(user_fd[1]);
-
-  // struct file for each of read fds
-  // therefore we can use fgets later
-  FILE *mem_file = fdopen(mem_fd[0], "r");
-  FILE *user_file = fdopen(user_fd[0], "r");
-  FILE *cpu_file = fdopen(cpu_fd[0], "r");
-  if ((mem_file == NULL) || (user_file == NULL) || (cpu_file == NULL)) {
-    perror("fdopen");
+int NextSample(struct sources *src, int timeout_ms) {
+  if (src->replay != NULL) {
+    int source =
+        NextReplayed(src->replay, src->wanted, &src->samples, timeout_ms);
+    if (source < 0) {
+      return 0;
+    }
+    CountSample(src, source);
+    return 1;
+  }
+  if (src->collector != NULL) {
+    int source = WaitCollected(src->collector, &src->samples, timeout_ms);
+    if (source < 0) {
+      return 0;
+    }
+    CountSample(src, source);
+    return 1;
+  }
+
+  // frames that arrived together with an earlier one come first
+  struct pollfd fds[SOURCE_NUM];
+  int which[SOURCE_NUM];
+  int nfds = 0;
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (src->done[i]) {
+      continue;
+    }
+    long long stage = StageStart();
+    if (TakeBuffered(src, i)) {
+      StageEnd(i, STAGE_RECEIVE, stage); // parts are numbered as sources
+      return 1;
+    }
+    fds[nfds].fd = src->readers[i].fd;
+    fds[nfds].events = POLLIN;
+    which[nfds] = i;
+    nfds++;
+  }
+  if (nfds == 0) {
+    return 0;
+  }
+  int n = poll(fds, nfds, timeout_ms);
+  if (n < 0) {
+    if (errno == EINTR) {
+      return 0; // interrupted by ctrl-c or ctrl-z
+    }
+    perror("poll");
     exit(1);
   }
+  int got = 0;
+  for (int k = 0; k < nfds; k++) {
+    if (fds[k].revents == 0) {
+      continue;
+    }
+    int i = which[k];
+    long long stage = StageStart();
+    if (FillFrameReader(&src->readers[i]) == 0) {
+      src->done[i] = 1; // child program ended
+      got = 1;
+    } else if (TakeBuffered(src, i)) {
+      StageEnd(i, STAGE_RECEIVE, stage);
+      got = 1;
+    }
+  }
+  return got;
+}
+
+/**
+ * @brief check whether a collector has not delivered for two periods
+ *
+ * @param src the sources
+ * @param source which collector to check
+ * @return 1 if the collector is late, 0 otherwise
+ */
+int IsLate(struct sources *src, int source) {
+  if (src->done[source] || src->replay != NULL) {
+    return 0; // a replayed sample is held back on purpose
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double waited = (now.tv_sec - src->last[source].tv_sec) +
+                  (now.tv_nsec - src->last[source].tv_nsec) * 1e-9;
+  return waited > 2e-6 * src->period;
+}
+
+/**
+ * @brief get which collectors are late, one bit for each collector
+ *
+ * @param src the sources
+ * @return the bits of the late collectors
+ */
+int LateMask(struct sources *src) {
+  int mask = 0;
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (IsLate(src, i)) {
+      mask |= 1 << i;
+    }
+  }
+  return mask;
+}
+
+/**
+ * @brief display the latest sample of a collector, noting if it is late
+ *
+ * @param out where to print
+ * @param src the sources
+ * @param source SOURCE_USER or SOURCE_CPU
+ */
+void ShowBlock(FILE *out, struct sources *src, int source) {
+  if (src->received[source] > 0) {
+    ShowSample(out, &src->samples, source);
+  }
+  if (IsLate(src, source)) {
+    fprintf(out, "(%s collector is late)\n", source_names[source]);
+  }
+}
+
+/**
+ * @brief display the memory row of the given iteration
+ *
+ * @param out where to print
+ * @param src the sources
+ * @param i the iteration
+ */
+void ShowMemoryRow(FILE *out, struct sources *src, int i) {
+  if (i < src->received[SOURCE_MEM]) {
+    double pre = i > 0 ? (double)src->mem_rows[i - 1].phys_used : 0;
+    PrintMemory(out, &src->mem_rows[i], pre, src->samples.graphic_state, 0);
+  } else if (IsLate(src, SOURCE_MEM)) {
+    fprintf(out, "(%s collector is late)\n", source_names[SOURCE_MEM]);
+  } else {
+    fputc('\n', out);
+  }
+}
+
+/**
+ * @brief display how many deadlines each collector missed, if any
+ *
+ * @param out where to print
+ * @param src the sources
+ */
+void ShowMissed(FILE *out, struct sources *src) {
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (src->samples.missed[i] > 0) {
+      fprintf(out, "(%s collector missed %lld deadlines)\n", source_names[i],
+              src->samples.missed[i]);
+    }
+  }
+}
+
+/**
+ * @brief display the statistics of every metric and the state of the rules
+ *
+ * @param out where to print
+ * @param src the sources
+ */
+void ShowStatistics(FILE *out, struct sources *src) {
+  if (src->samples.metrics != NULL) {
+    fprintf(out, "----------------------------\n");
+    fprintf(out, "### Statistics ### (memory in GB, cpu in %%)\n");
+    for (int i = 0; i < SOURCE_NUM; i++) {
+      PrintMetrics(out, src->metrics, i);
+    }
+  }
+  if (src->alerts != NULL) {
+    fprintf(out, "----------------------------\n");
+    fprintf(out, "### Alerts ###\n");
+    PrintAlerts(out, src->alerts, src->metrics);
+  }
+}
+
+/**
+ * @brief redraw everything received so far, in refreshing form
+ *
+ * The frame is built in memory and only the cells that changed since the
+ * previous one are written to the terminal.
+ *
+ * @param screen the screen to draw on
+ * @param src the sources
+ * @param user_state if 1, then only user info is shown
+ */
+void DrawScreen(struct screen *screen, struct sources *src, int user_state) {
+  long long stage = StageStart();
+  FILE *out = BeginFrame(screen);
+  if (user_state == 0) {
+    for (int i = 0; i < src->sample_size; i++) {
+      ShowMemoryRow(out, src, i);
+    }
+  }
+  if (src->wanted[SOURCE_USER] == 1) {
+    ShowBlock(out, src, SOURCE_USER);
+  }
+  if (src->wanted[SOURCE_CPU] == 1) {
+    ShowBlock(out, src, SOURCE_CPU);
+  }
+  ShowStatistics(out, src);
+  ShowMissed(out, src);
+  EndFrame(screen);
+  StageEnd(PROFILE_MONITOR, STAGE_RENDER, stage);
+}
+
+/**
+ * @brief check whether iteration i can be shown in sequential form
+ *
+ * It can once every collector delivered it, ended or is late.
+ *
+ * @param src the sources
+ * @param i the iteration
+ * @return 1 if it can be shown, 0 otherwise
+ */
+int IterationReady(struct sources *src, int i) {
+  int any = 0;
+  int all_done = 1;
+  for (int s = 0; s < SOURCE_NUM; s++) {
+    if (src->received[s] > i) {
+      any = 1;
+    } else if (!src->done[s] && !IsLate(src, s)) {
+      return 0;
+    }
+    all_done = all_done && src->done[s];
+  }
+  return any || all_done;
+}
+
+/**
+ * @brief display iteration i in sequential form
+ *
+ * @param src the sources
+ * @param i the iteration
+ * @param user_state if 1, then only user info is shown
+ */
+void ShowIteration(struct sources *src, int i, int user_state) {
+  long long stage = StageStart();
+  printf(">>> iteration %d\n", i + 1); // indicate which iteration
+  if (user_state == 1) {
+    ShowBlock(stdout, src, SOURCE_USER);
+    ShowStatistics(stdout, src);
+    fflush(stdout); // one write per iteration
+    StageEnd(PROFILE_MONITOR, STAGE_RENDER, stage);
+    return;
+  }
+  ShowMemoryUsage();
+  printf("----------------------------\n");
+  printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot) \n");
+  for (int m = 0; m < i; m++) {
+    putchar('\n');
+  }
+  ShowMemoryRow(stdout, src, i);
+  for (int c = 1; c < src->sample_size - i; c++) {
+    putchar('\n');
+  }
+  if (src->wanted[SOURCE_USER] == 1) {
+    ShowBlock(stdout, src, SOURCE_USER);
+  }
+  ShowBlock(stdout, src, SOURCE_CPU);
+  ShowStatistics(stdout, src);
+  ShowMissed(stdout, src);
+  printf("----------------------------\n");
+  fflush(stdout); // one write per iteration
+  StageEnd(PROFILE_MONITOR, STAGE_RENDER, stage);
+}
+
+/**
+ * @brief read the profiles the child programs send after their last sample
+ *
+ * Blocks until every child program ended.
+ *
+ * @param src the sources
+ */
+void CollectProfiles(struct sources *src) {
+  struct frame_header hdr;
+  const char *payload;
+  for (int i = 0; i < SOURCE_NUM; i++) {
+    if (src->wanted[i] == 0) {
+      continue;
+    }
+    while (ReadFrame(&src->readers[i], &hdr, &payload)) {
+      if (hdr.type == FRAME_STATS) {
+        DecodeStatsFrame(payload, hdr.len);
+      }
+    }
+  }
+}
 
-  // to print each iteration in sequential form
-  if (sequential_state == 1) {
-    for (int i = 0; i < sample_size; i++) {
-      printf(">>> iteration %d\n", i + 1); // indicate which iteration
-      ShowMemoryUsage();
-      printf("----------------------------\n");
-      printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot) \n");
-      for (int m = 0; m < i; m++) {
-        printf("\n");
+/**
+ * @brief display the samples of the collectors as they arrive
+ *
+ * In refreshing form the screen is redrawn as soon as any collector delivers
+ * a sample. In sequential form each iteration is printed once all collectors
+ * delivered it, a late collector is noted instead of waited for.
+ *
+ * @param src where the samples come from
+ * @param sequential_state if 1, then print output in sequential form
+ * @param user_state if 1, then only user info is shown
+ */
+void ShowDefault(struct sources *src, int sequential_state, int user_state) {
+  int next = 0;       // next iteration to print in sequential form
+  int late_mask = -1; // late collectors at the last redraw
+  int changed = 1;    // something arrived since the last redraw
+  struct screen screen;
+
+  // memory is shown as one row per iteration
+  src->mem_rows = calloc(src->sample_size, sizeof(struct mem_usage));
+  if (src->mem_rows == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  if (sequential_state == 0) {
+    if (user_state == 0) {
+      ShowMemoryUsage(); // print memory usage
+    }
+    InitScreen(&screen); // frames are drawn from here on
+  }
+  while (1) {
+    int all_done = 1;
+    for (int i = 0; i < SOURCE_NUM; i++) {
+      all_done = all_done && src->done[i];
+    }
+    if (sequential_state == 1) {
+      while (next < src->sample_size && IterationReady(src, next)) {
+        ShowIteration(src, next, user_state);
+        next++;
       }
-      read_output(mem_file);
-      for (int c = 1; c < sample_size - i; c++) {
-        printf("\n");
+      if (next == src->sample_size) {
+        break;
+      }
+    } else {
+      int mask = LateMask(src);
+      if (changed || mask != late_mask) {
+        DrawScreen(&screen, src, user_state);
+        late_mask = mask;
       }
-      if (system_state == 0) {
-        read_output(user_file);
+      if (all_done) {
+        break;
       }
-      read_output(cpu_file);
-      printf("----------------------------\n");
     }
+    changed = NextSample(src, LATE_CHECK_MS);
+  }
+  if (user_state == 0) {
     ShowSystemInfo();
-    return;
   }
+  fflush(stdout);
+}
 
-  // else print out result in default form
-
-  // print memory usage
-  ShowMemoryUsage();
+/**
+ * @brief serve the samples of the collectors on a socket as they arrive
+ *
+ * Nothing is shown; every sample that arrives is serialized once, however
+ * many clients ask for it.
+ *
+ * @param src where the samples come from
+ * @param server where the samples are served
+ */
+void ServeSamples(struct sources *src, struct server *server) {
+  while (1) {
+    int all_done = 1;
+    for (int i = 0; i < SOURCE_NUM; i++) {
+      all_done = all_done && src->done[i];
+    }
+    if (all_done) {
+      break;
+    }
+    if (NextSample(src, LATE_CHECK_MS)) {
+      long long stage = StageStart();
+      PublishSamples(server, &src->samples, src->received);
+      StageEnd(PROFILE_MONITOR, STAGE_RENDER, stage);
+    }
+  }
+}
 
-  saveCursorPosition();
-  for (int i = 0; i < sample_size; i++) {
-    restoreCursorPosition();
-    read_output(mem_file);
-    saveCursorPosition();
+/**
+ * @brief send the samples of the collectors to an aggregator as they arrive
+ *
+ * Nothing is shown; the agent sends a batch once enough samples are queued.
+ *
+ * @param src where the samples come from
+ * @param agent where the samples are sent
+ */
+void ForwardSamples(struct sources *src, struct agent *agent) {
+  int before[SOURCE_NUM];
+  while (1) {
+    int all_done = 1;
+    for (int i = 0; i < SOURCE_NUM; i++) {
+      all_done = all_done && src->done[i];
+      before[i] = src->received[i];
+    }
+    if (all_done) {
+      break;
+    }
+    if (NextSample(src, LATE_CHECK_MS)) {
+      long long stage = StageStart();
+      for (int i = 0; i < SOURCE_NUM; i++) {
+        if (src->received[i] != before[i]) {
+          QueueSample(agent, &src->samples, i, src->received[i] - 1);
+        }
+      }
+      StageEnd(PROFILE_MONITOR, STAGE_RENDER, stage);
+    }
+  }
+}
 
-    for (int j = 0; j < sample_size - 1 - i; j++) {
-      printf("\n");
+/**
+ * @brief print every sample of the collectors as a record as it arrives
+ *
+ * The records are buffered and written in batches: everything that arrived
+ * together goes out with one write when there is nothing left to take.
+ *
+ * @param src where the samples come from
+ */
+void StreamSamples(struct sources *src) {
+  PrintRecordHeader(stdout, src->format);
+  while (1) {
+    int all_done = 1;
+    for (int i = 0; i < SOURCE_NUM; i++) {
+      all_done = all_done && src->done[i];
     }
-    if (system_state == 0) {
-      read_output(user_file);
+    if (all_done) {
+      break;
+    }
+    if (NextSample(src, 0) == 0) {
+      long long stage = StageStart();
+      fflush(stdout);
+      StageEnd(PROFILE_MONITOR, STAGE_RENDER, stage);
+      NextSample(src, LATE_CHECK_MS);
     }
-    read_output(cpu_file);
   }
-  ShowSystemInfo();
+  fflush(stdout);
 }
 
 int main(int argc, char *argv[]) {
 
   set_signals(); // set signals
+  // output is flushed once per frame or iteration, not once per line
+  setvbuf(stdout, NULL, _IOFBF, 1 << 16);
 
   // initialize default argvs for child process
-  char *mem_argv[5] = {"memory_stats", "--samples=10", "--tdelay=1", NULL,
-                       NULL};
-  char *cpu_argv[5] = {"cpu_stats", "--samples=10", "--tdelay=1", NULL, NULL};
-  char *user_argv[5] = {"user_stats", "--samples=10", "--tdelay=1", NULL, NULL};
+  // the children send frames, the display options only matter here
+  char *mem_argv[9] = {"memory_stats", "--samples=10", "--tdelay=1",
+                       "--binary",     NULL,           NULL,
+                       NULL,           NULL,           NULL};
+  char *cpu_argv[9] = {"cpu_stats", "--samples=10", "--tdelay=1",
+                       "--binary",  NULL,           NULL,
+                       NULL,        NULL,           NULL};
+  char *user_argv[9] = {"user_stats", "--samples=10", "--tdelay=1",
+                        "--binary",   NULL,           NULL,
+                        NULL,         NULL,           NULL};
+  int child_argc = 5; // next free slot in the argvs above
 
   // set default value of sample size and sampled frequency
   int sample_size = 10;
-  int period = 1;
+  long long period = 1000000; // in microseconds
+  long long max_period = 0;   // longest period with --adaptive
 
   int count_int = 0; // count how many integers user has inputed
   int tem_int = 0;   // store input integer temporarlity
@@ -299,111 +833,340 @@ int main(int argc, char *argv[]) {
   int user_state = 0;
   int graphic_state = 0;
   int sequential_state = 0;
+  int core_state = 0;
+  int thread_state = 0;
+  int self_state = 0;
+  char *history_path = NULL; // record samples into this file
+  char *record_path = NULL;  // capture the raw files into this file
+  char *replay_path = NULL;  // replay the raw files of this capture
+  double speed = 1;          // pace of the replay, 0 for as fast as possible
+  char *root_arg = NULL;     // --root=DIR, passed on to the children
+  char *daemon_path = NULL;  // serve samples on this socket instead
+  char *agent_path = NULL;   // send samples to this aggregator instead
+  char *node_name = NULL;    // name sent to the aggregator
+  int batch = 0;             // samples per write to the aggregator
+  int stats_state = 0;       // show the statistics of every metric
+  struct alerts alerts;      // rules given with --alert
+  int samples_set = 0;       // sample size given on the command line
+  int size_set = 0;          // --samples was given, to confirm it
+  int period_set = 0;        // --tdelay was given, to confirm it
+  int format = FORMAT_SCREEN;
+  long long history_mb = 64; // ring size of a new history file, in MB
 
-  if (argc == 1) // if user enter 0 command line arguments
-  {
-    printf("----------------------------\n");
-    printf("Nbr of samples: %d -- every %d secs\n", sample_size, period);
-    ShowDefault(sample_size, sequential_state, system_state, mem_argv,
-                user_argv, cpu_argv);
-    return 0;
-  } else {
-    // scan all entered arguments
-    for (int i = 1; i < argc; i++) {
-      // if valid arguments enterd, activiate corresponding state
-      if (strcmp(argv[i], "--system") == 0) {
-        system_state = 1;
-      } else if (strcmp(argv[i], "--user") == 0) {
-        user_state = 1;
-      } else if (strcmp(argv[i], "--graphics") == 0) {
-        graphic_state = 1;
-        mem_argv[3] = argv[i];
-        cpu_argv[3] = argv[i];
-        user_argv[3] = argv[i];
-      } else if (strcmp(argv[i], "--sequential") == 0) {
-        sequential_state = 1;
+  memset(&alerts, 0, sizeof(alerts));
+
+  // scan all entered arguments
+  for (int i = 1; i < argc; i++) {
+    // if valid arguments enterd, activiate corresponding state
+    if (strcmp(argv[i], "--system") == 0) {
+      system_state = 1;
+    } else if (strcmp(argv[i], "--user") == 0) {
+      user_state = 1;
+    } else if (strcmp(argv[i], "--graphics") == 0) {
+      graphic_state = 1;
+    } else if (strcmp(argv[i], "--sequential") == 0) {
+      sequential_state = 1;
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      thread_state = 1;
+    } else if (strcmp(argv[i], "--cores") == 0) {
+      core_state = 1;
+    } else if (strcmp(argv[i], "--self-stats") == 0) {
+      self_state = 1;
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats_state = 1;
+    } else if (strncmp(argv[i], "--alert=", 8) == 0) {
+      if (alerts.count == MAX_ALERTS ||
+          ParseAlert(argv[i] + 8, &alerts.rules[alerts.count]) < 0) {
+        printf("Invalid alert rule %s\n", argv[i] + 8);
+        exit(0);
       }
-      // if sample size or frequency changed
-      // update it and show message with current value
-      else if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
-               (sample_size > 0)) {
-        printf("The current sample size is %d\n", sample_size);
-      } else if (sscanf(argv[i], "--tdelay=%d", &period) == 1 && (period > 0)) {
-        printf("The current sample frequency is %d sec\n", period);
+      alerts.count++;
+    } else if (strncmp(argv[i], "--alert-to=", 11) == 0) {
+      if (ParseAlertSink(argv[i] + 11, &alerts) < 0) {
+        printf("Invalid alert destination %s\n", argv[i] + 11);
+        exit(0);
       }
-      // if integer entered
-      else if (sscanf(argv[i], "%d", &tem_int) == 1 && (tem_int > 0)) {
-        if (count_int == 2) {
-          printf("To many input integers!\n"); // if already have 2 integers,
-                                               // display error message
-          exit(0);
-        } else if (count_int == 1) { // if only 1 integer enterd, store the
-          // second one as new frequency
-          period = tem_int;
-          tem_int = 0;
-          count_int = 2;
-        } else if (count_int == 0) {
-          // if it is the first integer, store the value as new sample size
-          sample_size = tem_int;
-          tem_int = 0;
-          count_int = 1;
-        }
-      } else {
-        // display error message for any other arguments
-        printf("Invalid command line arguments\n");
+    } else if (ParseRoot(argv[i])) {
+      root_arg = argv[i];
+    } else if (ParseFormat(argv[i], &format)) {
+      continue;
+    } else if (strncmp(argv[i], "--daemon=", 9) == 0 && argv[i][9] != '\0') {
+      daemon_path = argv[i] + 9;
+    } else if (strncmp(argv[i], "--agent=", 8) == 0 && argv[i][8] != '\0') {
+      agent_path = argv[i] + 8;
+    } else if (strncmp(argv[i], "--node=", 7) == 0 && argv[i][7] != '\0') {
+      node_name = argv[i] + 7;
+    } else if (sscanf(argv[i], "--batch=%d", &batch) == 1 && batch > 0) {
+      continue;
+    } else if (strncmp(argv[i], "--history=", 10) == 0 &&
+               argv[i][10] != '\0') {
+      history_path = argv[i] + 10;
+    } else if (sscanf(argv[i], "--history-size=%lld", &history_mb) == 1 &&
+               history_mb > 0) {
+      continue;
+    } else if (strncmp(argv[i], "--record=", 9) == 0 && argv[i][9] != '\0') {
+      record_path = argv[i] + 9;
+    } else if (strncmp(argv[i], "--replay=", 9) == 0 && argv[i][9] != '\0') {
+      replay_path = argv[i] + 9;
+    } else if (sscanf(argv[i], "--speed=%lf", &speed) == 1 && speed >= 0) {
+      continue;
+    }
+    // if sample size or frequency changed, update it
+    else if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
+             (sample_size > 0)) {
+      samples_set = 1;
+      size_set = 1;
+    } else if (strncmp(argv[i], "--tdelay=", 9) == 0 &&
+               ParsePeriod(argv[i] + 9, &period)) {
+      period_set = 1;
+    } else if (ParseAdaptive(argv[i], &period, &max_period)) {
+      period_set = 1;
+    }
+    // if integer entered
+    else if (sscanf(argv[i], "%d", &tem_int) == 1 && (tem_int > 0)) {
+      if (count_int == 2) {
+        printf("To many input integers!\n"); // if already have 2 integers,
+                                             // display error message
         exit(0);
+      } else if (count_int == 1) { // if only 1 integer enterd, store the
+        // second one as new frequency
+        period = tem_int * 1000000LL;
+        tem_int = 0;
+        count_int = 2;
+      } else if (count_int == 0) {
+        // if it is the first integer, store the value as new sample size
+        sample_size = tem_int;
+        samples_set = 1;
+        tem_int = 0;
+        count_int = 1;
       }
+    } else {
+      // display error message for any other arguments
+      printf("Invalid command line arguments\n");
+      exit(0);
     }
   }
 
-  // show current sample size and frequency
-  printf("----------------------------\n");
-  printf("Nbr of samples: %d -- every %d secs\n", sample_size, period);
+  if (daemon_path != NULL && agent_path != NULL) {
+    printf("Command combination invalid\n");
+    exit(0);
+  }
+  if (alerts.sink == ALERT_STDOUT && format == FORMAT_CSV) {
+    // a free-form line would break the columns of the csv stream
+    printf("Command combination invalid\n");
+    exit(0);
+  }
+  if (replay_path != NULL && (record_path != NULL || thread_state == 1)) {
+    printf("Command combination invalid\n");
+    exit(0);
+  }
+  if ((daemon_path != NULL || agent_path != NULL) && samples_set == 0) {
+    sample_size = INT_MAX; // a daemon or agent samples until it is stopped
+  }
+  struct replay replay;
+  if (replay_path != NULL) {
+    if (OpenReplay(&replay, replay_path, speed) < 0) {
+      exit(1);
+    }
+    // as many samples as were recorded, on the period they were taken on
+    if (samples_set == 0 || sample_size > replay.ticks) {
+      sample_size = replay.ticks;
+    }
+    period = replay.period;
+    max_period = 0; // paced by the recorded times instead
+  }
+  if (record_path != NULL) {
+    // the recorder takes the bytes the collector threads parse, on a record
+    // for every tick of the period
+    thread_state = 1;
+    max_period = 0;
+  }
+  if (max_period < period) {
+    max_period = period; // not adaptive
+  }
+  // show current sample size and frequency, records come without any text
+  if (format == FORMAT_SCREEN) {
+    if (size_set == 1) {
+      printf("The current sample size is %d\n", sample_size);
+    }
+    if (period_set == 1 && max_period > period) {
+      printf("The current sample frequency is %g to %g sec\n", period * 1e-6,
+             max_period * 1e-6);
+    } else if (period_set == 1) {
+      printf("The current sample frequency is %g sec\n", period * 1e-6);
+    }
+    printf("----------------------------\n");
+    if (max_period > period) {
+      printf("Nbr of samples: %d -- every %g to %g secs\n", sample_size,
+             period * 1e-6, max_period * 1e-6);
+    } else {
+      printf("Nbr of samples: %d -- every %g secs\n", sample_size,
+             period * 1e-6);
+    }
+  }
   char sample_size_string[20];
-  char period_string[20];
+  char period_string[40];
+  char epoch_string[60];
+  char adaptive_string[80];
+  // all collectors wake on the ticks of the same epoch
+  long long start = MonotonicNow();
+  long long real = RealtimeNow();
   snprintf(sample_size_string, 20, "--samples=%d", sample_size);
-  snprintf(period_string, 20, "--tdelay=%d", period);
+  snprintf(period_string, 40, "--tdelay=%lldus", period);
+  snprintf(epoch_string, 60, "--epoch=%lld,%lld", start, real);
   mem_argv[1] = sample_size_string;
   cpu_argv[1] = sample_size_string;
   user_argv[1] = sample_size_string;
   mem_argv[2] = period_string;
   cpu_argv[2] = period_string;
   user_argv[2] = period_string;
+  mem_argv[4] = epoch_string;
+  cpu_argv[4] = epoch_string;
+  user_argv[4] = epoch_string;
+  if (self_state == 1) {
+    // the children time their stages and send them after the last sample
+    EnableProfile();
+    mem_argv[child_argc] = "--self-stats";
+    cpu_argv[child_argc] = "--self-stats";
+    user_argv[child_argc] = "--self-stats";
+    child_argc++;
+  }
+  if (root_arg != NULL) {
+    // the children read the same captured files as the threads would
+    mem_argv[child_argc] = root_arg;
+    cpu_argv[child_argc] = root_arg;
+    user_argv[child_argc] = root_arg;
+    child_argc++;
+  }
+  if (max_period > period) {
+    // each child adapts to how fast its own values change
+    snprintf(adaptive_string, sizeof(adaptive_string),
+             "--adaptive=%lldus,%lldus", period, max_period);
+    mem_argv[child_argc] = adaptive_string;
+    cpu_argv[child_argc] = adaptive_string;
+    user_argv[child_argc] = adaptive_string;
+    child_argc++;
+  }
+  // which collectors are needed
+  int sources[SOURCE_NUM] = {1, system_state == 0, 1};
   if (user_state == 1) // if user state is avtivate
   {
-    if (system_state == 1 || graphic_state == 1) {
+    if (system_state == 1 || graphic_state == 1 || core_state == 1) {
       // any combination with other tate is considerd as invalid
       printf("Command combination invalid\n");
       exit(0);
-    } else {
-      // if only user_only state is activated
-      // display user information according to period and sample size
-      int user_fd[2];
-      RunStats(user_fd, "./user_stats", user_argv);
-      close(user_fd[1]);
-      FILE *user_file = fdopen(user_fd[0], "r");
-      if (user_file == NULL) {
-        perror("fdopen");
+    }
+    // if only user_only state is activated
+    // display user information according to period and sample size
+    sources[SOURCE_MEM] = 0;
+    sources[SOURCE_CPU] = 0;
+  }
+
+  // start the collectors, either as threads or as child programs
+  struct sources src;
+  struct collector collector;
+  struct history history;
+  struct recorder recorder;
+  StartProfile(PROFILE_MONITOR);
+  // a collector is only late once its longest period passed twice
+  InitSources(&src, sources, sample_size, max_period, graphic_state,
+              core_state);
+  src.format = format;
+  struct metric_set metrics;
+  if (stats_state == 1 || alerts.count > 0) {
+    InitMetrics(&metrics);
+    src.metrics = &metrics;
+    if (stats_state == 1) {
+      src.samples.metrics = &metrics;
+    }
+  }
+  if (alerts.count > 0) {
+    alerts.format = format;
+    alerts.framed = format == FORMAT_SCREEN && sequential_state == 0;
+    src.alerts = &alerts;
+  }
+  if (history_path != NULL) {
+    if (OpenHistory(&history, history_path, history_mb << 20, 1) < 0) {
+      exit(1);
+    }
+    src.history = &history;
+  }
+  if (record_path != NULL) {
+    StartRecorder(&recorder, record_path, sources, sample_size, period, real);
+  }
+  if (replay_path != NULL) {
+    src.replay = &replay;
+  } else if (thread_state == 1) {
+    StartCollector(&collector, sources, sample_size, period, max_period, start,
+                   real, record_path != NULL ? &recorder : NULL);
+    src.collector = &collector;
+  } else {
+    if (sources[SOURCE_MEM] == 1) {
+      OpenStats(&src, SOURCE_MEM, "memory_stats", mem_argv);
+    }
+    if (sources[SOURCE_USER] == 1) {
+      OpenStats(&src, SOURCE_USER, "user_stats", user_argv);
+    }
+    if (sources[SOURCE_CPU] == 1) {
+      OpenStats(&src, SOURCE_CPU, "cpu_stats", cpu_argv);
+    }
+  }
+
+  if (daemon_path != NULL) {
+    struct server server;
+    StartServer(&server, daemon_path);
+    printf("Serving samples on %s\n", daemon_path);
+    fflush(stdout);
+    ServeSamples(&src, &server);
+    StopServer(&server);
+  } else if (agent_path != NULL) {
+    struct agent agent;
+    struct utsname uts;
+    if (node_name == NULL) {
+      if (uname(&uts) < 0) {
+        perror("uname");
         exit(1);
       }
-      if (sequential_state == 1) {
-        for (int i = 0; i < sample_size; i++) {
-          printf(">>> iteration %d\n", i + 1);
-          read_output(user_file);
-        }
-      } else {
-        saveCursorPosition();
-        for (int i = 0; i < sample_size; i++) {
-          restoreCursorPosition();
-          saveCursorPosition();
-          read_output(user_file);
-        }
+      node_name = uts.nodename;
+    }
+    if (batch == 0) {
+      // one write per tick, with the sample of every collector
+      for (int i = 0; i < SOURCE_NUM; i++) {
+        batch += sources[i];
       }
-
-      return 0;
     }
+    StartAgent(&agent, agent_path, node_name, batch);
+    ForwardSamples(&src, &agent);
+    StopAgent(&agent);
+  } else if (format != FORMAT_SCREEN) {
+    StreamSamples(&src);
+  } else {
+    ShowDefault(&src, sequential_state, user_state);
+  }
+  StopProfile(PROFILE_MONITOR);
+  if (replay_path != NULL) {
+    if (speed == 0) {
+      // replayed as a benchmark of everything but the reads
+      double secs = (MonotonicNow() - replay.started) * 1e-9;
+      fprintf(stderr, "replayed %d samples in %.3f s, %.0f per second\n",
+              replay.taken, secs, secs > 0 ? replay.taken / secs : 0);
+    }
+    CloseReplay(&replay);
+  } else if (thread_state == 1) {
+    StopCollector(&collector);
+  } else if (self_state == 1) {
+    CollectProfiles(&src);
+  }
+  if (record_path != NULL) {
+    StopRecorder(&recorder);
+  }
+  if (self_state == 1) {
+    // keep records and the profile apart
+    PrintProfile(format == FORMAT_SCREEN ? stdout : stderr);
+    fflush(stdout);
+  }
+  if (src.history != NULL) {
+    CloseHistory(src.history);
   }
-  ShowDefault(sample_size, sequential_state, system_state, mem_argv, user_argv,
-              cpu_argv);
   return 0;
-}
\ No newline at end of file
+}
@@ -1,70 +1,317 @@
-
-#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <utmp.h>
 
+#include "procfs.h"
+#include "profile.h"
+#include "user_stats.h"
+
+static int utmp_fd = -1;             // utmp, kept open between samples
+static int utmp_watch = -1;          // inotify fd watching utmp, -1 if none
+static struct utmp *seen = NULL;     // records as of the last scan
+static struct utmp *fresh = NULL;    // records read by the scan under way
+static size_t seen_count = 0;        // number of records in seen
+static size_t seen_size = 0;         // records allocated in seen and fresh
+static struct user_list cache = {0}; // sessions as of the last scan
+static int rescan = 0;               // scan utmp even if it did not change
+
 /**
- * @brief main function for getting user info
+ * @brief copy a fixed size utmp field into a nul terminated string
  *
- * Sample once every 1 sec and sample total of 10 times in default
- * Able to take command line argument to print each itertion in either
- * sequential or refreshing form.
- *
- * @param argc
- * @param argv
- * @return int
+ * @param dst buffer of at least size + 1 bytes
+ * @param src utmp field, not necessarily nul terminated
+ * @param size size of the utmp field
  */
+static void CopyField(char *dst, const char *src, size_t size) {
+  strncpy(dst, src, size);
+  dst[size] = '\0';
+}
 
-int main(int argc, char *argv[]) {
-  const char *special_string =
-      "##SPECIAL_STRING##"; // indicate one iteration has done
-  setbuf(stdout, NULL);     // disable buff
-  int sample_size = 10;
-  int period = 1;
-
-  // set the ctrl-c signal and ctrl-z to be ignored
-  if (signal(SIGINT, SIG_IGN) == SIG_ERR ||
-      signal(SIGTSTP, SIG_IGN) == SIG_ERR) {
-    perror("signal");
+/**
+ * @brief make room for at least count sessions in a list
+ *
+ * @param list the list
+ * @param count number of sessions needed
+ */
+static void ReserveUsers(struct user_list *list, int count) {
+  if (count <= list->size) {
+    return;
+  }
+  while (list->size < count) {
+    list->size = list->size == 0 ? 16 : list->size * 2;
+  }
+  list->sessions = realloc(list->sessions, list->size * sizeof(struct session));
+  if (list->sessions == NULL) {
+    perror("realloc");
     exit(1);
   }
+}
 
-  if (argc > 1) {
-    // scan entered arguments
-    for (int i = 1; i < argc; i++) {
-      if (sscanf(argv[i], "--samples=%d", &sample_size) == 1 &&
-          (sample_size > 0)) {
-        continue;
-      } else if (sscanf(argv[i], "--tdelay=%d", &period) == 1 && (period > 0)) {
+/**
+ * @brief forget the open utmp, so the next sample opens it again
+ */
+static void CloseUtmp() {
+  if (utmp_watch >= 0) {
+    close(utmp_watch);
+  }
+  if (utmp_fd >= 0) {
+    close(utmp_fd);
+  }
+  utmp_watch = -1;
+  utmp_fd = -1;
+  seen_count = 0;
+  cache.count = 0;
+}
+
+/**
+ * @brief open utmp and start watching it for changes
+ *
+ * Without inotify utmp is compared with the last scan on every sample.
+ *
+ * @return 0 on success, -1 if utmp could not be opened
+ */
+static int OpenUtmp() {
+  char path[8192];
+  utmp_fd = OpenProc(UTMP_FILE, O_RDONLY | O_CLOEXEC);
+  if (utmp_fd < 0) {
+    return -1;
+  }
+  utmp_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (utmp_watch >= 0 &&
+      inotify_add_watch(utmp_watch, ProcPath(UTMP_FILE, path, sizeof(path)),
+                        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                            IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+    close(utmp_watch);
+    utmp_watch = -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief drain the inotify events of utmp
+ *
+ * @return 0 if utmp did not change, 1 if it changed, 2 if it was replaced
+ */
+static int UtmpChanged() {
+  if (utmp_watch < 0) {
+    return 1;
+  }
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int changed = 0;
+  while (1) {
+    ssize_t len = read(utmp_watch, buf, sizeof(buf));
+    if (len < 0) {
+      if (errno == EINTR) {
         continue;
       }
+      break; // EAGAIN, no more events
     }
+    for (char *p = buf; p < buf + len;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+        return 2;
+      }
+      changed = 1;
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+  // a file moved over utmp only unlinks the one we hold open
+  char path[8192];
+  struct stat now, held;
+  if (changed &&
+      (stat(ProcPath(UTMP_FILE, path, sizeof(path)), &now) < 0 ||
+       fstat(utmp_fd, &held) < 0 || now.st_ino != held.st_ino ||
+       now.st_dev != held.st_dev)) {
+    return 2;
+  }
+  return changed;
+}
+
+/**
+ * @brief make room for at least count records in seen and fresh
+ *
+ * @param count number of records needed
+ */
+static void ReserveRecords(size_t count) {
+  if (count <= seen_size) {
+    return;
+  }
+  seen_size = count;
+  seen = realloc(seen, seen_size * sizeof(struct utmp));
+  fresh = realloc(fresh, seen_size * sizeof(struct utmp));
+  if (seen == NULL || fresh == NULL) {
+    perror("realloc");
+    exit(1);
+  }
+}
+
+/**
+ * @brief read utmp and compare it with the last scan
+ *
+ * utmp is read with pread rather than mapped: login managers rewrite it in
+ * place, and touching a mapping past the end of a file truncated meanwhile
+ * raises SIGBUS. A read just returns fewer bytes, and a partial record at
+ * the end is left out.
+ *
+ * @return 1 if any record changed, 0 otherwise
+ */
+static int ScanUtmp() {
+  struct stat st;
+  if (fstat(utmp_fd, &st) < 0) {
+    perror("fstat");
+    exit(1);
   }
-  for (int i = 0; i < sample_size; i++) {
-    printf("----------------------------\n");
-    printf("### Sessions/users ### \n");
-    struct utmp *data;
-    setutent();
-    data = getutent(); // get user data
-    if (data == NULL) {
-      perror("getutent"); // if fail to get user info
+  // one record more than the file holds tells whether it grew meanwhile
+  ReserveRecords(st.st_size / sizeof(struct utmp) + 1);
+  ssize_t len;
+  while (1) {
+    len = pread(utmp_fd, fresh, seen_size * sizeof(struct utmp), 0);
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("pread");
       exit(1);
     }
-    while (data != NULL) {
-      // only print out normal user process
-      if (data->ut_type == USER_PROCESS) {
-        // print out user information
-        printf("%s %s %s\n", data->ut_name, data->ut_line, data->ut_host);
-      }
-      data = getutent(); // next user
+    if ((size_t)len < seen_size * sizeof(struct utmp)) {
+      break;
+    }
+    ReserveRecords(seen_size * 2);
+  }
+
+  size_t count = len / sizeof(struct utmp);
+  int changed = count != seen_count ||
+                memcmp(seen, fresh, count * sizeof(struct utmp)) != 0;
+  struct utmp *tmp = seen;
+  seen = fresh;
+  fresh = tmp;
+  seen_count = count;
+  return changed;
+}
+
+/**
+ * @brief add a record to a list of sessions if it is a normal user process
+ *
+ * @param list the list
+ * @param u the utmp record
+ */
+static void AddSession(struct user_list *list, const struct utmp *u) {
+  if (u->ut_type != USER_PROCESS) {
+    return;
+  }
+  ReserveUsers(list, list->count + 1);
+  struct session *s = &list->sessions[list->count++];
+  CopyField(s->name, u->ut_name, UT_NAMESIZE);
+  CopyField(s->line, u->ut_line, UT_LINESIZE);
+  CopyField(s->host, u->ut_host, UT_HOSTSIZE);
+}
+
+/**
+ * @brief rebuild the sessions from the records of the last scan
+ */
+static void BuildSessions() {
+  // only keep normal user process
+  cache.count = 0;
+  for (size_t i = 0; i < seen_count; i++) {
+    AddSession(&cache, &seen[i]);
+  }
+}
+
+/**
+ * @brief read all normal user processes from utmp
+ *
+ * utmp is kept open and watched with inotify, so it is only read again
+ * after it changed; otherwise the sessions of the last scan are returned.
+ *
+ * @param list where to store the sessions
+ * @return 0 on success, -1 if utmp could not be read
+ */
+int ReadUsers(struct user_list *list) {
+  int changed = 1;
+  long long start = StageStart();
+  if (utmp_fd >= 0) {
+    changed = UtmpChanged();
+    if (changed == 2) {
+      CloseUtmp(); // replaced, watch the new file
     }
-    endutent();
-    printf("%s\n", special_string);
-    sleep(period);
   }
+  if (utmp_fd < 0 && OpenUtmp() < 0) {
+    return -1;
+  }
+  if (changed || rescan) {
+    changed = ScanUtmp();
+    rescan = 0;
+  }
+  StageEnd(PROFILE_USER, STAGE_READ, start);
+  start = StageStart();
+  if (changed) {
+    BuildSessions();
+  }
+  ReserveUsers(list, cache.count);
+  if (cache.count > 0) {
+    memcpy(list->sessions, cache.sessions,
+           cache.count * sizeof(struct session));
+  }
+  list->count = cache.count;
+  StageEnd(PROFILE_USER, STAGE_PARSE, start);
+  return 0;
+}
+
+/**
+ * @brief the records of utmp the last ReadUsers() built its sessions from
+ *
+ * @param len where to store the number of bytes
+ * @return the records, valid until the next read
+ */
+const char *LastUtmp(size_t *len) {
+  *len = seen_count * sizeof(struct utmp);
+  return (const char *)seen;
+}
+
+/**
+ * @brief parse the normal user processes out of a copy of utmp
+ *
+ * @param buf content of utmp, a partial record at its end is ignored
+ * @param len number of bytes in buf
+ * @param list where to store the sessions
+ */
+void ParseUsers(const char *buf, size_t len, struct user_list *list) {
+  struct utmp u;
+  list->count = 0;
+  for (size_t off = 0; off + sizeof(u) <= len; off += sizeof(u)) {
+    memcpy(&u, buf + off, sizeof(u)); // buf need not be aligned
+    AddSession(list, &u);
+  }
+}
+
+/**
+ * @brief forget the last scan of utmp, so the next ReadUsers() copies and
+ * parses every record again
+ */
+void ResetUsers() {
+  seen_count = 0;
+  cache.count = 0;
+  rescan = 1;
+}
 
-  exit(0);
+/**
+ * @brief Displaying the user information of one sample
+ *
+ * @param out where to print
+ * @param list sessions to display
+ */
+void PrintUsers(FILE *out, const struct user_list *list) {
+  fprintf(out, "----------------------------\n");
+  fprintf(out, "### Sessions/users ### \n");
+  for (int i = 0; i < list->count; i++) {
+    // print out user information
+    fprintf(out, "%s %s %s\n", list->sessions[i].name, list->sessions[i].line,
+            list->sessions[i].host);
+  }
 }
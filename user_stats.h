@@ -0,0 +1,35 @@
+#ifndef USER_STATS_H
+#define USER_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <utmp.h>
+
+/**
+ * @brief one logged in user as read from utmp, strings nul terminated
+ */
+struct session {
+  char name[UT_NAMESIZE + 1];
+  char line[UT_LINESIZE + 1];
+  char host[UT_HOSTSIZE + 1];
+};
+
+/**
+ * @brief all sessions of one sample
+ *
+ * sessions grows only when more users are logged in than ever before, so
+ * steady state sampling does not allocate.
+ */
+struct user_list {
+  int count;                 // number of sessions read
+  int size;                  // number of sessions allocated
+  struct session *sessions;
+};
+
+int ReadUsers(struct user_list *list);
+const char *LastUtmp(size_t *len);
+void ParseUsers(const char *buf, size_t len, struct user_list *list);
+void ResetUsers();
+void PrintUsers(FILE *out, const struct user_list *list);
+
+#endif